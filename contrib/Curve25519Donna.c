@@ -4,112 +4,495 @@
 */
 
 #include "Curve25519Donna.h"
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
-extern void curve25519_donna(unsigned char *output, const unsigned char *a,
-                             const unsigned char *b);
+#include "curve25519-donna.h"
 
-unsigned char*
-as_unsigned_char_array(JNIEnv* env, jbyteArray array, int* len);
+/*
+    Keys are copied between Java arrays and 32-byte buffers on the stack
+    with Get/SetByteArrayRegion, so no call allocates anything in C. Bad
+    arguments throw instead of returning NULL: NullPointerException for a
+    null array and IllegalArgumentException for one that isn't 32 bytes.
+    Every function returns as soon as an exception is pending.
+*/
 
-jbyteArray as_byte_array(JNIEnv* env, unsigned char* buf, int len);
+static const unsigned char basepoint[32] = {9};
+
+static void throw_new(JNIEnv *env, const char *class_name, const char *msg) {
+    jclass cls = (*env)->FindClass(env, class_name);
+    if (cls != NULL) {
+        (*env)->ThrowNew(env, cls, msg);
+        (*env)->DeleteLocalRef(env, cls);
+    }
+}
 
+/* Throws unless |array| is a 32-byte array. Returns 0 if it is. */
+static int check_key(JNIEnv *env, jbyteArray array, const char *name) {
+    if (array == NULL) {
+        throw_new(env, "java/lang/NullPointerException", name);
+        return -1;
+    }
+    if ((*env)->GetArrayLength(env, array) != 32) {
+        throw_new(env, "java/lang/IllegalArgumentException", name);
+        return -1;
+    }
+    return 0;
+}
 
-jbyteArray as_byte_array(JNIEnv* env, unsigned char* buf, int len) {
-    jbyteArray array = (*env)->NewByteArray(env, len);
-    (*env)->SetByteArrayRegion(env, array, 0, len, (jbyte*)buf);
+static int get_key(JNIEnv *env, jbyteArray array, unsigned char key[32],
+                   const char *name) {
+    if (check_key(env, array, name) != 0) return -1;
+    (*env)->GetByteArrayRegion(env, array, 0, 32, (jbyte *) key);
+    return 0;
+}
 
-    //int i;
-    //for (i = 0;i < len;++i) printf("%02x",(unsigned int) buf[i]); printf(" ");
-    //printf("\n");
+static void wipe(unsigned char *buf, size_t len) {
+    volatile unsigned char *p = buf;
+    while (len--) *p++ = 0;
+}
 
+/* Returns a new 32-byte array holding |key|, or NULL with an
+   OutOfMemoryError pending. */
+static jbyteArray new_key(JNIEnv *env, const unsigned char key[32]) {
+    jbyteArray array = (*env)->NewByteArray(env, 32);
+    if (array != NULL) {
+        (*env)->SetByteArrayRegion(env, array, 0, 32, (const jbyte *) key);
+    }
     return array;
 }
 
-unsigned char*
-as_unsigned_char_array(JNIEnv* env, jbyteArray array, int* len) {
+static void clamp(unsigned char k[32]) {
+    k[0] &= 248;
+    k[31] &= 127;
+    k[31] |= 64;
+}
 
-    *len = (*env)->GetArrayLength(env, array);
-    unsigned char* buf = (unsigned char*)calloc(*len+1, sizeof(char));
-    (*env)->GetByteArrayRegion (env, array, 0, *len, (jbyte*)buf);
-    return buf;
+/* The shared part of each method and its ...Into variant: checks the
+   arguments and computes the result into |o|. */
 
+static int do_curve25519(JNIEnv *env, unsigned char o[32], jbyteArray a,
+                         jbyteArray b) {
+    unsigned char a1[32], b1[32];
+    if (get_key(env, a, a1, "a must be 32 bytes") != 0 ||
+        get_key(env, b, b1, "b must be 32 bytes") != 0) {
+        wipe(a1, 32);
+        return -1;
+    }
+    curve25519_donna(o, a1, b1);
+    wipe(a1, 32);
+    return 0;
 }
 
-JNIEXPORT jbyteArray JNICALL Java_Curve25519Donna_curve25519Donna
-  (JNIEnv *env, jobject obj, jbyteArray a, jbyteArray b) {
+static int do_make_private(JNIEnv *env, unsigned char o[32],
+                           jbyteArray secret) {
+    if (get_key(env, secret, o, "secret must be 32 bytes") != 0) return -1;
+    clamp(o);
+    return 0;
+}
 
-    unsigned char o[32] = {0};
-    int l1, l2;
-    unsigned char* a1 = as_unsigned_char_array(env, a, &l1);
-    unsigned char* b1 = as_unsigned_char_array(env, b, &l2);
+static int do_get_public(JNIEnv *env, unsigned char o[32],
+                         jbyteArray privkey) {
+    unsigned char private[32];
+    if (get_key(env, privkey, private, "privkey must be 32 bytes") != 0) {
+        return -1;
+    }
+    curve25519_donna(o, private, basepoint);
+    wipe(private, 32);
+    return 0;
+}
 
-    if ( !(l1 == 32 && l2 == 32) ) {
-        fprintf(stderr, "Error, must be length 32");
-        return NULL;
+static int do_make_shared_secret(JNIEnv *env, unsigned char o[32],
+                                 jbyteArray privkey, jbyteArray their_pubkey) {
+    unsigned char private[32], pubkey[32];
+    if (get_key(env, privkey, private, "privkey must be 32 bytes") != 0 ||
+        get_key(env, their_pubkey, pubkey,
+                "theirPubKey must be 32 bytes") != 0) {
+        wipe(private, 32);
+        return -1;
     }
+    curve25519_donna(o, private, pubkey);
+    wipe(private, 32);
+    return 0;
+}
 
+/* Copies |o| into |out| and wipes it. */
+static void put_key(JNIEnv *env, jbyteArray out, unsigned char o[32]) {
+    (*env)->SetByteArrayRegion(env, out, 0, 32, (const jbyte *) o);
+    wipe(o, 32);
+}
 
-    curve25519_donna(o, (const unsigned char*)a1, (const unsigned char*)b1);
+static jbyteArray return_key(JNIEnv *env, unsigned char o[32]) {
+    jbyteArray array = new_key(env, o);
+    wipe(o, 32);
+    return array;
+}
 
-    free(a1);
-    free(b1);
+JNIEXPORT jbyteArray JNICALL Java_Curve25519Donna_curve25519Donna
+  (JNIEnv *env, jobject obj, jbyteArray a, jbyteArray b) {
 
-    return as_byte_array(env, (unsigned char*)o, 32);
+    unsigned char o[32];
+    if (do_curve25519(env, o, a, b) != 0) return NULL;
+    return return_key(env, o);
 }
 
 JNIEXPORT jbyteArray JNICALL Java_Curve25519Donna_makePrivate
   (JNIEnv *env, jobject obj, jbyteArray secret) {
 
-    int len;
-    unsigned char* k = as_unsigned_char_array(env, secret, &len);
+    unsigned char o[32];
+    if (do_make_private(env, o, secret) != 0) return NULL;
+    return return_key(env, o);
+}
+
+JNIEXPORT jbyteArray JNICALL Java_Curve25519Donna_getPublic
+  (JNIEnv *env, jobject obj, jbyteArray privkey) {
+
+    unsigned char o[32];
+    if (do_get_public(env, o, privkey) != 0) return NULL;
+    return return_key(env, o);
+}
+
+JNIEXPORT jbyteArray JNICALL Java_Curve25519Donna_makeSharedSecret
+  (JNIEnv *env, jobject obj, jbyteArray privkey, jbyteArray their_pubkey) {
 
-    if (len != 32) {
-        fprintf(stderr, "Error, must be length 32");        
+    unsigned char o[32];
+    if (do_make_shared_secret(env, o, privkey, their_pubkey) != 0) {
         return NULL;
     }
+    return return_key(env, o);
+}
 
-    k[0] &= 248;
-    k[31] &= 127;
-    k[31] |= 64;
-    return as_byte_array(env, k, 32);
+/* The ...Into variants write to a caller-supplied 32-byte array instead of
+   allocating one. */
+
+JNIEXPORT void JNICALL Java_Curve25519Donna_curve25519DonnaInto
+  (JNIEnv *env, jobject obj, jbyteArray out, jbyteArray a, jbyteArray b) {
+
+    unsigned char o[32];
+    if (check_key(env, out, "out must be 32 bytes") != 0 ||
+        do_curve25519(env, o, a, b) != 0) {
+        return;
+    }
+    put_key(env, out, o);
 }
 
-JNIEXPORT jbyteArray JNICALL Java_Curve25519Donna_getPublic
-  (JNIEnv *env, jobject obj, jbyteArray privkey) {
+JNIEXPORT void JNICALL Java_Curve25519Donna_makePrivateInto
+  (JNIEnv *env, jobject obj, jbyteArray out, jbyteArray secret) {
+
+    unsigned char o[32];
+    if (check_key(env, out, "out must be 32 bytes") != 0 ||
+        do_make_private(env, o, secret) != 0) {
+        return;
+    }
+    put_key(env, out, o);
+}
+
+JNIEXPORT void JNICALL Java_Curve25519Donna_getPublicInto
+  (JNIEnv *env, jobject obj, jbyteArray out, jbyteArray privkey) {
+
+    unsigned char o[32];
+    if (check_key(env, out, "out must be 32 bytes") != 0 ||
+        do_get_public(env, o, privkey) != 0) {
+        return;
+    }
+    put_key(env, out, o);
+}
+
+JNIEXPORT void JNICALL Java_Curve25519Donna_makeSharedSecretInto
+  (JNIEnv *env, jobject obj, jbyteArray out, jbyteArray privkey,
+   jbyteArray their_pubkey) {
+
+    unsigned char o[32];
+    if (check_key(env, out, "out must be 32 bytes") != 0 ||
+        do_make_shared_secret(env, o, privkey, their_pubkey) != 0) {
+        return;
+    }
+    put_key(env, out, o);
+}
+
+/*
+    Batch methods take N keys packed into one array of N * 32 bytes. They
+    cross JNI once, run the keys through curve25519_donna_batch, which shares
+    the field inversions between ladders, and split large batches over
+    threads like curve25519-bulk does.
+*/
+
+#define BATCH 64             /* keys per curve25519_donna_batch call */
+#define MIN_PER_THREAD 256   /* smaller batches stay on the calling thread */
+#define MAX_THREADS 64
+
+struct batch_job {
+    unsigned char *out;
+    const unsigned char *secrets;
+    const unsigned char *points;  /* NULL for the base point */
+    size_t n;
+};
 
-    int len;
-    unsigned char* private = as_unsigned_char_array(env, privkey, &len);
+static void run_batch(const struct batch_job *job) {
+    unsigned char basepoints[BATCH * 32];
+    const unsigned char *points;
+    size_t i, m;
 
-    if (len != 32) {
-        fprintf(stderr, "Error, must be length 32");        
+    if (job->points == NULL) {
+        for (i = 0; i < BATCH; ++i) memcpy(basepoints + i * 32, basepoint, 32);
+    }
+    for (i = 0; i < job->n; i += m) {
+        m = job->n - i < BATCH ? job->n - i : BATCH;
+        points = job->points ? job->points + i * 32 : basepoints;
+        curve25519_donna_batch(job->out + i * 32, job->secrets + i * 32,
+                               points, m);
+    }
+}
+
+static void *batch_thread(void *arg) {
+    run_batch(arg);
+    return NULL;
+}
+
+static void run_batch_threads(unsigned char *out,
+                              const unsigned char *secrets,
+                              const unsigned char *points, size_t n) {
+    struct batch_job jobs[MAX_THREADS];
+    pthread_t threads[MAX_THREADS];
+    int started[MAX_THREADS];
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t nthreads = n / MIN_PER_THREAD, per, begin, t;
+
+    if (cpus < 1) cpus = 1;
+    if (nthreads > (size_t) cpus) nthreads = cpus;
+    if (nthreads > MAX_THREADS) nthreads = MAX_THREADS;
+    if (nthreads < 1) nthreads = 1;
+    /* Whole batches per thread, so that only the last one is short. */
+    per = (n + nthreads - 1) / nthreads;
+    per = (per + BATCH - 1) / BATCH * BATCH;
+
+    for (t = 0, begin = 0; t < nthreads; ++t, begin += per) {
+        jobs[t].out = out + begin * 32;
+        jobs[t].secrets = secrets + begin * 32;
+        jobs[t].points = points ? points + begin * 32 : NULL;
+        jobs[t].n = begin >= n ? 0 : (n - begin < per ? n - begin : per);
+        started[t] = t > 0 && jobs[t].n > 0 &&
+                     pthread_create(&threads[t], NULL, batch_thread,
+                                    &jobs[t]) == 0;
+    }
+    for (t = 0; t < nthreads; ++t) {
+        if (!started[t]) run_batch(&jobs[t]);
+    }
+    for (t = 1; t < nthreads; ++t) {
+        if (started[t]) pthread_join(threads[t], NULL);
+    }
+}
+
+/* Throws unless |array| holds a whole number of keys. Returns the number of
+   keys, or -1. */
+static jsize check_keys(JNIEnv *env, jbyteArray array, const char *name) {
+    jsize len;
+    if (array == NULL) {
+        throw_new(env, "java/lang/NullPointerException", name);
+        return -1;
+    }
+    len = (*env)->GetArrayLength(env, array);
+    if (len % 32 != 0) {
+        throw_new(env, "java/lang/IllegalArgumentException", name);
+        return -1;
+    }
+    return len / 32;
+}
+
+/* Runs a batch from |privkeys| and, unless |public_only|, |pubkeys| into
+   |out|, or into a new array if |out| is NULL. Returns the output array, or
+   NULL with an exception pending. */
+static jbyteArray do_batch(JNIEnv *env, jbyteArray out, jbyteArray privkeys,
+                           jbyteArray pubkeys, int public_only) {
+    unsigned char *buf, *secrets, *points, *o;
+    jsize n, m;
+
+    n = check_keys(env, privkeys,
+                   "privkeys must be a multiple of 32 bytes");
+    if (n < 0) return NULL;
+    if (!public_only) {
+        m = check_keys(env, pubkeys,
+                       "theirPubKeys must be a multiple of 32 bytes");
+        if (m < 0) return NULL;
+        if (m != n) {
+            throw_new(env, "java/lang/IllegalArgumentException",
+                      "privkeys and theirPubKeys must be the same length");
+            return NULL;
+        }
+    }
+    if (out != NULL && (*env)->GetArrayLength(env, out) != n * 32) {
+        throw_new(env, "java/lang/IllegalArgumentException",
+                  "out must be as long as privkeys");
         return NULL;
     }
+    if (out == NULL) {
+        out = (*env)->NewByteArray(env, n * 32);
+        if (out == NULL) return NULL;
+    }
+    if (n == 0) return out;
+
+    buf = malloc((size_t) n * 32 * (public_only ? 2 : 3));
+    if (buf == NULL) {
+        throw_new(env, "java/lang/OutOfMemoryError", "curve25519 batch");
+        return NULL;
+    }
+    secrets = buf;
+    o = buf + (size_t) n * 32;
+    points = public_only ? NULL : o + (size_t) n * 32;
+    (*env)->GetByteArrayRegion(env, privkeys, 0, n * 32, (jbyte *) secrets);
+    if (points) {
+        (*env)->GetByteArrayRegion(env, pubkeys, 0, n * 32, (jbyte *) points);
+    }
 
-    unsigned char pubkey[32];
-    unsigned char basepoint[32] = {9};
+    run_batch_threads(o, secrets, points, n);
+    (*env)->SetByteArrayRegion(env, out, 0, n * 32, (const jbyte *) o);
 
-    curve25519_donna(pubkey, private, basepoint);
-    return as_byte_array(env, (unsigned char*)pubkey, 32);
+    wipe(buf, (size_t) n * 32 * (public_only ? 2 : 3));
+    free(buf);
+    return out;
 }
 
-JNIEXPORT jbyteArray JNICALL Java_Curve25519Donna_makeSharedSecret
-  (JNIEnv *env, jobject obj, jbyteArray privkey, jbyteArray their_pubkey) {
+JNIEXPORT jbyteArray JNICALL Java_Curve25519Donna_getPublicBatch
+  (JNIEnv *env, jobject obj, jbyteArray privkeys) {
 
-    unsigned char shared_secret[32];
+    return do_batch(env, NULL, privkeys, NULL, 1);
+}
+
+JNIEXPORT void JNICALL Java_Curve25519Donna_getPublicBatchInto
+  (JNIEnv *env, jobject obj, jbyteArray out, jbyteArray privkeys) {
+
+    if (out == NULL) {
+        throw_new(env, "java/lang/NullPointerException", "out");
+        return;
+    }
+    do_batch(env, out, privkeys, NULL, 1);
+}
+
+JNIEXPORT jbyteArray JNICALL Java_Curve25519Donna_makeSharedSecretBatch
+  (JNIEnv *env, jobject obj, jbyteArray privkeys, jbyteArray their_pubkeys) {
+
+    return do_batch(env, NULL, privkeys, their_pubkeys, 0);
+}
 
-    int l1, l2;
-    unsigned char* private = as_unsigned_char_array(env, privkey, &l1);
-    unsigned char* pubkey = as_unsigned_char_array(env, their_pubkey, &l2);
+JNIEXPORT void JNICALL Java_Curve25519Donna_makeSharedSecretBatchInto
+  (JNIEnv *env, jobject obj, jbyteArray out, jbyteArray privkeys,
+   jbyteArray their_pubkeys) {
 
-    if ( !(l1 == 32 && l2 == 32) ) {
-        fprintf(stderr, "Error, must be length 32");
+    if (out == NULL) {
+        throw_new(env, "java/lang/NullPointerException", "out");
+        return;
+    }
+    do_batch(env, out, privkeys, their_pubkeys, 0);
+}
+
+/*
+    Direct ByteBuffer methods work on the buffers' memory in place: each
+    key is |len| bytes at an absolute offset into the buffer, regardless of
+    its position and limit. Nothing is copied and nothing is allocated.
+*/
+
+/* Returns the address of |len| bytes at |offset| in the direct buffer
+   |buf|, or NULL with an exception pending. */
+static unsigned char *direct(JNIEnv *env, jobject buf, jint offset,
+                             jlong len, const char *name) {
+    unsigned char *p;
+    jlong capacity;
+    if (buf == NULL) {
+        throw_new(env, "java/lang/NullPointerException", name);
+        return NULL;
+    }
+    p = (*env)->GetDirectBufferAddress(env, buf);
+    capacity = (*env)->GetDirectBufferCapacity(env, buf);
+    if (p == NULL || capacity < 0) {
+        throw_new(env, "java/lang/IllegalArgumentException", name);
         return NULL;
     }
+    if (offset < 0 || len > capacity - offset) {
+        throw_new(env, "java/lang/IndexOutOfBoundsException", name);
+        return NULL;
+    }
+    return p + offset;
+}
+
+JNIEXPORT void JNICALL Java_Curve25519Donna_makePrivateDirect
+  (JNIEnv *env, jobject obj, jobject out, jint out_offset, jobject secret,
+   jint secret_offset) {
+
+    unsigned char *o, *k;
+    if ((o = direct(env, out, out_offset, 32, "out")) == NULL ||
+        (k = direct(env, secret, secret_offset, 32, "secret")) == NULL) {
+        return;
+    }
+    memmove(o, k, 32);
+    clamp(o);
+}
+
+JNIEXPORT void JNICALL Java_Curve25519Donna_getPublicDirect
+  (JNIEnv *env, jobject obj, jobject out, jint out_offset, jobject privkey,
+   jint privkey_offset) {
+
+    unsigned char *o, *private;
+    if ((o = direct(env, out, out_offset, 32, "out")) == NULL ||
+        (private = direct(env, privkey, privkey_offset, 32,
+                          "privkey")) == NULL) {
+        return;
+    }
+    curve25519_donna(o, private, basepoint);
+}
+
+JNIEXPORT void JNICALL Java_Curve25519Donna_makeSharedSecretDirect
+  (JNIEnv *env, jobject obj, jobject out, jint out_offset, jobject privkey,
+   jint privkey_offset, jobject their_pubkey, jint their_pubkey_offset) {
+
+    unsigned char *o, *private, *pubkey;
+    if ((o = direct(env, out, out_offset, 32, "out")) == NULL ||
+        (private = direct(env, privkey, privkey_offset, 32,
+                          "privkey")) == NULL ||
+        (pubkey = direct(env, their_pubkey, their_pubkey_offset, 32,
+                         "theirPubKey")) == NULL) {
+        return;
+    }
+    curve25519_donna(o, private, pubkey);
+}
+
+JNIEXPORT void JNICALL Java_Curve25519Donna_getPublicBatchDirect
+  (JNIEnv *env, jobject obj, jobject out, jint out_offset, jobject privkeys,
+   jint privkeys_offset, jint n) {
 
-    curve25519_donna(shared_secret, private, pubkey);
-    return as_byte_array(env, (unsigned char*)shared_secret, 32);
+    unsigned char *o, *secrets;
+    if (n < 0) {
+        throw_new(env, "java/lang/IllegalArgumentException", "n");
+        return;
+    }
+    if ((o = direct(env, out, out_offset, (jlong) n * 32, "out")) == NULL ||
+        (secrets = direct(env, privkeys, privkeys_offset, (jlong) n * 32,
+                          "privkeys")) == NULL) {
+        return;
+    }
+    run_batch_threads(o, secrets, NULL, n);
+}
+
+JNIEXPORT void JNICALL Java_Curve25519Donna_makeSharedSecretBatchDirect
+  (JNIEnv *env, jobject obj, jobject out, jint out_offset, jobject privkeys,
+   jint privkeys_offset, jobject their_pubkeys, jint their_pubkeys_offset,
+   jint n) {
+
+    unsigned char *o, *secrets, *points;
+    if (n < 0) {
+        throw_new(env, "java/lang/IllegalArgumentException", "n");
+        return;
+    }
+    if ((o = direct(env, out, out_offset, (jlong) n * 32, "out")) == NULL ||
+        (secrets = direct(env, privkeys, privkeys_offset, (jlong) n * 32,
+                          "privkeys")) == NULL ||
+        (points = direct(env, their_pubkeys, their_pubkeys_offset,
+                         (jlong) n * 32, "theirPubKeys")) == NULL) {
+        return;
+    }
+    run_batch_threads(o, secrets, points, n);
 }
 
 JNIEXPORT void JNICALL Java_Curve25519Donna_helowrld
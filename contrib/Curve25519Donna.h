@@ -39,6 +39,110 @@ JNIEXPORT jbyteArray JNICALL Java_Curve25519Donna_getPublic
 JNIEXPORT jbyteArray JNICALL Java_Curve25519Donna_makeSharedSecret
   (JNIEnv *, jobject, jbyteArray, jbyteArray);
 
+/*
+ * Class:     Curve25519Donna
+ * Method:    curve25519DonnaInto
+ * Signature: ([B[B[B)V
+ */
+JNIEXPORT void JNICALL Java_Curve25519Donna_curve25519DonnaInto
+  (JNIEnv *, jobject, jbyteArray, jbyteArray, jbyteArray);
+
+/*
+ * Class:     Curve25519Donna
+ * Method:    makePrivateInto
+ * Signature: ([B[B)V
+ */
+JNIEXPORT void JNICALL Java_Curve25519Donna_makePrivateInto
+  (JNIEnv *, jobject, jbyteArray, jbyteArray);
+
+/*
+ * Class:     Curve25519Donna
+ * Method:    getPublicInto
+ * Signature: ([B[B)V
+ */
+JNIEXPORT void JNICALL Java_Curve25519Donna_getPublicInto
+  (JNIEnv *, jobject, jbyteArray, jbyteArray);
+
+/*
+ * Class:     Curve25519Donna
+ * Method:    makeSharedSecretInto
+ * Signature: ([B[B[B)V
+ */
+JNIEXPORT void JNICALL Java_Curve25519Donna_makeSharedSecretInto
+  (JNIEnv *, jobject, jbyteArray, jbyteArray, jbyteArray);
+
+/*
+ * Class:     Curve25519Donna
+ * Method:    getPublicBatch
+ * Signature: ([B)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_Curve25519Donna_getPublicBatch
+  (JNIEnv *, jobject, jbyteArray);
+
+/*
+ * Class:     Curve25519Donna
+ * Method:    getPublicBatchInto
+ * Signature: ([B[B)V
+ */
+JNIEXPORT void JNICALL Java_Curve25519Donna_getPublicBatchInto
+  (JNIEnv *, jobject, jbyteArray, jbyteArray);
+
+/*
+ * Class:     Curve25519Donna
+ * Method:    makeSharedSecretBatch
+ * Signature: ([B[B)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_Curve25519Donna_makeSharedSecretBatch
+  (JNIEnv *, jobject, jbyteArray, jbyteArray);
+
+/*
+ * Class:     Curve25519Donna
+ * Method:    makeSharedSecretBatchInto
+ * Signature: ([B[B[B)V
+ */
+JNIEXPORT void JNICALL Java_Curve25519Donna_makeSharedSecretBatchInto
+  (JNIEnv *, jobject, jbyteArray, jbyteArray, jbyteArray);
+
+/*
+ * Class:     Curve25519Donna
+ * Method:    makePrivateDirect
+ * Signature: (Ljava/nio/ByteBuffer;ILjava/nio/ByteBuffer;I)V
+ */
+JNIEXPORT void JNICALL Java_Curve25519Donna_makePrivateDirect
+  (JNIEnv *, jobject, jobject, jint, jobject, jint);
+
+/*
+ * Class:     Curve25519Donna
+ * Method:    getPublicDirect
+ * Signature: (Ljava/nio/ByteBuffer;ILjava/nio/ByteBuffer;I)V
+ */
+JNIEXPORT void JNICALL Java_Curve25519Donna_getPublicDirect
+  (JNIEnv *, jobject, jobject, jint, jobject, jint);
+
+/*
+ * Class:     Curve25519Donna
+ * Method:    makeSharedSecretDirect
+ * Signature: (Ljava/nio/ByteBuffer;ILjava/nio/ByteBuffer;ILjava/nio/ByteBuffer;I)V
+ */
+JNIEXPORT void JNICALL Java_Curve25519Donna_makeSharedSecretDirect
+  (JNIEnv *, jobject, jobject, jint, jobject, jint, jobject, jint);
+
+/*
+ * Class:     Curve25519Donna
+ * Method:    getPublicBatchDirect
+ * Signature: (Ljava/nio/ByteBuffer;ILjava/nio/ByteBuffer;II)V
+ */
+JNIEXPORT void JNICALL Java_Curve25519Donna_getPublicBatchDirect
+  (JNIEnv *, jobject, jobject, jint, jobject, jint, jint);
+
+/*
+ * Class:     Curve25519Donna
+ * Method:    makeSharedSecretBatchDirect
+ * Signature: (Ljava/nio/ByteBuffer;ILjava/nio/ByteBuffer;ILjava/nio/ByteBuffer;II)V
+ */
+JNIEXPORT void JNICALL Java_Curve25519Donna_makeSharedSecretBatchDirect
+  (JNIEnv *, jobject, jobject, jint, jobject, jint, jobject, jint, jint);
+
 /*
  * Class:     Curve25519Donna
  * Method:    helowrld
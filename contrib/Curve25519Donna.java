@@ -22,17 +22,80 @@ public class Curve25519Donna {
     public native byte[] makePrivate(byte[] secret);
     public native byte[] getPublic(byte[] privkey);
     public native byte[] makeSharedSecret(byte[] privkey, byte[] theirPubKey);
-    public native void helowrld();
 
-    // Uncomment if your Java is 32-bit:
-    //static { System.loadLibrary("Curve25519Donna"); }
+    // Same as above, but write the result to out instead of allocating a
+    // new array. out may be one of the inputs.
+    public native void curve25519DonnaInto(byte[] out, byte[] a, byte[] b);
+    public native void makePrivateInto(byte[] out, byte[] secret);
+    public native void getPublicInto(byte[] out, byte[] privkey);
+    public native void makeSharedSecretInto(byte[] out, byte[] privkey,
+                                            byte[] theirPubKey);
+
+    // All arguments must be 32-byte arrays. The methods throw
+    // NullPointerException for null and IllegalArgumentException for any
+    // other length.
+
+    // Batch versions: privkeys and theirPubKeys hold N keys packed into
+    // N * 32 bytes, and the result holds the N public keys or shared secrets
+    // in the same order. One call runs the whole batch, sharing work between
+    // keys and spreading large batches over all cores.
+    public native byte[] getPublicBatch(byte[] privkeys);
+    public native void getPublicBatchInto(byte[] out, byte[] privkeys);
+    public native byte[] makeSharedSecretBatch(byte[] privkeys,
+                                               byte[] theirPubKeys);
+    public native void makeSharedSecretBatchInto(byte[] out, byte[] privkeys,
+                                                 byte[] theirPubKeys);
+
+    // Direct ByteBuffer versions, which read and write the buffers' memory
+    // in place. Each key is at an absolute byte offset into its buffer; the
+    // buffers' positions and limits are neither used nor changed. A buffer
+    // that isn't direct throws IllegalArgumentException and one too small
+    // throws IndexOutOfBoundsException. For the batch methods, out must not
+    // overlap the inputs.
+    public native void makePrivateDirect(java.nio.ByteBuffer out,
+                                         int outOffset,
+                                         java.nio.ByteBuffer secret,
+                                         int secretOffset);
+    public native void getPublicDirect(java.nio.ByteBuffer out, int outOffset,
+                                       java.nio.ByteBuffer privkey,
+                                       int privkeyOffset);
+    public native void makeSharedSecretDirect(java.nio.ByteBuffer out,
+                                              int outOffset,
+                                              java.nio.ByteBuffer privkey,
+                                              int privkeyOffset,
+                                              java.nio.ByteBuffer theirPubKey,
+                                              int theirPubKeyOffset);
+    public native void getPublicBatchDirect(java.nio.ByteBuffer out,
+                                            int outOffset,
+                                            java.nio.ByteBuffer privkeys,
+                                            int privkeysOffset, int n);
+    public native void makeSharedSecretBatchDirect(
+        java.nio.ByteBuffer out, int outOffset,
+        java.nio.ByteBuffer privkeys, int privkeysOffset,
+        java.nio.ByteBuffer theirPubKeys, int theirPubKeysOffset, int n);
 
-    // Otherwise, load this 64-bit .jnilib:
-    static { System.loadLibrary("Curve25519Donna_64"); }
+    public native void helowrld();
+
+    // Loads the library named by -Dcurve25519donna.library=/path/to/lib if
+    // given. Otherwise it looks on java.library.path for the 64-bit library
+    // (libCurve25519Donna_64.so from "make jni" on Linux, or the .jnilib on
+    // OSX), then for the 32-bit one.
+    static {
+        String path = System.getProperty("curve25519donna.library");
+        if (path != null) {
+            System.load(path);
+        } else {
+            try {
+                System.loadLibrary("Curve25519Donna_64");
+            } catch (UnsatisfiedLinkError e) {
+                System.loadLibrary("Curve25519Donna");
+            }
+        }
+    }
 
     /*
-        To give the old tires a kick (OSX):
-        java -cp `pwd` Curve25519Donna
+        To give the old tires a kick ("make test-jni" on Linux):
+        java -cp `pwd` -Djava.library.path=`pwd` Curve25519Donna
     */
     public static void main (String[] args) {
 
@@ -73,5 +136,35 @@ public class Curve25519Donna {
         byte[] ss2 = c.makeSharedSecret(privKey2, pubKey);
         System.out.println("'user2' computes shared secret: " + bytesToHex(ss2));
 
+        // The other variants must agree.
+        boolean ok = java.util.Arrays.equals(ss1, ss2);
+        byte[] out = new byte[32];
+        c.makeSharedSecretInto(out, privKey, pubKey2);
+        ok &= java.util.Arrays.equals(out, ss1);
+
+        byte[] batch = c.makeSharedSecretBatch(concat(privKey, privKey2),
+                                               concat(pubKey2, pubKey));
+        ok &= java.util.Arrays.equals(batch, concat(ss1, ss2));
+        ok &= java.util.Arrays.equals(c.getPublicBatch(concat(privKey,
+                                                              privKey2)),
+                                      concat(pubKey, pubKey2));
+
+        java.nio.ByteBuffer direct = java.nio.ByteBuffer.allocateDirect(99);
+        direct.position(1);
+        direct.put(privKey).put(pubKey2);
+        c.makeSharedSecretDirect(direct, 65, direct, 1, direct, 33);
+        byte[] fromDirect = new byte[32];
+        direct.position(65);
+        direct.get(fromDirect);
+        ok &= java.util.Arrays.equals(fromDirect, ss1);
+
+        System.out.println(ok ? "All variants agree." : "FAIL: variants differ");
+        if (!ok) System.exit(1);
+    }
+
+    static byte[] concat(byte[] a, byte[] b) {
+        byte[] r = java.util.Arrays.copyOf(a, a.length + b.length);
+        System.arraycopy(b, 0, r, a.length, b.length);
+        return r;
     }
 }
@@ -0,0 +1,81 @@
+/*
+    Public domain.
+*/
+
+/*
+    Compares one makeSharedSecretInto call per key with the batch methods,
+    at batch sizes from 1 to 4096. Prints nanoseconds per key.
+
+        java -cp `pwd` Curve25519DonnaBench [seconds per measurement]
+*/
+public class Curve25519DonnaBench {
+
+    static final int[] SIZES = {1, 4, 16, 64, 256, 1024, 4096};
+
+    static Curve25519Donna c = new Curve25519Donna();
+    static long sink;
+
+    interface Run { void run(); }
+
+    // Repeats r, which handles n keys, for about |nanos| and returns
+    // nanoseconds per key.
+    static double perKey(Run r, int n, long nanos) {
+        long rounds = 0;
+        long start = System.nanoTime();
+        long elapsed;
+        do {
+            r.run();
+            rounds++;
+            elapsed = System.nanoTime() - start;
+        } while (elapsed < nanos);
+        return (double) elapsed / (rounds * n);
+    }
+
+    public static void main(String[] args) {
+        long nanos = (long) ((args.length > 0
+                              ? Double.parseDouble(args[0]) : 1.0) * 1e9);
+        java.util.Random random = new java.util.Random(25519);
+        final int max = SIZES[SIZES.length - 1];
+        final byte[] privs = new byte[max * 32];
+        random.nextBytes(privs);
+        final byte[] pubs = c.getPublicBatch(privs);
+        final byte[] out = new byte[max * 32];
+        final byte[] one = new byte[32];
+        final byte[][] privKeys = new byte[max][];
+        final byte[][] pubKeys = new byte[max][];
+        for (int i = 0; i < max; i++) {
+            privKeys[i] = java.util.Arrays.copyOfRange(privs, i * 32,
+                                                       i * 32 + 32);
+            pubKeys[i] = java.util.Arrays.copyOfRange(pubs, i * 32,
+                                                      i * 32 + 32);
+        }
+
+        // warm up the JIT and the native code
+        for (int i = 0; i < 2000; i++) {
+            c.makeSharedSecretInto(one, privKeys[i % max], pubKeys[i % max]);
+        }
+        c.makeSharedSecretBatchInto(out, privs, pubs);
+
+        System.out.println("   batch   single (ns/key)   batch (ns/key)  "
+                           + "batchInto (ns/key)");
+        for (final int n : SIZES) {
+            final byte[] p = java.util.Arrays.copyOf(privs, n * 32);
+            final byte[] q = java.util.Arrays.copyOf(pubs, n * 32);
+            final byte[] o = new byte[n * 32];
+            double single = perKey(new Run() { public void run() {
+                for (int i = 0; i < n; i++) {
+                    c.makeSharedSecretInto(one, privKeys[i], pubKeys[i]);
+                }
+            }}, n, nanos);
+            double batch = perKey(new Run() { public void run() {
+                sink += c.makeSharedSecretBatch(p, q)[0];
+            }}, n, nanos);
+            double batchInto = perKey(new Run() { public void run() {
+                c.makeSharedSecretBatchInto(o, p, q);
+            }}, n, nanos);
+            System.out.println(String.format("%8d %16.0f %16.0f %19.0f",
+                                             n, single, batch, batchInto));
+        }
+        if (sink == 42) System.out.println();
+    }
+}
@@ -0,0 +1,133 @@
+/*
+    Public domain.
+*/
+
+/*
+    Per-call latency and multithreaded throughput of the JNI binding.
+
+    The makePrivate methods run no curve arithmetic, so their latency is
+    almost all JNI overhead: the call itself, argument checks and copying
+    32-byte keys across. Subtracting it from makeSharedSecretInto's gives
+    the ladder's share. Latencies are percentiles over samples that each
+    time a short run of calls.
+
+        make speed-jni
+        java -cp . -Djava.library.path=. Curve25519DonnaMicroBench \
+            [seconds per measurement] [max threads]
+*/
+public class Curve25519DonnaMicroBench {
+
+    static final Curve25519Donna c = new Curve25519Donna();
+
+    // Returns {p50, p90, p99} of r's time per call in nanoseconds, from
+    // samples of |inner| calls each, taking about |nanos| in all.
+    static double[] latency(Runnable r, int inner, long nanos) {
+        double[] samples = new double[1 << 16];
+        int n = 0;
+        long end = System.nanoTime() + nanos;
+        while (n < samples.length && (n < 100 || System.nanoTime() < end)) {
+            long start = System.nanoTime();
+            for (int i = 0; i < inner; i++) r.run();
+            samples[n++] = (double) (System.nanoTime() - start) / inner;
+        }
+        java.util.Arrays.sort(samples, 0, n);
+        return new double[] {samples[n / 2], samples[n * 9 / 10],
+                             samples[n * 99 / 100]};
+    }
+
+    static double[] report(String name, Runnable r, int inner, long nanos) {
+        double[] p = latency(r, inner, nanos);
+        System.out.println(String.format("%-28s %10.0f %10.0f %10.0f",
+                                         name, p[0], p[1], p[2]));
+        return p;
+    }
+
+    // Shared secrets per second from |threads| threads calling
+    // makeSharedSecretInto for about |nanos|.
+    static double throughput(int threads, final long nanos)
+            throws InterruptedException {
+        final long[] counts = new long[threads];
+        Thread[] workers = new Thread[threads];
+        final long start = System.nanoTime();
+        for (int t = 0; t < threads; t++) {
+            final int index = t;
+            workers[t] = new Thread(new Runnable() { public void run() {
+                byte[] priv = new byte[32], pub = new byte[32];
+                byte[] out = new byte[32];
+                new java.util.Random(index).nextBytes(priv);
+                c.getPublicInto(pub, priv);
+                long n = 0;
+                while (System.nanoTime() - start < nanos) {
+                    c.makeSharedSecretInto(out, priv, pub);
+                    n++;
+                }
+                counts[index] = n;
+            }});
+            workers[t].start();
+        }
+        long total = 0;
+        for (int t = 0; t < threads; t++) {
+            workers[t].join();
+            total += counts[t];
+        }
+        return total / ((System.nanoTime() - start) / 1e9);
+    }
+
+    public static void main(String[] args) throws InterruptedException {
+        long nanos = (long) ((args.length > 0
+                              ? Double.parseDouble(args[0]) : 1.0) * 1e9);
+        int cpus = Runtime.getRuntime().availableProcessors();
+        int maxThreads = args.length > 1 ? Integer.parseInt(args[1])
+                                         : Math.max(4, cpus);
+
+        final byte[] secret = new byte[32], priv = new byte[32];
+        final byte[] pub = new byte[32], out = new byte[32];
+        new java.util.Random(25519).nextBytes(secret);
+        c.makePrivateInto(priv, secret);
+        c.getPublicInto(pub, priv);
+        final java.nio.ByteBuffer direct =
+            java.nio.ByteBuffer.allocateDirect(96);
+        direct.put(priv).put(pub);
+
+        Runnable makePrivate = new Runnable() { public void run() {
+            c.makePrivate(secret); }};
+        Runnable makePrivateInto = new Runnable() { public void run() {
+            c.makePrivateInto(out, secret); }};
+        Runnable makePrivateDirect = new Runnable() { public void run() {
+            c.makePrivateDirect(direct, 64, direct, 0); }};
+        Runnable makeShared = new Runnable() { public void run() {
+            c.makeSharedSecret(priv, pub); }};
+        Runnable makeSharedInto = new Runnable() { public void run() {
+            c.makeSharedSecretInto(out, priv, pub); }};
+        Runnable makeSharedDirect = new Runnable() { public void run() {
+            c.makeSharedSecretDirect(direct, 64, direct, 0, direct, 32); }};
+
+        // warm up the JIT
+        latency(makePrivateInto, 1000, nanos / 4);
+        latency(makeSharedInto, 10, nanos / 4);
+
+        System.out.println(String.format("%-28s %10s %10s %10s (ns/call)",
+                                         "", "p50", "p90", "p99"));
+        report("makePrivate", makePrivate, 1000, nanos);
+        double[] overhead = report("makePrivateInto", makePrivateInto, 1000,
+                                   nanos);
+        report("makePrivateDirect", makePrivateDirect, 1000, nanos);
+        report("makeSharedSecret", makeShared, 10, nanos);
+        double[] shared = report("makeSharedSecretInto", makeSharedInto, 10,
+                                 nanos);
+        report("makeSharedSecretDirect", makeSharedDirect, 10, nanos);
+        System.out.println(String.format(
+            "JNI overhead %.0f ns, ladder %.0f ns (from the medians)",
+            overhead[0], shared[0] - overhead[0]));
+        System.out.println();
+
+        double base = 0;
+        for (int threads = 1; threads <= maxThreads; threads *= 2) {
+            double rate = throughput(threads, nanos);
+            if (threads == 1) base = rate;
+            System.out.println(String.format(
+                "%2d threads: %10.0f shared secrets/s (%.2fx)",
+                threads, rate, rate / base));
+        }
+    }
+}
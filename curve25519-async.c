@@ -0,0 +1,288 @@
+/* Asynchronous curve25519-donna over lock-free rings. Public domain.
+ *
+ * Both rings are bounded multi-producer, multi-consumer queues in which each
+ * slot carries a sequence number saying whether it is free for the push or
+ * the pop at a given position (after Dmitry Vyukov's design). A semaphore
+ * counts queued submissions so that idle workers sleep instead of spinning.
+ *
+ * The number of jobs in flight, from submit to reap, is capped at the ring
+ * size, so a push only finds its ring full for the moment that a pop is
+ * still copying out of the slot it needs. */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/random.h>
+#include <unistd.h>
+
+#include "curve25519-donna.h"
+#include "curve25519-async.h"
+
+#define CACHE_LINE 64
+
+struct async_job {
+  struct curve25519_async_sqe sqe;
+  int result;
+};
+
+struct ring_slot {
+  atomic_size_t seq;
+  struct async_job job;
+};
+
+struct ring {
+  struct ring_slot *slots;
+  size_t mask;
+  /* Producers and consumers each get their own cache line. */
+  _Alignas(CACHE_LINE) atomic_size_t tail;
+  _Alignas(CACHE_LINE) atomic_size_t head;
+};
+
+struct curve25519_async {
+  struct ring sq, cq;
+  _Alignas(CACHE_LINE) atomic_uint in_flight;
+  unsigned capacity;
+  sem_t pending;
+  atomic_int stop;
+  int efd;
+  unsigned num_workers;
+  pthread_t *workers;
+};
+
+static int
+ring_init(struct ring *r, size_t size) {
+  size_t i;
+
+  r->slots = calloc(size, sizeof(*r->slots));
+  if (!r->slots) return -1;
+  for (i = 0; i < size; ++i) atomic_init(&r->slots[i].seq, i);
+  r->mask = size - 1;
+  atomic_init(&r->tail, 0);
+  atomic_init(&r->head, 0);
+  return 0;
+}
+
+static int
+ring_push(struct ring *r, const struct async_job *job) {
+  size_t pos = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+  for (;;) {
+    struct ring_slot *slot = &r->slots[pos & r->mask];
+    const size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    const intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&r->tail, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        slot->job = *job;
+        atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+        return 0;
+      }
+    } else if (diff < 0) {
+      return -1;  /* full */
+    } else {
+      pos = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    }
+  }
+}
+
+static int
+ring_pop(struct ring *r, struct async_job *job) {
+  size_t pos = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+  for (;;) {
+    struct ring_slot *slot = &r->slots[pos & r->mask];
+    const size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    const intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&r->head, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        *job = slot->job;
+        atomic_store_explicit(&slot->seq, pos + r->mask + 1,
+                              memory_order_release);
+        return 0;
+      }
+    } else if (diff < 0) {
+      return -1;  /* empty, or the next push hasn't been published yet */
+    } else {
+      pos = atomic_load_explicit(&r->head, memory_order_relaxed);
+    }
+  }
+}
+
+/* Takes a job that the semaphore says is queued. Its push may still be
+ * finishing in another thread, so wait for it rather than give up. */
+static void
+take_job(struct curve25519_async *a, struct async_job *job) {
+  while (ring_pop(&a->sq, job) != 0) sched_yield();
+}
+
+static void
+run_jobs(struct async_job *jobs, unsigned n) {
+  static const uint8_t basepoint[32] = {9};
+  uint8_t secrets[CURVE25519_ASYNC_BATCH * 32];
+  uint8_t points[CURVE25519_ASYNC_BATCH * 32];
+  uint8_t outs[CURVE25519_ASYNC_BATCH * 32];
+  unsigned i;
+
+  for (i = 0; i < n; ++i) {
+    struct curve25519_async_sqe *sqe = &jobs[i].sqe;
+
+    jobs[i].result = 0;
+    if (sqe->op == CURVE25519_ASYNC_OP_KEYGEN) {
+      if (getrandom(sqe->secret, 32, 0) != 32) jobs[i].result = -1;
+      sqe->basepoint = NULL;
+    }
+    memcpy(secrets + 32 * i, sqe->secret, 32);
+    memcpy(points + 32 * i, sqe->basepoint ? sqe->basepoint : basepoint, 32);
+  }
+
+  curve25519_donna_batch(outs, secrets, points, n);
+
+  for (i = 0; i < n; ++i) {
+    if (jobs[i].result == 0) {
+      memcpy(jobs[i].sqe.out, outs + 32 * i, 32);
+    } else {
+      memset(jobs[i].sqe.out, 0, 32);
+      memset(jobs[i].sqe.secret, 0, 32);
+    }
+  }
+  memset(secrets, 0, sizeof(secrets));
+  memset(outs, 0, sizeof(outs));
+}
+
+static void *
+worker_main(void *arg) {
+  struct curve25519_async *a = arg;
+  struct async_job jobs[CURVE25519_ASYNC_BATCH];
+  const uint64_t one = 1;
+  unsigned i, n;
+
+  for (;;) {
+    while (sem_wait(&a->pending) != 0 && errno == EINTR) {}
+    if (atomic_load_explicit(&a->stop, memory_order_acquire)) break;
+
+    /* Whatever else is already queued rides along in the same batch. */
+    take_job(a, &jobs[0]);
+    for (n = 1; n < CURVE25519_ASYNC_BATCH && sem_trywait(&a->pending) == 0;
+         ++n) {
+      take_job(a, &jobs[n]);
+    }
+
+    run_jobs(jobs, n);
+
+    for (i = 0; i < n; ++i) {
+      while (ring_push(&a->cq, &jobs[i]) != 0) sched_yield();
+    }
+    if (write(a->efd, &one, sizeof(one)) != sizeof(one)) {
+      /* Only fails if the counter would overflow, and then it's readable. */
+    }
+  }
+
+  return NULL;
+}
+
+void
+curve25519_async_free(struct curve25519_async *a) {
+  unsigned i;
+
+  if (!a) return;
+  atomic_store_explicit(&a->stop, 1, memory_order_release);
+  for (i = 0; i < a->num_workers; ++i) sem_post(&a->pending);
+  for (i = 0; i < a->num_workers; ++i) pthread_join(a->workers[i], NULL);
+
+  if (a->efd >= 0) close(a->efd);
+  sem_destroy(&a->pending);
+  free(a->workers);
+  free(a->sq.slots);
+  free(a->cq.slots);
+  free(a);
+}
+
+struct curve25519_async *
+curve25519_async_new(unsigned workers, unsigned entries) {
+  struct curve25519_async *a;
+  unsigned size = 1;
+
+  if (workers == 0 || entries == 0 || entries > (1u << 30)) return NULL;
+  while (size < entries) size <<= 1;
+
+  a = aligned_alloc(CACHE_LINE,
+                    (sizeof(*a) + CACHE_LINE - 1) & ~(size_t) (CACHE_LINE - 1));
+  if (!a) return NULL;
+  memset(a, 0, sizeof(*a));
+  a->efd = -1;
+  atomic_init(&a->in_flight, 0);
+  atomic_init(&a->stop, 0);
+  a->capacity = size;
+  if (sem_init(&a->pending, 0, 0) != 0) {
+    free(a);
+    return NULL;
+  }
+
+  a->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  a->workers = calloc(workers, sizeof(*a->workers));
+  if (a->efd < 0 || !a->workers ||
+      ring_init(&a->sq, size) != 0 || ring_init(&a->cq, size) != 0) {
+    curve25519_async_free(a);
+    return NULL;
+  }
+
+  for (; a->num_workers < workers; a->num_workers++) {
+    if (pthread_create(&a->workers[a->num_workers], NULL, worker_main, a)) {
+      curve25519_async_free(a);
+      return NULL;
+    }
+  }
+
+  return a;
+}
+
+int
+curve25519_async_fd(const struct curve25519_async *a) {
+  return a->efd;
+}
+
+int
+curve25519_async_submit(struct curve25519_async *a,
+                        const struct curve25519_async_sqe *sqe) {
+  struct async_job job;
+
+  if (atomic_fetch_add_explicit(&a->in_flight, 1, memory_order_relaxed) >=
+      a->capacity) {
+    atomic_fetch_sub_explicit(&a->in_flight, 1, memory_order_relaxed);
+    return -1;
+  }
+
+  job.sqe = *sqe;
+  job.result = 0;
+  /* Can only fail briefly, while a worker is still copying out of the slot
+   * this push needs. */
+  while (ring_push(&a->sq, &job) != 0) sched_yield();
+  sem_post(&a->pending);
+  return 0;
+}
+
+unsigned
+curve25519_async_reap(struct curve25519_async *a,
+                      struct curve25519_async_cqe *cqes, unsigned max) {
+  struct async_job job;
+  unsigned n = 0;
+
+  while (n < max && ring_pop(&a->cq, &job) == 0) {
+    cqes[n].user_data = job.sqe.user_data;
+    cqes[n].result = job.result;
+    n++;
+  }
+  if (n) atomic_fetch_sub_explicit(&a->in_flight, n, memory_order_relaxed);
+  return n;
+}
@@ -0,0 +1,84 @@
+/* Asynchronous curve25519-donna: submission and completion rings in front of
+ * a pool of worker threads.
+ *
+ * A thread that must not block for a whole ladder (an event loop, say) pushes
+ * jobs into the submission ring and later reaps their results from the
+ * completion ring. Both rings are lock-free. Workers take up to
+ * CURVE25519_ASYNC_BATCH queued jobs at a time and run them through
+ * curve25519_donna_batch. After each batch they signal an eventfd, which can
+ * be registered with epoll:
+ *
+ *   fd = curve25519_async_fd(a);               add fd to epoll for EPOLLIN
+ *   curve25519_async_submit(a, &sqe);
+ *   ... epoll_wait reports fd readable ...
+ *   read(fd, &counter, 8);                     reset the eventfd
+ *   n = curve25519_async_reap(a, cqes, 64);    handle n completions
+ *
+ * Any thread may submit or reap. Linux only (eventfd, getrandom); link with
+ * -lpthread and one of the curve25519-donna implementations. */
+
+#ifndef CURVE25519_ASYNC_H
+#define CURVE25519_ASYNC_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CURVE25519_ASYNC_BATCH 8
+
+enum curve25519_async_op {
+  /* out = secret * basepoint, as curve25519_donna */
+  CURVE25519_ASYNC_OP_DH,
+  /* Fills the 32-byte buffer |secret| with random bytes and writes the
+   * matching public key to |out|. |basepoint| is ignored. */
+  CURVE25519_ASYNC_OP_KEYGEN,
+};
+
+/* The ring copies the entry itself, but the buffers it points to must stay
+ * valid until the job's completion has been reaped. */
+struct curve25519_async_sqe {
+  int op;
+  uint8_t *secret;            /* read for DH, written for KEYGEN */
+  const uint8_t *basepoint;   /* NULL for the base point 9 */
+  uint8_t *out;
+  uint64_t user_data;
+};
+
+struct curve25519_async_cqe {
+  uint64_t user_data;
+  int result;  /* 0 on success, -1 if random bytes couldn't be obtained */
+};
+
+struct curve25519_async;
+
+/* Starts |workers| threads behind rings with room for |entries| jobs in
+ * flight (rounded up to a power of two). Returns NULL on failure. */
+struct curve25519_async *curve25519_async_new(unsigned workers,
+                                              unsigned entries);
+
+/* Stops the workers and releases everything. Jobs that are still queued are
+ * dropped; those already running finish first. */
+void curve25519_async_free(struct curve25519_async *a);
+
+/* Returns the eventfd that becomes readable when completions are ready. It
+ * is non-blocking; read it before reaping to reset the counter. */
+int curve25519_async_fd(const struct curve25519_async *a);
+
+/* Queues a copy of |sqe|. Returns 0, or -1 if |entries| jobs are already in
+ * flight, in which case reap some completions and try again. */
+int curve25519_async_submit(struct curve25519_async *a,
+                            const struct curve25519_async_sqe *sqe);
+
+/* Moves up to |max| completions into |cqes| and returns how many there were.
+ * Never blocks. */
+unsigned curve25519_async_reap(struct curve25519_async *a,
+                               struct curve25519_async_cqe *cqes,
+                               unsigned max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* CURVE25519_ASYNC_H */
@@ -0,0 +1,334 @@
+/* curve25519-bulk: derives public keys or shared secrets for a file of
+ * fixed-size records.
+ *
+ * Usage: curve25519-bulk [-q] [-t threads] public|shared [input [output]]
+ *
+ *   public  input records are 32-byte secrets; writes 32-byte public keys
+ *   shared  input records are a 32-byte secret followed by a 32-byte peer
+ *           public key; writes 32-byte shared secrets
+ *
+ * Input and output default to stdin and stdout ("-" means the same). A
+ * regular input file is memory-mapped instead of read. Records go through
+ * curve25519_donna_batch in chunks split over the worker threads, while the
+ * main thread writes the previous chunk's results and reads the next one.
+ * The throughput is printed to stderr at the end unless -q is given. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "curve25519-donna.h"
+
+#define CHUNK_RECORDS 16384  /* per chunk, across all threads */
+#define BATCH 64             /* records per curve25519_donna_batch call */
+#define MAX_THREADS 256
+
+struct bulk {
+  size_t record_size;           /* 32 or 64 */
+  unsigned threads;
+  pthread_barrier_t start, done;
+  int quit;
+  /* The chunk being worked on. */
+  const uint8_t *in;
+  uint8_t *out;
+  size_t n;
+};
+
+static void
+wipe(void *p, size_t n) {
+  volatile uint8_t *v = p;
+  while (n--) *v++ = 0;
+}
+
+static uint64_t
+time_now() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Runs records [begin, end) of the current chunk. */
+static void
+run_slice(const struct bulk *b, size_t begin, size_t end) {
+  uint8_t secrets[BATCH * 32], points[BATCH * 32];
+  size_t i, j, n;
+
+  if (b->record_size == 32) {
+    memset(points, 0, sizeof(points));
+    for (j = 0; j < BATCH; ++j) points[j * 32] = 9;
+  }
+
+  for (i = begin; i < end; i += n) {
+    n = end - i < BATCH ? end - i : BATCH;
+    if (b->record_size == 32) {
+      curve25519_donna_batch(b->out + i * 32, b->in + i * 32, points, n);
+    } else {
+      for (j = 0; j < n; ++j) {
+        memcpy(secrets + j * 32, b->in + (i + j) * 64, 32);
+        memcpy(points + j * 32, b->in + (i + j) * 64 + 32, 32);
+      }
+      curve25519_donna_batch(b->out + i * 32, secrets, points, n);
+    }
+  }
+  wipe(secrets, sizeof(secrets));
+}
+
+struct worker {
+  struct bulk *bulk;
+  unsigned index;
+};
+
+static void *
+worker_main(void *arg) {
+  const struct worker *w = arg;
+  struct bulk *b = w->bulk;
+  size_t per, begin, end;
+
+  for (;;) {
+    pthread_barrier_wait(&b->start);
+    if (b->quit) return NULL;
+    /* Slices are whole batches so that no batch is split between threads. */
+    per = ((b->n + b->threads - 1) / b->threads + BATCH - 1) / BATCH * BATCH;
+    begin = per * w->index;
+    end = begin + per;
+    if (begin > b->n) begin = b->n;
+    if (end > b->n) end = b->n;
+    run_slice(b, begin, end);
+    pthread_barrier_wait(&b->done);
+  }
+}
+
+/* Reads until |len| bytes arrive or the input ends. Returns the number of
+ * bytes read, or -1 on error. */
+static ssize_t
+read_full(int fd, uint8_t *buf, size_t len) {
+  size_t got = 0;
+  ssize_t n;
+
+  while (got < len) {
+    n = read(fd, buf + got, len - got);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) return -1;
+    if (n == 0) break;
+    got += n;
+  }
+  return got;
+}
+
+static int
+write_full(int fd, const uint8_t *buf, size_t len) {
+  ssize_t n;
+
+  while (len) {
+    n = write(fd, buf, len);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) return -1;
+    buf += n;
+    len -= n;
+  }
+  return 0;
+}
+
+struct input {
+  int fd;
+  const char *path;
+  const uint8_t *map;  /* the whole input if it could be mapped */
+  size_t map_len, offset;
+  uint8_t *buf[2];     /* otherwise, read into these in turn */
+  size_t chunk_bytes;
+};
+
+/* Makes the next chunk of input available at |*ptr|, reading it into buffer
+ * |slot| unless the input is mapped. Returns its length, 0 at the end of the
+ * input or -1 on error. */
+static ssize_t
+fetch(struct input *input, unsigned slot, const uint8_t **ptr) {
+  size_t len;
+  ssize_t n;
+
+  if (input->map) {
+    len = input->map_len - input->offset;
+    if (len > input->chunk_bytes) len = input->chunk_bytes;
+    *ptr = input->map + input->offset;
+    input->offset += len;
+    return len;
+  }
+
+  n = read_full(input->fd, input->buf[slot], input->chunk_bytes);
+  if (n < 0) perror(input->path);
+  *ptr = input->buf[slot];
+  return n;
+}
+
+static void
+usage(void) {
+  fprintf(stderr,
+          "usage: curve25519-bulk [-q] [-t threads] public|shared "
+          "[input [output]]\n");
+  exit(2);
+}
+
+int
+main(int argc, char **argv) {
+  static struct bulk b;
+  static struct worker workers[MAX_THREADS];
+  static struct input input;
+  pthread_t threads[MAX_THREADS];
+  const char *out_path = "-";
+  long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  int quiet = 0, out_fd, opt, ret = 0;
+  const uint8_t *in, *next_in;
+  uint8_t *out_buf[2];
+  uint64_t records = 0, start, elapsed;
+  ssize_t have, next_have;
+  size_t prev_n = 0;
+  unsigned cur = 0, i;
+  struct stat st;
+  void *map;
+
+  while ((opt = getopt(argc, argv, "qt:")) != -1) {
+    if (opt == 'q') {
+      quiet = 1;
+    } else if (opt == 't') {
+      nthreads = atol(optarg);
+    } else {
+      usage();
+    }
+  }
+  if (optind >= argc) usage();
+  if (strcmp(argv[optind], "public") == 0) {
+    b.record_size = 32;
+  } else if (strcmp(argv[optind], "shared") == 0) {
+    b.record_size = 64;
+  } else {
+    usage();
+  }
+  input.path = optind + 1 < argc ? argv[optind + 1] : "-";
+  if (optind + 2 < argc) out_path = argv[optind + 2];
+  if (optind + 3 < argc) usage();
+  if (nthreads < 1) nthreads = 1;
+  if (nthreads > MAX_THREADS) nthreads = MAX_THREADS;
+  b.threads = nthreads;
+
+  input.fd = strcmp(input.path, "-") == 0
+                 ? 0
+                 : open(input.path, O_RDONLY | O_CLOEXEC);
+  if (input.fd < 0) {
+    perror(input.path);
+    return 1;
+  }
+  out_fd = strcmp(out_path, "-") == 0
+               ? 1
+               : open(out_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (out_fd < 0) {
+    perror(out_path);
+    return 1;
+  }
+
+  /* Map regular files; pipes and terminals are read a chunk at a time. */
+  input.chunk_bytes = CHUNK_RECORDS * b.record_size;
+  if (fstat(input.fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, input.fd, 0);
+    if (map != MAP_FAILED) {
+      madvise(map, st.st_size, MADV_SEQUENTIAL);
+      input.map = map;
+      input.map_len = st.st_size;
+    }
+  }
+
+  for (i = 0; i < 2; ++i) {
+    if (!input.map) input.buf[i] = aligned_alloc(64, input.chunk_bytes);
+    out_buf[i] = aligned_alloc(64, CHUNK_RECORDS * 32);
+    if ((!input.map && !input.buf[i]) || !out_buf[i]) {
+      fprintf(stderr, "out of memory\n");
+      return 1;
+    }
+  }
+
+  pthread_barrier_init(&b.start, NULL, b.threads + 1);
+  pthread_barrier_init(&b.done, NULL, b.threads + 1);
+  for (i = 0; i < b.threads; ++i) {
+    workers[i].bulk = &b;
+    workers[i].index = i;
+    if (pthread_create(&threads[i], NULL, worker_main, &workers[i]) != 0) {
+      fprintf(stderr, "cannot start threads\n");
+      return 1;
+    }
+  }
+
+  start = time_now();
+  have = fetch(&input, cur, &in);
+  while (have > 0) {
+    if (have < 0 || have % b.record_size != 0) {
+      if (have > 0) {
+        fprintf(stderr, "input is not a whole number of %u-byte records\n",
+                (unsigned) b.record_size);
+      }
+      ret = 1;
+      break;
+    }
+
+    b.in = in;
+    b.out = out_buf[cur];
+    b.n = have / b.record_size;
+    pthread_barrier_wait(&b.start);
+
+    /* Overlap I/O with the workers: flush the last chunk, fetch the next. */
+    if (prev_n && write_full(out_fd, out_buf[cur ^ 1], prev_n * 32) != 0) {
+      perror(out_path);
+      ret = 1;
+    }
+    next_have = fetch(&input, cur ^ 1, &next_in);
+
+    pthread_barrier_wait(&b.done);
+    records += b.n;
+    prev_n = b.n;
+    if (ret) break;
+
+    in = next_in;
+    have = next_have;
+    cur ^= 1;
+  }
+  /* fetch has already reported why. */
+  if (have < 0) ret = 1;
+  if (!ret && prev_n &&
+      write_full(out_fd, out_buf[cur ^ 1], prev_n * 32) != 0) {
+    perror(out_path);
+    ret = 1;
+  }
+
+  elapsed = time_now() - start;
+  b.quit = 1;
+  pthread_barrier_wait(&b.start);
+  for (i = 0; i < b.threads; ++i) pthread_join(threads[i], NULL);
+
+  if (!ret && out_fd != 1 && close(out_fd) != 0) {
+    perror(out_path);
+    ret = 1;
+  }
+  if (!ret && !quiet) {
+    fprintf(stderr, "%llu records in %.3f s: %.0f records/s on %u threads\n",
+            (unsigned long long) records, elapsed / 1e9,
+            elapsed ? records * 1e9 / elapsed : 0.0, b.threads);
+  }
+
+  for (i = 0; i < 2; ++i) {
+    if (input.buf[i]) {
+      wipe(input.buf[i], input.chunk_bytes);
+      free(input.buf[i]);
+    }
+    wipe(out_buf[i], CHUNK_RECORDS * 32);
+    free(out_buf[i]);
+  }
+  if (input.map) munmap((void *) input.map, input.map_len);
+  return ret;
+}
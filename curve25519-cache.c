@@ -0,0 +1,320 @@
+/* Cache of static-static curve25519 shared secrets. Public domain. */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+
+#include "curve25519-donna.h"
+#include "curve25519-cache.h"
+
+#define CACHE_LINE 64
+#define WAYS 8
+
+struct entry {
+  uint64_t key_id;
+  uint64_t stamp;  /* last use; 0 marks a free slot */
+  uint8_t peer[32];
+  uint8_t shared[32];
+};
+
+struct shard {
+  pthread_mutex_t lock;
+  struct entry *sets;  /* |num_sets| * WAYS entries */
+  uint64_t clock;
+  uint64_t generation;  /* bumped by every invalidate call */
+  uint64_t hits, misses, evictions, invalidations;
+  unsigned entries;
+} __attribute__((aligned(CACHE_LINE)));
+
+struct curve25519_cache {
+  struct shard *shards;
+  unsigned num_shards, num_sets;
+  unsigned shard_shift;  /* shard = hash >> shard_shift */
+  uint64_t sip_k0, sip_k1;
+  struct entry *memory;
+  size_t memory_size;
+};
+
+static void
+wipe(void *p, size_t len) {
+  volatile uint8_t *v = (volatile uint8_t *) p;
+  while (len--) *v++ = 0;
+}
+
+static uint64_t
+load64_le(const uint8_t *in) {
+  uint64_t r = 0;
+  int i;
+
+  for (i = 7; i >= 0; --i) r = (r << 8) | in[i];
+  return r;
+}
+
+#define ROTL64(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND                                                         \
+  do {                                                                   \
+    v0 += v1; v1 = ROTL64(v1, 13); v1 ^= v0; v0 = ROTL64(v0, 32);        \
+    v2 += v3; v3 = ROTL64(v3, 16); v3 ^= v2;                             \
+    v0 += v3; v3 = ROTL64(v3, 21); v3 ^= v0;                             \
+    v2 += v1; v1 = ROTL64(v1, 17); v1 ^= v2; v2 = ROTL64(v2, 32);        \
+  } while (0)
+
+/* SipHash-2-4 of the 40-byte string key_id (little-endian) || peer. */
+static uint64_t
+entry_hash(const struct curve25519_cache *cache, uint64_t key_id,
+           const uint8_t *peer) {
+  uint64_t v0 = cache->sip_k0 ^ 0x736f6d6570736575ull;
+  uint64_t v1 = cache->sip_k1 ^ 0x646f72616e646f6dull;
+  uint64_t v2 = cache->sip_k0 ^ 0x6c7967656e657261ull;
+  uint64_t v3 = cache->sip_k1 ^ 0x7465646279746573ull;
+  uint64_t m;
+  int i;
+
+  for (i = -1; i < 4; ++i) {
+    m = i < 0 ? key_id : load64_le(peer + 8 * i);
+    v3 ^= m;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= m;
+  }
+
+  /* Final block: just the length, as 40 is a multiple of 8. */
+  m = (uint64_t) 40 << 56;
+  v3 ^= m;
+  SIPROUND;
+  SIPROUND;
+  v0 ^= m;
+
+  v2 ^= 0xff;
+  SIPROUND;
+  SIPROUND;
+  SIPROUND;
+  SIPROUND;
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+static struct shard *
+find_set(const struct curve25519_cache *cache, uint64_t key_id,
+         const uint8_t *peer, struct entry **set) {
+  const uint64_t h = entry_hash(cache, key_id, peer);
+  struct shard *shard = &cache->shards[cache->num_shards > 1 ?
+                                       h >> cache->shard_shift : 0];
+
+  *set = shard->sets + (size_t) (h & (cache->num_sets - 1)) * WAYS;
+  return shard;
+}
+
+static struct entry *
+set_lookup(struct entry *set, uint64_t key_id, const uint8_t *peer) {
+  unsigned i;
+
+  for (i = 0; i < WAYS; ++i) {
+    if (set[i].stamp && set[i].key_id == key_id &&
+        memcmp(set[i].peer, peer, 32) == 0) {
+      return &set[i];
+    }
+  }
+  return NULL;
+}
+
+struct curve25519_cache *
+curve25519_cache_new(unsigned capacity, unsigned shards) {
+  struct curve25519_cache *cache;
+  unsigned num_shards = 1, num_sets = 1, shard_bits = 0, i;
+  uint64_t keys[2];
+
+  if (capacity == 0 || capacity > (1u << 28) || shards > (1u << 16)) {
+    return NULL;
+  }
+  while (num_shards < shards) {
+    num_shards <<= 1;
+    shard_bits++;
+  }
+  while ((uint64_t) num_shards * num_sets * WAYS < capacity) num_sets <<= 1;
+
+  if (getrandom(keys, sizeof(keys), 0) != sizeof(keys)) return NULL;
+
+  cache = calloc(1, sizeof(*cache));
+  if (!cache) return NULL;
+  cache->shards = aligned_alloc(CACHE_LINE, num_shards * sizeof(struct shard));
+  if (!cache->shards) {
+    free(cache);
+    return NULL;
+  }
+  memset(cache->shards, 0, num_shards * sizeof(struct shard));
+
+  cache->memory_size = (size_t) num_shards * num_sets * WAYS *
+                       sizeof(struct entry);
+  cache->memory = mmap(NULL, cache->memory_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (cache->memory == MAP_FAILED ||
+      mlock(cache->memory, cache->memory_size) != 0) {
+    if (cache->memory != MAP_FAILED) munmap(cache->memory, cache->memory_size);
+    free(cache->shards);
+    free(cache);
+    return NULL;
+  }
+#ifdef MADV_DONTDUMP
+  madvise(cache->memory, cache->memory_size, MADV_DONTDUMP);
+#endif
+#ifdef MADV_WIPEONFORK
+  madvise(cache->memory, cache->memory_size, MADV_WIPEONFORK);
+#endif
+
+  cache->num_shards = num_shards;
+  cache->num_sets = num_sets;
+  cache->shard_shift = 64 - shard_bits;
+  cache->sip_k0 = keys[0];
+  cache->sip_k1 = keys[1];
+  wipe(keys, sizeof(keys));
+
+  for (i = 0; i < num_shards; ++i) {
+    pthread_mutex_init(&cache->shards[i].lock, NULL);
+    cache->shards[i].sets = cache->memory + (size_t) i * num_sets * WAYS;
+  }
+
+  return cache;
+}
+
+void
+curve25519_cache_free(struct curve25519_cache *cache) {
+  unsigned i;
+
+  if (!cache) return;
+  for (i = 0; i < cache->num_shards; ++i) {
+    pthread_mutex_destroy(&cache->shards[i].lock);
+  }
+  wipe(cache->memory, cache->memory_size);
+  munlock(cache->memory, cache->memory_size);
+  munmap(cache->memory, cache->memory_size);
+  free(cache->shards);
+  wipe(cache, sizeof(*cache));
+  free(cache);
+}
+
+int
+curve25519_cache_shared(struct curve25519_cache *cache, uint8_t *shared,
+                        uint64_t key_id, const uint8_t *secret,
+                        const uint8_t *peer_public) {
+  struct entry *set, *e, *victim;
+  struct shard *shard = find_set(cache, key_id, peer_public, &set);
+  uint8_t computed[32];
+  uint64_t generation;
+  unsigned i;
+
+  pthread_mutex_lock(&shard->lock);
+  e = set_lookup(set, key_id, peer_public);
+  if (e) {
+    e->stamp = ++shard->clock;
+    memcpy(shared, e->shared, 32);
+    shard->hits++;
+    pthread_mutex_unlock(&shard->lock);
+    return 1;
+  }
+  shard->misses++;
+  generation = shard->generation;
+  pthread_mutex_unlock(&shard->lock);
+
+  /* Run the ladder without holding the lock. If another thread raced us to
+   * the same entry, both compute the same value and the second insert just
+   * refreshes it. If an invalidate call ran meanwhile, |secret| may be the
+   * key it meant to remove, so the result is returned but not cached. */
+  curve25519_donna(computed, secret, peer_public);
+
+  pthread_mutex_lock(&shard->lock);
+  if (shard->generation != generation) goto out;
+  e = set_lookup(set, key_id, peer_public);
+  if (!e) {
+    victim = &set[0];
+    for (i = 0; i < WAYS; ++i) {
+      if (set[i].stamp < victim->stamp) victim = &set[i];
+    }
+    if (victim->stamp) {
+      shard->evictions++;
+    } else {
+      shard->entries++;
+    }
+    e = victim;
+    e->key_id = key_id;
+    memcpy(e->peer, peer_public, 32);
+  }
+  memcpy(e->shared, computed, 32);
+  e->stamp = ++shard->clock;
+out:
+  pthread_mutex_unlock(&shard->lock);
+
+  memcpy(shared, computed, 32);
+  wipe(computed, sizeof(computed));
+  return 0;
+}
+
+unsigned
+curve25519_cache_invalidate_key(struct curve25519_cache *cache,
+                                uint64_t key_id) {
+  const size_t per_shard = (size_t) cache->num_sets * WAYS;
+  unsigned i, removed = 0, n;
+  size_t j;
+
+  for (i = 0; i < cache->num_shards; ++i) {
+    struct shard *shard = &cache->shards[i];
+
+    n = 0;
+    pthread_mutex_lock(&shard->lock);
+    for (j = 0; j < per_shard; ++j) {
+      if (shard->sets[j].stamp && shard->sets[j].key_id == key_id) {
+        wipe(&shard->sets[j], sizeof(shard->sets[j]));
+        n++;
+      }
+    }
+    shard->entries -= n;
+    shard->invalidations += n;
+    shard->generation++;
+    pthread_mutex_unlock(&shard->lock);
+    removed += n;
+  }
+
+  return removed;
+}
+
+int
+curve25519_cache_invalidate_peer(struct curve25519_cache *cache,
+                                 uint64_t key_id, const uint8_t *peer_public) {
+  struct entry *set, *e;
+  struct shard *shard = find_set(cache, key_id, peer_public, &set);
+
+  pthread_mutex_lock(&shard->lock);
+  e = set_lookup(set, key_id, peer_public);
+  if (e) {
+    wipe(e, sizeof(*e));
+    shard->entries--;
+    shard->invalidations++;
+  }
+  shard->generation++;
+  pthread_mutex_unlock(&shard->lock);
+
+  return e != NULL;
+}
+
+void
+curve25519_cache_stats(struct curve25519_cache *cache,
+                       struct curve25519_cache_stats *stats) {
+  unsigned i;
+
+  memset(stats, 0, sizeof(*stats));
+  for (i = 0; i < cache->num_shards; ++i) {
+    struct shard *shard = &cache->shards[i];
+
+    pthread_mutex_lock(&shard->lock);
+    stats->hits += shard->hits;
+    stats->misses += shard->misses;
+    stats->evictions += shard->evictions;
+    stats->invalidations += shard->invalidations;
+    stats->entries += shard->entries;
+    pthread_mutex_unlock(&shard->lock);
+  }
+  stats->capacity = cache->num_shards * cache->num_sets * WAYS;
+}
@@ -0,0 +1,78 @@
+/* Cache of static-static curve25519 shared secrets.
+ *
+ * Nodes that keep reconnecting to the same peers compute the same
+ * curve25519_donna(shared, my_static, peer_static) over and over. This
+ * bounded cache remembers the results, keyed by a caller-chosen id for the
+ * local key plus the peer's public key. It is split into independently
+ * locked shards so that many threads can use it at once, and each shard is
+ * set-associative with least-recently-used replacement within a set. The
+ * set index comes from SipHash under a random key, so peers can't choose
+ * public keys that all compete for the same slots.
+ *
+ * Entries live in memory that is locked (never swapped) and excluded from
+ * core dumps, and are wiped when evicted or invalidated. When a local key is
+ * rotated, give the new key a new id and call curve25519_cache_invalidate_key
+ * for the old one.
+ *
+ * Linux only (getrandom, mlock); link with -lpthread and one of the
+ * curve25519-donna implementations. */
+
+#ifndef CURVE25519_CACHE_H
+#define CURVE25519_CACHE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct curve25519_cache;
+
+struct curve25519_cache_stats {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;      /* live entries replaced to make room */
+  uint64_t invalidations;  /* entries removed by invalidate calls */
+  unsigned entries;        /* live entries */
+  unsigned capacity;
+};
+
+/* Creates a cache for about |capacity| entries spread over |shards| shards
+ * (both rounded up to powers of two; pick at least as many shards as
+ * threads). Returns NULL on failure, including when the memory can't be
+ * locked: see RLIMIT_MEMLOCK. */
+struct curve25519_cache *curve25519_cache_new(unsigned capacity,
+                                              unsigned shards);
+
+/* Wipes and frees the cache. */
+void curve25519_cache_free(struct curve25519_cache *cache);
+
+/* Sets |shared| to curve25519_donna(shared, |secret|, |peer_public|), taking
+ * it from the cache if an entry for (|key_id|, |peer_public|) exists and
+ * computing and inserting it otherwise. The caller must always pass the same
+ * |secret| for a given |key_id|. Returns 1 on a hit and 0 on a miss. */
+int curve25519_cache_shared(struct curve25519_cache *cache, uint8_t *shared,
+                            uint64_t key_id, const uint8_t *secret,
+                            const uint8_t *peer_public);
+
+/* Removes every entry computed with the local key |key_id|. Returns how many
+ * were removed. A miss still computing when this is called returns its
+ * result without caching it. */
+unsigned curve25519_cache_invalidate_key(struct curve25519_cache *cache,
+                                         uint64_t key_id);
+
+/* Removes the entry for (|key_id|, |peer_public|), if any. Returns 1 if there
+ * was one. */
+int curve25519_cache_invalidate_peer(struct curve25519_cache *cache,
+                                     uint64_t key_id,
+                                     const uint8_t *peer_public);
+
+/* Sums the counters of all shards into |stats|. */
+void curve25519_cache_stats(struct curve25519_cache *cache,
+                            struct curve25519_cache_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* CURVE25519_CACHE_H */
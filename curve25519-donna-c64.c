@@ -1330,57 +1330,72 @@ swap_conditional(limb a[5], limb b[5], limb iswap) {
   }
 }
 
-/* Calculates nQ where Q is the x-coordinate of a point on the curve
+/* Runs |count| steps of the Montgomery ladder for nQ, consuming the bits of
+ * |n| from position |pos| - 1 downwards. (x2, z2), the running multiple of
+ * Q, and (x3, z3), one more than that, are in short form and are updated in
+ * place.
  *
- *   resultx/resultz: the x coordinate of the resulting curve point (short form)
  *   n: a little endian, 32-byte number
- *   q: a point of the curve (short form)
- */
+ *   q: a point of the curve (short form) */
 static void
-cmult(limb *resultx, limb *resultz, const u8 *n, const limb *q) {
-  limb a[5] = {0}, b[5] = {1}, c[5] = {1}, d[5] = {0};
-  limb *nqpqx = a, *nqpqz = b, *nqx = c, *nqz = d, *t;
+ladder_bits(limb *x2, limb *z2, limb *x3, limb *z3, const u8 *n, unsigned pos,
+            unsigned count, const limb *q) {
   limb e[5] = {0}, f[5] = {1}, g[5] = {0}, h[5] = {1};
+  limb *nqx = x2, *nqz = z2, *nqpqx = x3, *nqpqz = z3, *t;
   limb *nqpqx2 = e, *nqpqz2 = f, *nqx2 = g, *nqz2 = h;
 
-  unsigned i, j;
+  while (count--) {
+    const limb bit = (n[(pos - 1) >> 3] >> ((pos - 1) & 7)) & 1;
 
-  memcpy(nqpqx, q, sizeof(limb) * 5);
+    swap_conditional(nqx, nqpqx, bit);
+    swap_conditional(nqz, nqpqz, bit);
+    fmonty(nqx2, nqz2,
+           nqpqx2, nqpqz2,
+           nqx, nqz,
+           nqpqx, nqpqz,
+           q);
+    swap_conditional(nqx2, nqpqx2, bit);
+    swap_conditional(nqz2, nqpqz2, bit);
 
-  for (i = 0; i < 32; ++i) {
-    u8 byte = n[31 - i];
-    for (j = 0; j < 8; ++j) {
-      const limb bit = byte >> 7;
-
-      swap_conditional(nqx, nqpqx, bit);
-      swap_conditional(nqz, nqpqz, bit);
-      fmonty(nqx2, nqz2,
-             nqpqx2, nqpqz2,
-             nqx, nqz,
-             nqpqx, nqpqz,
-             q);
-      swap_conditional(nqx2, nqpqx2, bit);
-      swap_conditional(nqz2, nqpqz2, bit);
-
-      t = nqx;
-      nqx = nqx2;
-      nqx2 = t;
-      t = nqz;
-      nqz = nqz2;
-      nqz2 = t;
-      t = nqpqx;
-      nqpqx = nqpqx2;
-      nqpqx2 = t;
-      t = nqpqz;
-      nqpqz = nqpqz2;
-      nqpqz2 = t;
-
-      byte <<= 1;
-    }
+    t = nqx;
+    nqx = nqx2;
+    nqx2 = t;
+    t = nqz;
+    nqz = nqz2;
+    nqz2 = t;
+    t = nqpqx;
+    nqpqx = nqpqx2;
+    nqpqx2 = t;
+    t = nqpqz;
+    nqpqz = nqpqz2;
+    nqpqz2 = t;
+
+    pos--;
   }
 
-  memcpy(resultx, nqx, sizeof(limb) * 5);
-  memcpy(resultz, nqz, sizeof(limb) * 5);
+  /* After an odd number of steps the points are in the temporaries. */
+  if (nqx != x2) {
+    memcpy(x2, nqx, sizeof(limb) * 5);
+    memcpy(z2, nqz, sizeof(limb) * 5);
+    memcpy(x3, nqpqx, sizeof(limb) * 5);
+    memcpy(z3, nqpqz, sizeof(limb) * 5);
+  }
+}
+
+/* Calculates nQ where Q is the x-coordinate of a point on the curve
+ *
+ *   resultx/resultz: the x coordinate of the resulting curve point (short form)
+ *   n: a little endian, 32-byte number
+ *   q: a point of the curve (short form) */
+static void
+cmult(limb *resultx, limb *resultz, const u8 *n, const limb *q) {
+  limb a[5] = {0}, b[5] = {1}, c[5] = {1}, d[5] = {0};
+
+  memcpy(a, q, sizeof(limb) * 5);
+  ladder_bits(c, d, a, b, n, 256, 256, q);
+
+  memcpy(resultx, c, sizeof(limb) * 5);
+  memcpy(resultz, d, sizeof(limb) * 5);
 }
 
 
@@ -1415,11 +1430,23 @@ crecip(felem out, const felem z) {
   /* 2^255 - 21 */ fmul(out, t0, a);
 }
 
+/* Sets |mypublic| to |e| times |basepoint|, using |e| as given. */
+static int
+scalarmult(u8 *mypublic, const u8 *e, const u8 *basepoint) {
+  limb bp[5], x[5], z[5], zmone[5];
+
+  fexpand(bp, basepoint);
+  cmult(x, z, e, bp);
+  crecip(zmone, z);
+  fmul(z, x, zmone);
+  fcontract(mypublic, z);
+  return 0;
+}
+
 int curve25519_donna(u8 *, const u8 *, const u8 *);
 
 int
 curve25519_donna(u8 *mypublic, const u8 *secret, const u8 *basepoint) {
-  limb bp[5], x[5], z[5], zmone[5];
   uint8_t e[32];
   int i;
 
@@ -1428,10 +1455,485 @@ curve25519_donna(u8 *mypublic, const u8 *secret, const u8 *basepoint) {
   e[31] &= 127;
   e[31] |= 64;
 
-  fexpand(bp, basepoint);
-  cmult(x, z, e, bp);
-  crecip(zmone, z);
-  fmul(z, x, zmone);
-  fcontract(mypublic, z);
+  return scalarmult(mypublic, e, basepoint);
+}
+
+/* Returns 1 if the |len| bytes at |in| are all zero and 0 otherwise, without
+ * branching on the contents. */
+static int
+bytes_are_zero(const u8 *in, unsigned len) {
+  unsigned i;
+  uint32_t acc = 0;
+
+  for (i = 0; i < len; ++i) acc |= in[i];
+  return (int) ((acc - 1) >> 31);
+}
+
+/* The number of ladders that share a single field inversion in
+ * curve25519_donna_batch. The state for them lives on the stack. */
+#define BATCH_LANES 8
+
+int curve25519_donna_batch(u8 *, const u8 *, const u8 *, size_t);
+
+/* Computes curve25519_donna for |n| independent (secret, basepoint) pairs.
+ * The arguments are packed arrays of |n| 32-byte values and the results are
+ * identical to calling curve25519_donna on each pair.
+ *
+ * Up to BATCH_LANES ladders at a time share one inversion using Montgomery's
+ * trick, which saves most of a crecip per key. A zero z (low-order input) is
+ * replaced by one so that it doesn't poison the product, and the
+ * corresponding output is then masked to zero, all without branching. */
+int
+curve25519_donna_batch(u8 *mypublic, const u8 *secret, const u8 *basepoint,
+                       size_t n) {
+  felem x[BATCH_LANES], z[BATCH_LANES], acc[BATCH_LANES], bp, inv, t;
+  u8 e[32], zbytes[32];
+  limb zmask[BATCH_LANES];
+  size_t done, m, i;
+  int j;
+
+  for (done = 0; done < n; done += m) {
+    m = n - done;
+    if (m > BATCH_LANES) m = BATCH_LANES;
+
+    for (i = 0; i < m; ++i) {
+      const size_t off = (done + i) * 32;
+      limb iszero;
+
+      for (j = 0; j < 32; ++j) e[j] = secret[off + j];
+      e[0] &= 248;
+      e[31] &= 127;
+      e[31] |= 64;
+
+      fexpand(bp, basepoint + off);
+      cmult(x[i], z[i], e, bp);
+
+      fcontract(zbytes, z[i]);
+      iszero = bytes_are_zero(zbytes, 32);
+      zmask[i] = iszero - 1;
+      z[i][0] += iszero;
+
+      if (i == 0) {
+        memcpy(acc[0], z[0], sizeof(felem));
+      } else {
+        fmul(acc[i], acc[i - 1], z[i]);
+      }
+    }
+
+    crecip(inv, acc[m - 1]);
+    for (i = m - 1; i > 0; --i) {
+      fmul(t, inv, acc[i - 1]);
+      fmul(inv, inv, z[i]);
+      fmul(t, x[i], t);
+      fcontract(mypublic + (done + i) * 32, t);
+    }
+    fmul(t, x[0], inv);
+    fcontract(mypublic + done * 32, t);
+
+    for (i = 0; i < m; ++i) {
+      for (j = 0; j < 32; ++j) mypublic[(done + i) * 32 + j] &= zmask[i];
+    }
+  }
+
+  return 0;
+}
+
+/* The u-coordinates, in canonical little-endian form, of every point of small
+ * order on the curve and on its twist: 0 (order 2), 1 (order 4), 2^255-20
+ * (order 4, on the twist) and the two points of order 8. Any of these makes
+ * the shared secret all-zero no matter what the secret key is. */
+static const u8 small_order_points[5][32] = {
+  { 0 },
+  { 1 },
+  { 0xec, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x7f },
+  { 0xe0, 0xeb, 0x7a, 0x7c, 0x3b, 0x41, 0xb8, 0xae,
+    0x16, 0x56, 0xe3, 0xfa, 0xf1, 0x9f, 0xc4, 0x6a,
+    0xda, 0x09, 0x8d, 0xeb, 0x9c, 0x32, 0xb1, 0xfd,
+    0x86, 0x62, 0x05, 0x16, 0x5f, 0x49, 0xb8, 0x00 },
+  { 0x5f, 0x9c, 0x95, 0xbc, 0xa3, 0x50, 0x8c, 0x24,
+    0xb1, 0xd0, 0xb1, 0x55, 0x9c, 0x83, 0xef, 0x5b,
+    0x04, 0x44, 0x5c, 0xc4, 0x58, 0x1c, 0x8e, 0x86,
+    0xd8, 0x22, 0x4e, 0xdd, 0xd0, 0x9f, 0x11, 0x57 },
+};
+
+/* Returns 1 if |point| is the canonical encoding of a u-coordinate that isn't
+ * of small order, and 0 otherwise. An encoding is canonical if bit 255 is
+ * clear and the value is less than 2^255-19. Together with the table above,
+ * this rejects every 32-byte string that curve25519_donna would decode to a
+ * small-order point. The running time doesn't depend on |point|. */
+static int
+point_is_acceptable(const u8 *point) {
+  uint32_t bad, all_ff = 0xff, diff;
+  unsigned i, j;
+
+  /* bit 255 set */
+  bad = point[31] >> 7;
+
+  /* 2^255-19 <= u < 2^255: bytes 1..30 are 0xff, byte 31 is 0x7f and
+   * byte 0 is >= 0xed. */
+  for (i = 1; i < 31; ++i) all_ff &= point[i];
+  bad |= (((uint32_t)(all_ff ^ 0xff) - 1) >> 31) &
+         (((uint32_t)(point[31] ^ 0x7f) - 1) >> 31) &
+         ((((uint32_t)point[0] - 0xed) >> 31) ^ 1);
+
+  for (i = 0; i < 5; ++i) {
+    diff = 0;
+    for (j = 0; j < 32; ++j) diff |= point[j] ^ small_order_points[i][j];
+    bad |= (diff - 1) >> 31;
+  }
+
+  return (int) (bad ^ 1);
+}
+
+int curve25519_donna_checked(u8 *, const u8 *, const u8 *);
+
+/* Like curve25519_donna, but refuses to run the ladder on a non-canonical or
+ * small-order |basepoint| and refuses an all-zero result. Returns 0 on
+ * success and -1 if either check fails, in which case |mypublic| is all
+ * zeros. Rejecting a bad point costs a few hundred byte operations rather
+ * than a ladder. */
+int
+curve25519_donna_checked(u8 *mypublic, const u8 *secret, const u8 *basepoint) {
+  if (!point_is_acceptable(basepoint)) {
+    memset(mypublic, 0, 32);
+    return -1;
+  }
+
+  curve25519_donna(mypublic, secret, basepoint);
+  return bytes_are_zero(mypublic, 32) ? -1 : 0;
+}
+
+/* Sets |out| to z^((p-1)/2) = z^(2^254 - 10), which is 1 if z is a non-zero
+ * square, 0 if z is zero and -1 otherwise. The chain is crecip's up to
+ * 2^250 - 1. */
+static void
+flegendre(felem out, const felem z) {
+  felem z2, a, t0, b, c;
+
+  /* 2 */ fsquare_times(z2, z, 1);
+  /* 8 */ fsquare_times(t0, z2, 2);
+  /* 9 */ fmul(b, t0, z);
+  /* 11 */ fmul(a, b, z2);
+  /* 22 */ fsquare_times(t0, a, 1);
+  /* 2^5 - 2^0 = 31 */ fmul(b, t0, b);
+  /* 2^10 - 2^5 */ fsquare_times(t0, b, 5);
+  /* 2^10 - 2^0 */ fmul(b, t0, b);
+  /* 2^20 - 2^10 */ fsquare_times(t0, b, 10);
+  /* 2^20 - 2^0 */ fmul(c, t0, b);
+  /* 2^40 - 2^20 */ fsquare_times(t0, c, 20);
+  /* 2^40 - 2^0 */ fmul(t0, t0, c);
+  /* 2^50 - 2^10 */ fsquare_times(t0, t0, 10);
+  /* 2^50 - 2^0 */ fmul(b, t0, b);
+  /* 2^100 - 2^50 */ fsquare_times(t0, b, 50);
+  /* 2^100 - 2^0 */ fmul(c, t0, b);
+  /* 2^200 - 2^100 */ fsquare_times(t0, c, 100);
+  /* 2^200 - 2^0 */ fmul(t0, t0, c);
+  /* 2^250 - 2^50 */ fsquare_times(t0, t0, 50);
+  /* 2^250 - 2^0 */ fmul(t0, t0, b);
+  /* 2^252 - 2^2 */ fsquare_times(t0, t0, 2);
+  /* 2^252 - 3 */ fmul(t0, t0, z);
+  /* 2^254 - 12 */ fsquare_times(t0, t0, 2);
+  /* 2^254 - 10 */ fmul(out, t0, z2);
+}
+
+/* Sets |out| to the canonical encoding of u^3 + 486662u^2 + u, the right-hand
+ * side of the curve equation, for the u-coordinate |point|. */
+static void
+curve_rhs(u8 out[32], const u8 *point) {
+  static const felem A = {486662};
+  static const felem one = {1};
+  felem u, t;
+
+  fexpand(u, point);
+  memcpy(t, u, sizeof(felem));
+  fsum(t, A);
+  fmul(t, t, u);
+  fsum(t, one);
+  fmul(t, t, u);
+  fcontract(out, t);
+}
+
+/* Returns 1 if the canonical field element |in| is p-1 and 0 otherwise, in
+ * constant time. */
+static int
+bytes_are_minus_one(const u8 in[32]) {
+  uint32_t diff = (in[0] ^ 0xec) | (in[31] ^ 0x7f);
+  unsigned i;
+
+  for (i = 1; i < 31; ++i) diff |= in[i] ^ 0xff;
+  return (int) ((diff - 1) >> 31);
+}
+
+/* Returns the Jacobi symbol (in / 2^255-19) of the canonical field element
+ * |in| using the binary algorithm. Its running time depends on |in|. */
+static int
+jacobi_vartime(const u8 in[32]) {
+  uint64_t a[4], n[4] = {
+    0xffffffffffffffedull, 0xffffffffffffffffull,
+    0xffffffffffffffffull, 0x7fffffffffffffffull,
+  };
+  uint64_t t, borrow;
+  int sign = 1, i, j, less;
+
+  for (i = 0; i < 4; ++i) {
+    a[i] = 0;
+    for (j = 7; j >= 0; --j) a[i] = (a[i] << 8) | in[8 * i + j];
+  }
+
+  for (;;) {
+    if ((a[0] | a[1] | a[2] | a[3]) == 0) break;
+
+    /* Remove factors of two: (2/n) = -1 iff n = 3 or 5 mod 8. */
+    while ((a[0] & 1) == 0) {
+      int shift = 1;
+      if (a[0] == 0) {
+        a[0] = a[1]; a[1] = a[2]; a[2] = a[3]; a[3] = 0;
+        /* 64 is even, so the sign doesn't change. */
+        continue;
+      }
+      while (((a[0] >> shift) & 1) == 0) shift++;
+      if ((shift & 1) && ((n[0] & 7) == 3 || (n[0] & 7) == 5)) sign = -sign;
+      for (i = 0; i < 3; ++i) a[i] = (a[i] >> shift) | (a[i + 1] << (64 - shift));
+      a[3] >>= shift;
+    }
+
+    /* Both odd now. If a < n, swap them using quadratic reciprocity. */
+    less = 0;
+    for (i = 3; i >= 0; --i) {
+      if (a[i] != n[i]) {
+        less = a[i] < n[i];
+        break;
+      }
+    }
+    if (less) {
+      for (i = 0; i < 4; ++i) {
+        t = a[i]; a[i] = n[i]; n[i] = t;
+      }
+      if ((a[0] & 3) == 3 && (n[0] & 3) == 3) sign = -sign;
+    }
+
+    /* (a/n) = ((a-n)/n) */
+    borrow = 0;
+    for (i = 0; i < 4; ++i) {
+      t = a[i] - n[i] - borrow;
+      borrow = (a[i] < n[i]) | ((a[i] == n[i]) & borrow);
+      a[i] = t;
+    }
+  }
+
+  /* n is now gcd(in, p), which is 1 unless in is zero. */
+  return (n[0] == 1 && (n[1] | n[2] | n[3]) == 0) ? sign : 0;
+}
+
+int curve25519_donna_on_curve(const u8 *);
+int curve25519_donna_on_curve_vartime(const u8 *);
+int curve25519_donna_on_curve_batch(int *, const u8 *, size_t);
+
+/* Returns 1 if the u-coordinate |point| belongs to a point on curve25519 and
+ * 0 if it is on the quadratic twist, by computing the Legendre symbol of
+ * u^3 + 486662u^2 + u. Bit 255 is ignored, as in curve25519_donna. Runs in
+ * constant time. */
+int
+curve25519_donna_on_curve(const u8 *point) {
+  u8 rhs[32];
+  felem v, chi;
+
+  curve_rhs(rhs, point);
+  fexpand(v, rhs);
+  flegendre(chi, v);
+  fcontract(rhs, chi);
+  return bytes_are_minus_one(rhs) ^ 1;
+}
+
+/* Same result as curve25519_donna_on_curve, but faster and with a running
+ * time that depends on |point|. Only for public keys. */
+int
+curve25519_donna_on_curve_vartime(const u8 *point) {
+  u8 rhs[32];
+
+  curve_rhs(rhs, point);
+  return jacobi_vartime(rhs) >= 0;
+}
+
+/* Runs curve25519_donna_on_curve on |n| packed 32-byte points, storing each
+ * result in |on_curve|. Returns 1 if every point is on the curve and 0
+ * otherwise. */
+int
+curve25519_donna_on_curve_batch(int *on_curve, const u8 *points, size_t n) {
+  size_t i;
+  int all = 1;
+
+  for (i = 0; i < n; ++i) {
+    on_curve[i] = curve25519_donna_on_curve(points + 32 * i);
+    all &= on_curve[i];
+  }
+  return all;
+}
+
+/* 8 * l, where l = 2^252 + 27742317777372353535851937790883648493 is the
+ * order of the prime-order subgroup, so 8l is the order of the whole curve
+ * group. Little-endian 32-bit words. */
+static const uint32_t eight_l[8] = {
+  0xe7ae9f68, 0xc09318d2, 0x17bce6b2, 0xa6f7cef5,
+  0x00000000, 0x00000000, 0x00000000, 0x80000000,
+};
+
+/* Sets |out| to |a| * |b| mod 8l, where all three are little-endian 32-byte
+ * numbers. Reducing modulo the full group order, rather than l, keeps the
+ * small-order component of a point multiplied by the result exact. Runs in
+ * constant time. */
+static void
+scalar_mul_mod_8l(u8 out[32], const u8 a[32], const u8 b[32]) {
+  uint32_t x[8], y[8], prod[16], r[9], t[9], mask;
+  uint64_t acc;
+  unsigned i, j;
+  int bit;
+
+  for (i = 0; i < 8; ++i) {
+    x[i] = (uint32_t)a[4*i] | ((uint32_t)a[4*i+1] << 8) |
+           ((uint32_t)a[4*i+2] << 16) | ((uint32_t)a[4*i+3] << 24);
+    y[i] = (uint32_t)b[4*i] | ((uint32_t)b[4*i+1] << 8) |
+           ((uint32_t)b[4*i+2] << 16) | ((uint32_t)b[4*i+3] << 24);
+  }
+
+  memset(prod, 0, sizeof(prod));
+  for (i = 0; i < 8; ++i) {
+    acc = 0;
+    for (j = 0; j < 8; ++j) {
+      acc += (uint64_t)x[i] * y[j] + prod[i + j];
+      prod[i + j] = (uint32_t)acc;
+      acc >>= 32;
+    }
+    prod[i + 8] = (uint32_t)acc;
+  }
+
+  /* Shift the product into r one bit at a time, subtracting 8l whenever
+   * r >= 8l. r < 8l < 2^256 before each step, so 2r+1 fits in nine words. */
+  memset(r, 0, sizeof(r));
+  for (bit = 511; bit >= 0; --bit) {
+    for (i = 8; i > 0; --i) r[i] = (r[i] << 1) | (r[i - 1] >> 31);
+    r[0] = (r[0] << 1) | ((prod[bit / 32] >> (bit % 32)) & 1);
+
+    acc = 0;
+    for (i = 0; i < 9; ++i) {
+      acc = (uint64_t)r[i] - (i < 8 ? eight_l[i] : 0) - (acc >> 63);
+      t[i] = (uint32_t)acc;
+    }
+    /* The final borrow is set iff r < 8l. */
+    mask = (uint32_t)(acc >> 63) - 1;
+    for (i = 0; i < 9; ++i) r[i] = (t[i] & mask) | (r[i] & ~mask);
+  }
+
+  for (i = 0; i < 8; ++i) {
+    out[4*i] = r[i];
+    out[4*i+1] = r[i] >> 8;
+    out[4*i+2] = r[i] >> 16;
+    out[4*i+3] = r[i] >> 24;
+  }
+}
+
+int curve25519_donna_raw(u8 *, const u8 *, const u8 *);
+int curve25519_donna_raw_blinded(u8 *, const u8 *, const u8 *, const u8 *);
+
+/* Sets |out| to |scalar| times the point |basepoint|, using all 256 bits of
+ * |scalar| as given: no clamping. Multiples that are the point at infinity
+ * come out as zero, as do odd multiples of the point of order two, since
+ * both have u-coordinate zero in this encoding. Always returns 0. */
+int
+curve25519_donna_raw(u8 *out, const u8 *scalar, const u8 *basepoint) {
+  return scalarmult(out, scalar, basepoint);
+}
+
+/* Sets |out| to (|scalar| * |blind| mod 8l) times |basepoint|: the same
+ * result as blinding the output of curve25519_donna_raw with a second call,
+ * for the price of one ladder and a short scalar multiplication. Reducing
+ * modulo 8l is only valid for points on the curve proper, so this returns -1,
+ * and zeros |out|, if |basepoint| is on the twist. Returns 0 otherwise. */
+int
+curve25519_donna_raw_blinded(u8 *out, const u8 *scalar, const u8 *blind,
+                             const u8 *basepoint) {
+  u8 e[32];
+
+  if (!curve25519_donna_on_curve(basepoint)) {
+    memset(out, 0, 32);
+    return -1;
+  }
+
+  scalar_mul_mod_8l(e, scalar, blind);
+  return scalarmult(out, e, basepoint);
+}
+
+/* The state of a ladder that runs over several calls. It lives in the
+ * caller's struct curve25519_donna_ladder, which is 512 bytes. */
+struct ladder_state {
+  limb x2[5], z2[5], x3[5], z3[5], q[5];
+  u8 e[32];
+  unsigned remaining;  /* ladder steps still to run */
+};
+
+typedef char ladder_state_fits[sizeof(struct ladder_state) <= 512 ? 1 : -1];
+
+struct curve25519_donna_ladder;
+
+int curve25519_donna_ladder_init(struct curve25519_donna_ladder *, const u8 *,
+                                 const u8 *);
+unsigned curve25519_donna_ladder_step(struct curve25519_donna_ladder *,
+                                      unsigned);
+int curve25519_donna_ladder_finish(struct curve25519_donna_ladder *, u8 *);
+
+/* Starts computing curve25519_donna(mypublic, secret, basepoint) in pieces:
+ * clamps |secret| and sets up the ladder without running any of it. */
+int
+curve25519_donna_ladder_init(struct curve25519_donna_ladder *ladder,
+                             const u8 *secret, const u8 *basepoint) {
+  struct ladder_state *st = (struct ladder_state *) ladder;
+  int i;
+
+  memset(st, 0, sizeof(*st));
+  for (i = 0; i < 32; ++i) st->e[i] = secret[i];
+  st->e[0] &= 248;
+  st->e[31] &= 127;
+  st->e[31] |= 64;
+
+  fexpand(st->q, basepoint);
+  st->x2[0] = 1;
+  memcpy(st->x3, st->q, sizeof(st->q));
+  st->z3[0] = 1;
+  st->remaining = 256;
+  return 0;
+}
+
+/* Runs the next |bits| steps of the ladder, or as many as are left, and
+ * returns how many remain. The time taken depends only on |bits|. */
+unsigned
+curve25519_donna_ladder_step(struct curve25519_donna_ladder *ladder,
+                             unsigned bits) {
+  struct ladder_state *st = (struct ladder_state *) ladder;
+
+  if (bits > st->remaining) bits = st->remaining;
+  ladder_bits(st->x2, st->z2, st->x3, st->z3, st->e, st->remaining, bits,
+              st->q);
+  st->remaining -= bits;
+  return st->remaining;
+}
+
+/* Runs any remaining steps, writes the result to |mypublic| and wipes the
+ * state. Always returns 0. */
+int
+curve25519_donna_ladder_finish(struct curve25519_donna_ladder *ladder,
+                               u8 *mypublic) {
+  struct ladder_state *st = (struct ladder_state *) ladder;
+  limb zmone[5], out[5];
+
+  ladder_bits(st->x2, st->z2, st->x3, st->z3, st->e, st->remaining,
+              st->remaining, st->q);
+  crecip(zmone, st->z2);
+  fmul(out, st->x2, zmone);
+  fcontract(mypublic, out);
+
+  memset(st, 0, sizeof(*st));
   return 0;
 }
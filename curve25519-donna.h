@@ -0,0 +1,101 @@
+/* curve25519-donna: Curve25519 elliptic curve, public key function
+ *
+ * Both curve25519-donna.c (portable, 32-bit limbs) and curve25519-donna-c64.c
+ * (64-bit limbs, needs a 128-bit integer type) define every function declared
+ * here, so link against exactly one of them. The implementations don't
+ * include this file themselves so that each stays a single drop-in source
+ * file. */
+
+#ifndef CURVE25519_DONNA_H
+#define CURVE25519_DONNA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Sets |mypublic| to |secret| times the point |basepoint|. All arguments are
+ * 32 bytes long and |secret| is clamped before use. To derive a public key,
+ * pass the basepoint {9, 0, ..., 0}. Always returns 0. */
+int curve25519_donna(uint8_t *mypublic, const uint8_t *secret,
+                     const uint8_t *basepoint);
+
+/* Runs curve25519_donna on |n| (secret, basepoint) pairs. The arguments are
+ * packed arrays of |n| 32-byte values; the output is bit-identical to |n|
+ * single calls but cheaper, because the ladders share field inversions.
+ * Always returns 0. */
+int curve25519_donna_batch(uint8_t *mypublic, const uint8_t *secret,
+                           const uint8_t *basepoint, size_t n);
+
+/* Like curve25519_donna, but for keys received from a peer: returns -1 without
+ * running the ladder if |basepoint| is not canonical (bit 255 set, or not
+ * reduced mod 2^255-19) or is a point of small order, and returns -1 if the
+ * result is all zeros. Returns 0 otherwise. On failure |mypublic| is zeroed.
+ * The input checks run in constant time. */
+int curve25519_donna_checked(uint8_t *mypublic, const uint8_t *secret,
+                             const uint8_t *basepoint);
+
+/* Returns 1 if the u-coordinate |point| is that of a point on curve25519 and
+ * 0 if it lies on the quadratic twist, by computing the Legendre symbol of
+ * u^3 + 486662u^2 + u. Bit 255 is ignored, as in curve25519_donna. Runs in
+ * constant time and costs about a field inversion. */
+int curve25519_donna_on_curve(const uint8_t *point);
+
+/* Same result as curve25519_donna_on_curve, using a binary Jacobi symbol
+ * algorithm whose running time depends on |point|. Only for public data. */
+int curve25519_donna_on_curve_vartime(const uint8_t *point);
+
+/* Runs curve25519_donna_on_curve on |n| packed 32-byte points and stores
+ * each result in |on_curve|. Returns 1 if all of them are on the curve. */
+int curve25519_donna_on_curve_batch(int *on_curve, const uint8_t *points,
+                                    size_t n);
+
+/* Sets |out| to |scalar| times |basepoint| using all 256 bits of |scalar|
+ * exactly as given, for key blinding and similar constructions that need
+ * arbitrary multipliers. The point at infinity is encoded as zero. Always
+ * returns 0. */
+int curve25519_donna_raw(uint8_t *out, const uint8_t *scalar,
+                         const uint8_t *basepoint);
+
+/* Sets |out| to (|scalar| * |blind| mod 8l) times |basepoint|, where l is the
+ * prime subgroup order. This equals blinding the result of
+ * curve25519_donna_raw with a second call, but runs a single ladder. Returns
+ * -1 (and zeros |out|) if |basepoint| is on the twist, where that identity
+ * doesn't hold; returns 0 otherwise. */
+int curve25519_donna_raw_blinded(uint8_t *out, const uint8_t *scalar,
+                                 const uint8_t *blind,
+                                 const uint8_t *basepoint);
+
+/* State for a curve25519_donna computation that is spread over several calls,
+ * so that a single-threaded scheduler can interleave it with other work. The
+ * caller owns the storage; its contents are private to the implementation. */
+struct curve25519_donna_ladder {
+  uint64_t opaque[64];
+};
+
+/* Starts computing curve25519_donna(mypublic, secret, basepoint) without
+ * running any of the ladder. |secret| and |basepoint| are copied, so they
+ * needn't stay valid. Always returns 0. */
+int curve25519_donna_ladder_init(struct curve25519_donna_ladder *ladder,
+                                 const uint8_t *secret,
+                                 const uint8_t *basepoint);
+
+/* Runs up to |bits| of the 256 ladder steps and returns how many remain. The
+ * time taken depends only on the number of steps run, so calls with a fixed
+ * |bits| give a fixed pause. */
+unsigned curve25519_donna_ladder_step(struct curve25519_donna_ladder *ladder,
+                                      unsigned bits);
+
+/* Runs any remaining steps and the final field inversion, writes the result
+ * to |mypublic| and wipes |ladder|. The result equals curve25519_donna's.
+ * Always returns 0. */
+int curve25519_donna_ladder_finish(struct curve25519_donna_ladder *ladder,
+                                   uint8_t *mypublic);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* CURVE25519_DONNA_H */
@@ -0,0 +1,394 @@
+/* Pool of precomputed ephemeral curve25519 keypairs. Public domain.
+ *
+ * The ring is the same bounded queue with per-slot sequence numbers as in
+ * curve25519-async.c, with the refill thread as the only producer. Each pop
+ * wipes the slot before giving it back to the producer.
+ *
+ * Forks are noticed through a counter bumped by a pthread_atfork child
+ * handler: a pool created under an older count belongs to the parent, and is
+ * reset before its first use in the child. */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/types.h>
+
+#include "curve25519-donna.h"
+#include "curve25519-keypool.h"
+
+#define CACHE_LINE 64
+#define REFILL_BATCH 8
+
+struct keypair {
+  uint8_t secret[32];
+  uint8_t public_key[32];
+};
+
+struct pool_slot {
+  atomic_size_t seq;
+  struct keypair kp;
+};
+
+struct curve25519_keypool {
+  struct pool_slot *slots;
+  size_t slots_size;  /* bytes mapped */
+  size_t mask;
+  unsigned capacity, low_watermark;
+
+  _Alignas(CACHE_LINE) atomic_size_t tail;
+  _Alignas(CACHE_LINE) atomic_size_t head;
+  _Alignas(CACHE_LINE) atomic_uint level;
+  atomic_uint min_level;
+  atomic_uint_fast64_t served, misses, low_events, generated;
+
+  /* The refill thread sleeps on |wake| while the pool is above the low
+   * watermark. */
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_t thread;
+  int thread_running;
+  atomic_int stop;
+
+  atomic_uint fork_generation;
+  atomic_flag resetting;
+};
+
+static atomic_uint fork_generation;
+static pthread_once_t atfork_once = PTHREAD_ONCE_INIT;
+
+static void
+wipe(void *p, size_t len) {
+  volatile uint8_t *v = (volatile uint8_t *) p;
+  while (len--) *v++ = 0;
+}
+
+static void
+on_fork_child(void) {
+  atomic_fetch_add_explicit(&fork_generation, 1, memory_order_relaxed);
+}
+
+static void
+register_atfork(void) {
+  pthread_atfork(NULL, NULL, on_fork_child);
+}
+
+static void
+ring_reset(struct curve25519_keypool *pool) {
+  size_t i;
+
+  for (i = 0; i <= pool->mask; ++i) {
+    wipe(&pool->slots[i].kp, sizeof(pool->slots[i].kp));
+    atomic_init(&pool->slots[i].seq, i);
+  }
+  atomic_init(&pool->tail, 0);
+  atomic_init(&pool->head, 0);
+  atomic_init(&pool->level, 0);
+  atomic_init(&pool->min_level, pool->capacity);
+}
+
+static int
+ring_push(struct curve25519_keypool *pool, const struct keypair *kp) {
+  size_t pos = atomic_load_explicit(&pool->tail, memory_order_relaxed);
+
+  for (;;) {
+    struct pool_slot *slot = &pool->slots[pos & pool->mask];
+    const size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    const intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&pool->tail, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        slot->kp = *kp;
+        atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+        return 0;
+      }
+    } else if (diff < 0) {
+      return -1;
+    } else {
+      pos = atomic_load_explicit(&pool->tail, memory_order_relaxed);
+    }
+  }
+}
+
+static int
+ring_pop(struct curve25519_keypool *pool, struct keypair *kp) {
+  size_t pos = atomic_load_explicit(&pool->head, memory_order_relaxed);
+
+  for (;;) {
+    struct pool_slot *slot = &pool->slots[pos & pool->mask];
+    const size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    const intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&pool->head, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        *kp = slot->kp;
+        wipe(&slot->kp, sizeof(slot->kp));
+        atomic_store_explicit(&slot->seq, pos + pool->mask + 1,
+                              memory_order_release);
+        return 0;
+      }
+    } else if (diff < 0) {
+      return -1;
+    } else {
+      pos = atomic_load_explicit(&pool->head, memory_order_relaxed);
+    }
+  }
+}
+
+static int
+generate(struct keypair *kps, unsigned n) {
+  static const uint8_t basepoint[32] = {9};
+  uint8_t secrets[REFILL_BATCH * 32], points[REFILL_BATCH * 32];
+  uint8_t publics[REFILL_BATCH * 32];
+  unsigned i;
+
+  if (getrandom(secrets, 32 * n, 0) != (ssize_t) (32 * n)) {
+    wipe(secrets, sizeof(secrets));
+    return -1;
+  }
+  for (i = 0; i < n; ++i) memcpy(points + 32 * i, basepoint, 32);
+  curve25519_donna_batch(publics, secrets, points, n);
+
+  for (i = 0; i < n; ++i) {
+    memcpy(kps[i].secret, secrets + 32 * i, 32);
+    memcpy(kps[i].public_key, publics + 32 * i, 32);
+  }
+  wipe(secrets, sizeof(secrets));
+  return 0;
+}
+
+static void *
+refill_main(void *arg) {
+  struct curve25519_keypool *pool = arg;
+  struct keypair kps[REFILL_BATCH];
+  unsigned i, n, level;
+  int failed;
+
+  for (;;) {
+    /* Top the pool all the way up, then sleep until it runs low. */
+    level = atomic_load_explicit(&pool->level, memory_order_relaxed);
+    failed = 0;
+    while (level < pool->capacity &&
+           !atomic_load_explicit(&pool->stop, memory_order_relaxed)) {
+      n = pool->capacity - level;
+      if (n > REFILL_BATCH) n = REFILL_BATCH;
+      if (generate(kps, n) != 0) {
+        failed = 1;
+        break;
+      }
+      /* Count them before they become visible, so that a consumer never
+       * takes the level below zero. */
+      level = atomic_fetch_add_explicit(&pool->level, n,
+                                        memory_order_relaxed) + n;
+      for (i = 0; i < n; ++i) {
+        while (ring_push(pool, &kps[i]) != 0) sched_yield();
+      }
+      wipe(kps, sizeof(kps));
+      atomic_fetch_add_explicit(&pool->generated, n, memory_order_relaxed);
+    }
+
+    /* Consumers signal under the lock after lowering the level, so checking
+     * it under the lock can't miss a wakeup. If randomness failed, retry on
+     * the next request rather than spin. */
+    pthread_mutex_lock(&pool->lock);
+    if (failed && !atomic_load_explicit(&pool->stop, memory_order_relaxed)) {
+      pthread_cond_wait(&pool->wake, &pool->lock);
+    }
+    while (!atomic_load_explicit(&pool->stop, memory_order_relaxed) &&
+           atomic_load_explicit(&pool->level, memory_order_relaxed) >=
+               pool->low_watermark) {
+      pthread_cond_wait(&pool->wake, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    if (atomic_load_explicit(&pool->stop, memory_order_relaxed)) break;
+  }
+
+  return NULL;
+}
+
+static void
+wake_refill(struct curve25519_keypool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  pthread_cond_signal(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+static int
+start_refill(struct curve25519_keypool *pool) {
+  atomic_store_explicit(&pool->stop, 0, memory_order_relaxed);
+  pool->thread_running =
+      pthread_create(&pool->thread, NULL, refill_main, pool) == 0;
+  return pool->thread_running ? 0 : -1;
+}
+
+/* Runs in a forked child on first use: the parent's keys must never be
+ * handed out here, and the parent's refill thread doesn't exist. */
+static void
+reset_after_fork(struct curve25519_keypool *pool, unsigned generation) {
+  while (atomic_flag_test_and_set_explicit(&pool->resetting,
+                                           memory_order_acquire)) {
+    sched_yield();
+  }
+  if (atomic_load_explicit(&pool->fork_generation, memory_order_relaxed) !=
+      generation) {
+    ring_reset(pool);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    start_refill(pool);
+    atomic_store_explicit(&pool->fork_generation, generation,
+                          memory_order_release);
+  }
+  atomic_flag_clear_explicit(&pool->resetting, memory_order_release);
+}
+
+struct curve25519_keypool *
+curve25519_keypool_new(unsigned capacity, unsigned low_watermark) {
+  struct curve25519_keypool *pool;
+  size_t size = 1;
+
+  if (capacity == 0 || capacity > (1u << 24)) return NULL;
+  while (size < capacity) size <<= 1;
+  if (low_watermark == 0) low_watermark = 1;
+  if (low_watermark > size) low_watermark = size;
+
+  pthread_once(&atfork_once, register_atfork);
+
+  pool = aligned_alloc(CACHE_LINE, (sizeof(*pool) + CACHE_LINE - 1) &
+                                   ~(size_t) (CACHE_LINE - 1));
+  if (!pool) return NULL;
+  memset(pool, 0, sizeof(*pool));
+
+  /* Secrets live in their own mapping so that they can be kept out of core
+   * dumps and wiped by the kernel on fork. */
+  pool->slots_size = size * sizeof(struct pool_slot);
+  pool->slots = mmap(NULL, pool->slots_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (pool->slots == MAP_FAILED) {
+    free(pool);
+    return NULL;
+  }
+#ifdef MADV_DONTDUMP
+  madvise(pool->slots, pool->slots_size, MADV_DONTDUMP);
+#endif
+#ifdef MADV_WIPEONFORK
+  madvise(pool->slots, pool->slots_size, MADV_WIPEONFORK);
+#endif
+
+  pool->mask = size - 1;
+  pool->capacity = size;
+  pool->low_watermark = low_watermark;
+  ring_reset(pool);
+  atomic_flag_clear(&pool->resetting);
+  atomic_init(&pool->fork_generation,
+              atomic_load_explicit(&fork_generation, memory_order_relaxed));
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->wake, NULL);
+
+  if (start_refill(pool) != 0) {
+    munmap(pool->slots, pool->slots_size);
+    free(pool);
+    return NULL;
+  }
+
+  return pool;
+}
+
+void
+curve25519_keypool_free(struct curve25519_keypool *pool) {
+  if (!pool) return;
+
+  /* In a child that never used the pool, the refill thread and the state of
+   * its lock are the parent's; there's nothing to stop or destroy. */
+  if (atomic_load_explicit(&pool->fork_generation, memory_order_relaxed) ==
+      atomic_load_explicit(&fork_generation, memory_order_relaxed)) {
+    if (pool->thread_running) {
+      pthread_mutex_lock(&pool->lock);
+      atomic_store_explicit(&pool->stop, 1, memory_order_relaxed);
+      pthread_cond_signal(&pool->wake);
+      pthread_mutex_unlock(&pool->lock);
+      pthread_join(pool->thread, NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+  }
+
+  ring_reset(pool);
+  munmap(pool->slots, pool->slots_size);
+  free(pool);
+}
+
+static void
+note_level(struct curve25519_keypool *pool, unsigned level) {
+  unsigned min = atomic_load_explicit(&pool->min_level, memory_order_relaxed);
+
+  while (level < min &&
+         !atomic_compare_exchange_weak_explicit(&pool->min_level, &min, level,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+  }
+}
+
+int
+curve25519_keypool_get(struct curve25519_keypool *pool, uint8_t *secret,
+                       uint8_t *public_key) {
+  const unsigned generation =
+      atomic_load_explicit(&fork_generation, memory_order_relaxed);
+  struct keypair kp;
+  unsigned level;
+
+  if (atomic_load_explicit(&pool->fork_generation, memory_order_acquire) !=
+      generation) {
+    reset_after_fork(pool, generation);
+  }
+
+  if (ring_pop(pool, &kp) == 0) {
+    level = atomic_fetch_sub_explicit(&pool->level, 1,
+                                      memory_order_relaxed) - 1;
+    atomic_fetch_add_explicit(&pool->served, 1, memory_order_relaxed);
+    note_level(pool, level);
+    if (level + 1 == pool->low_watermark) {
+      atomic_fetch_add_explicit(&pool->low_events, 1, memory_order_relaxed);
+      wake_refill(pool);
+    }
+  } else {
+    atomic_fetch_add_explicit(&pool->misses, 1, memory_order_relaxed);
+    note_level(pool, 0);
+    wake_refill(pool);
+    if (generate(&kp, 1) != 0) {
+      memset(secret, 0, 32);
+      memset(public_key, 0, 32);
+      return -1;
+    }
+  }
+
+  memcpy(secret, kp.secret, 32);
+  memcpy(public_key, kp.public_key, 32);
+  wipe(&kp, sizeof(kp));
+  return 0;
+}
+
+void
+curve25519_keypool_stats(struct curve25519_keypool *pool,
+                         struct curve25519_keypool_stats *stats, int reset) {
+  stats->served = atomic_load_explicit(&pool->served, memory_order_relaxed);
+  stats->misses = atomic_load_explicit(&pool->misses, memory_order_relaxed);
+  stats->low_events =
+      atomic_load_explicit(&pool->low_events, memory_order_relaxed);
+  stats->generated =
+      atomic_load_explicit(&pool->generated, memory_order_relaxed);
+  stats->level = atomic_load_explicit(&pool->level, memory_order_relaxed);
+  stats->min_level =
+      atomic_load_explicit(&pool->min_level, memory_order_relaxed);
+  if (reset) {
+    atomic_store_explicit(&pool->min_level, stats->level,
+                          memory_order_relaxed);
+  }
+}
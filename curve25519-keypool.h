@@ -0,0 +1,62 @@
+/* Pool of precomputed ephemeral curve25519 keypairs.
+ *
+ * A background thread keeps a lock-free ring topped up with fresh keypairs,
+ * generated in batches through curve25519_donna_batch, so that taking an
+ * ephemeral key on a latency-critical path is a copy instead of a ladder.
+ * Each keypair is handed out once and wiped from the pool as it is taken.
+ *
+ * The pool is fork-safe: a child process never sees its parent's keys. The
+ * ring memory is marked to be wiped on fork where the kernel supports that,
+ * and in any case the first call in the child discards the ring and starts a
+ * new refill thread.
+ *
+ * Linux only (getrandom); link with -lpthread and one of the curve25519-donna
+ * implementations. */
+
+#ifndef CURVE25519_KEYPOOL_H
+#define CURVE25519_KEYPOOL_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct curve25519_keypool;
+
+struct curve25519_keypool_stats {
+  uint64_t served;      /* keypairs taken from the pool */
+  uint64_t misses;      /* calls that found it empty and generated inline */
+  uint64_t low_events;  /* times the level dropped below the low watermark */
+  uint64_t generated;   /* keypairs made by the refill thread */
+  unsigned level;       /* keypairs currently in the pool */
+  unsigned min_level;   /* lowest level seen since the last reset */
+};
+
+/* Creates a pool holding up to |capacity| keypairs (rounded up to a power of
+ * two) and starts filling it. Refilling resumes whenever fewer than
+ * |low_watermark| (at least 1) remain. Returns NULL on failure. */
+struct curve25519_keypool *curve25519_keypool_new(unsigned capacity,
+                                                  unsigned low_watermark);
+
+/* Stops the refill thread and wipes and frees the pool. */
+void curve25519_keypool_free(struct curve25519_keypool *pool);
+
+/* Writes a fresh keypair to |secret| and |public_key| (32 bytes each). Takes
+ * one from the pool if possible, otherwise generates it inline. Safe to call
+ * from any thread. Returns 0 on success and -1 if no random bytes could be
+ * obtained, in which case both outputs are zeroed. */
+int curve25519_keypool_get(struct curve25519_keypool *pool, uint8_t *secret,
+                           uint8_t *public_key);
+
+/* Fills |stats|. If |reset| is non-zero, min_level restarts from the current
+ * level, so periodic callers see the low point of each interval. */
+void curve25519_keypool_stats(struct curve25519_keypool *pool,
+                              struct curve25519_keypool_stats *stats,
+                              int reset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* CURVE25519_KEYPOOL_H */
@@ -0,0 +1,105 @@
+/* Multi-buffer job manager for curve25519-donna. Public domain. */
+
+#include <string.h>
+#include <time.h>
+
+#include "curve25519-donna.h"
+#include "curve25519-mb.h"
+
+static uint64_t
+now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void
+curve25519_mb_mgr_init(struct curve25519_mb_mgr *mgr, unsigned lanes,
+                       uint64_t deadline_ns) {
+  memset(mgr, 0, sizeof(*mgr));
+  if (lanes == 0) lanes = 1;
+  if (lanes > CURVE25519_MB_MAX_LANES) lanes = CURVE25519_MB_MAX_LANES;
+  mgr->lanes = lanes;
+  mgr->deadline_ns = deadline_ns;
+}
+
+/* Runs every queued job as one batch and moves them to the completed ring. */
+static void
+run_batch(struct curve25519_mb_mgr *mgr) {
+  static const uint8_t basepoint[32] = {9};
+  const unsigned n = mgr->num_queued;
+  unsigned i, slot;
+
+  for (i = 0; i < n; ++i) {
+    const struct curve25519_mb_job *job = mgr->queued[i];
+    memcpy(mgr->secrets + 32 * i, job->secret, 32);
+    memcpy(mgr->points + 32 * i, job->basepoint ? job->basepoint : basepoint,
+           32);
+  }
+
+  curve25519_donna_batch(mgr->outs, mgr->secrets, mgr->points, n);
+  memset(mgr->secrets, 0, 32 * n);
+
+  for (i = 0; i < n; ++i) {
+    struct curve25519_mb_job *job = mgr->queued[i];
+    memcpy(job->out, mgr->outs + 32 * i, 32);
+    job->status = CURVE25519_MB_STATUS_COMPLETED;
+
+    slot = (mgr->completed_head + mgr->num_completed) %
+           (2 * CURVE25519_MB_MAX_LANES);
+    mgr->completed[slot] = job;
+    mgr->num_completed++;
+  }
+  memset(mgr->outs, 0, 32 * n);
+
+  mgr->batches++;
+  if (n < mgr->lanes) mgr->partial_batches++;
+  mgr->jobs += n;
+  mgr->num_queued = 0;
+}
+
+struct curve25519_mb_job *
+curve25519_mb_get_completed(struct curve25519_mb_mgr *mgr) {
+  struct curve25519_mb_job *job;
+
+  if (mgr->num_completed == 0) return NULL;
+  job = mgr->completed[mgr->completed_head];
+  mgr->completed_head = (mgr->completed_head + 1) %
+                        (2 * CURVE25519_MB_MAX_LANES);
+  mgr->num_completed--;
+  return job;
+}
+
+static int
+deadline_passed(const struct curve25519_mb_mgr *mgr) {
+  return mgr->deadline_ns != 0 && mgr->num_queued > 0 &&
+         now_ns() - mgr->oldest_ns >= mgr->deadline_ns;
+}
+
+/* Every submit hands back a completion whenever one exists, so completed plus
+ * queued jobs never exceed |lanes| between calls, and a batch always fits in
+ * the completed ring. */
+struct curve25519_mb_job *
+curve25519_mb_submit(struct curve25519_mb_mgr *mgr,
+                     struct curve25519_mb_job *job) {
+  job->status = CURVE25519_MB_STATUS_QUEUED;
+  if (mgr->num_queued == 0 && mgr->deadline_ns) mgr->oldest_ns = now_ns();
+  mgr->queued[mgr->num_queued++] = job;
+
+  if (mgr->num_queued == mgr->lanes || deadline_passed(mgr)) run_batch(mgr);
+
+  return curve25519_mb_get_completed(mgr);
+}
+
+struct curve25519_mb_job *
+curve25519_mb_poll(struct curve25519_mb_mgr *mgr) {
+  if (deadline_passed(mgr)) run_batch(mgr);
+  return curve25519_mb_get_completed(mgr);
+}
+
+struct curve25519_mb_job *
+curve25519_mb_flush(struct curve25519_mb_mgr *mgr) {
+  if (mgr->num_completed == 0 && mgr->num_queued > 0) run_batch(mgr);
+  return curve25519_mb_get_completed(mgr);
+}
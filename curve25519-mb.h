@@ -0,0 +1,94 @@
+/* Multi-buffer job manager for curve25519-donna.
+ *
+ * Requests that arrive one at a time are queued until enough of them are
+ * waiting to fill the lanes of a curve25519_donna_batch call. A flush, or a
+ * job that has waited longer than a configurable deadline, runs a partially
+ * filled batch. Results are bit-identical to curve25519_donna.
+ *
+ * Typical use:
+ *
+ *   curve25519_mb_mgr_init(&mgr, 8, 200000);
+ *   for each request:
+ *     done = curve25519_mb_submit(&mgr, &jobs[i]);
+ *     while (done) { handle(done); done = curve25519_mb_get_completed(&mgr); }
+ *   while ((done = curve25519_mb_flush(&mgr)) != NULL) handle(done);
+ *
+ * A manager is not thread-safe; use one per thread. */
+
+#ifndef CURVE25519_MB_H
+#define CURVE25519_MB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CURVE25519_MB_MAX_LANES 16
+
+enum curve25519_mb_status {
+  CURVE25519_MB_STATUS_QUEUED = 1,
+  CURVE25519_MB_STATUS_COMPLETED,
+};
+
+/* A job is owned by the caller and must stay valid, along with the buffers it
+ * points to, until the manager hands it back. */
+struct curve25519_mb_job {
+  const uint8_t *secret;     /* 32 bytes, clamped as by curve25519_donna */
+  const uint8_t *basepoint;  /* 32 bytes, or NULL for the base point 9 */
+  uint8_t *out;              /* 32 bytes */
+  void *user_data;
+  int status;
+};
+
+struct curve25519_mb_mgr {
+  unsigned lanes;
+  uint64_t deadline_ns;
+  uint64_t oldest_ns;  /* submission time of the oldest queued job */
+
+  struct curve25519_mb_job *queued[CURVE25519_MB_MAX_LANES];
+  unsigned num_queued;
+
+  /* Completed jobs waiting to be handed back, oldest first. */
+  struct curve25519_mb_job *completed[2 * CURVE25519_MB_MAX_LANES];
+  unsigned completed_head, num_completed;
+
+  /* Statistics */
+  uint64_t batches, partial_batches, jobs;
+
+  uint8_t secrets[CURVE25519_MB_MAX_LANES * 32];
+  uint8_t points[CURVE25519_MB_MAX_LANES * 32];
+  uint8_t outs[CURVE25519_MB_MAX_LANES * 32];
+};
+
+/* Sets up |mgr| to run batches of |lanes| jobs (at most
+ * CURVE25519_MB_MAX_LANES). If |deadline_ns| is non-zero, a partial batch is
+ * run once its oldest job has been queued for that long, checked on every
+ * submit and poll. */
+void curve25519_mb_mgr_init(struct curve25519_mb_mgr *mgr, unsigned lanes,
+                            uint64_t deadline_ns);
+
+/* Queues |job| and returns the oldest completed job, or NULL if none has
+ * completed yet. Completions come back in submission order. */
+struct curve25519_mb_job *curve25519_mb_submit(struct curve25519_mb_mgr *mgr,
+                                               struct curve25519_mb_job *job);
+
+/* Returns the oldest completed job without running anything, or NULL. */
+struct curve25519_mb_job *
+curve25519_mb_get_completed(struct curve25519_mb_mgr *mgr);
+
+/* Runs a partial batch if the deadline of the oldest queued job has passed,
+ * then returns the oldest completed job, or NULL. Call this from an idle
+ * loop or timer to bound latency when submissions stop. */
+struct curve25519_mb_job *curve25519_mb_poll(struct curve25519_mb_mgr *mgr);
+
+/* Returns the oldest completed job, running whatever is queued first if
+ * nothing has completed. Returns NULL once the manager is empty. */
+struct curve25519_mb_job *curve25519_mb_flush(struct curve25519_mb_mgr *mgr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* CURVE25519_MB_H */
@@ -0,0 +1,710 @@
+/* Noise handshakes on top of curve25519-donna. Public domain.
+ *
+ * Only the two patterns that VPN-style deployments actually use are
+ * supported, with the 25519/ChaChaPoly/SHA256 suite. ChaCha20 and Poly1305
+ * follow RFC 8439; Poly1305 is the 26-bit limb "donna" construction.
+ *
+ * Each handshake message does at most four DH operations. When writing a
+ * message every operand is known up front, so the ephemeral key generation
+ * and all the DHs of that message are run as one curve25519_donna_batch.
+ * When reading, each DH may depend on a static key that's only decrypted
+ * part-way through the message, so consecutive DH tokens are batched
+ * instead. */
+
+#include <string.h>
+
+#include "curve25519-donna.h"
+#include "curve25519-noise.h"
+#include "sha256.h"
+
+typedef uint8_t u8;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+/* ----------------------------------------------------------------------------
+ * Utilities
+ * ------------------------------------------------------------------------- */
+
+static void
+wipe(void *p, size_t len) {
+  volatile u8 *v = (volatile u8 *) p;
+  while (len--) *v++ = 0;
+}
+
+static u32
+load_le32(const u8 *in) {
+  return ((u32)in[0]) | ((u32)in[1] << 8) | ((u32)in[2] << 16) |
+         ((u32)in[3] << 24);
+}
+
+static void
+store_le32(u8 *out, u32 in) {
+  out[0] = in;
+  out[1] = in >> 8;
+  out[2] = in >> 16;
+  out[3] = in >> 24;
+}
+
+static void
+store_le64(u8 *out, u64 in) {
+  store_le32(out, (u32)in);
+  store_le32(out + 4, (u32)(in >> 32));
+}
+
+/* ----------------------------------------------------------------------------
+ * ChaCha20
+ * ------------------------------------------------------------------------- */
+
+#define ROTL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define QUARTERROUND(a, b, c, d) \
+  a += b; d ^= a; d = ROTL32(d, 16); \
+  c += d; b ^= c; b = ROTL32(b, 12); \
+  a += b; d ^= a; d = ROTL32(d, 8); \
+  c += d; b ^= c; b = ROTL32(b, 7);
+
+static void
+chacha20_block(u8 out[64], const u8 key[32], u32 counter, const u8 nonce[12]) {
+  u32 in[16], x[16];
+  unsigned i;
+
+  in[0] = 0x61707865;
+  in[1] = 0x3320646e;
+  in[2] = 0x79622d32;
+  in[3] = 0x6b206574;
+  for (i = 0; i < 8; ++i) in[4 + i] = load_le32(key + 4 * i);
+  in[12] = counter;
+  in[13] = load_le32(nonce);
+  in[14] = load_le32(nonce + 4);
+  in[15] = load_le32(nonce + 8);
+
+  memcpy(x, in, sizeof(x));
+  for (i = 0; i < 10; ++i) {
+    QUARTERROUND(x[0], x[4], x[8], x[12])
+    QUARTERROUND(x[1], x[5], x[9], x[13])
+    QUARTERROUND(x[2], x[6], x[10], x[14])
+    QUARTERROUND(x[3], x[7], x[11], x[15])
+    QUARTERROUND(x[0], x[5], x[10], x[15])
+    QUARTERROUND(x[1], x[6], x[11], x[12])
+    QUARTERROUND(x[2], x[7], x[8], x[13])
+    QUARTERROUND(x[3], x[4], x[9], x[14])
+  }
+  for (i = 0; i < 16; ++i) store_le32(out + 4 * i, x[i] + in[i]);
+}
+
+/* out = in XOR keystream, starting at block |counter|. */
+static void
+chacha20_xor(u8 *out, const u8 *in, size_t len, const u8 key[32],
+             u32 counter, const u8 nonce[12]) {
+  u8 block[64];
+  size_t i, todo;
+
+  while (len > 0) {
+    chacha20_block(block, key, counter++, nonce);
+    todo = len < 64 ? len : 64;
+    for (i = 0; i < todo; ++i) out[i] = in[i] ^ block[i];
+    out += todo;
+    in += todo;
+    len -= todo;
+  }
+  wipe(block, sizeof(block));
+}
+
+/* ----------------------------------------------------------------------------
+ * Poly1305
+ * ------------------------------------------------------------------------- */
+
+struct poly1305 {
+  u32 r[5], h[5], pad[4];
+};
+
+static void
+poly1305_init(struct poly1305 *st, const u8 key[32]) {
+  st->r[0] = (load_le32(key + 0)) & 0x3ffffff;
+  st->r[1] = (load_le32(key + 3) >> 2) & 0x3ffff03;
+  st->r[2] = (load_le32(key + 6) >> 4) & 0x3ffc0ff;
+  st->r[3] = (load_le32(key + 9) >> 6) & 0x3f03fff;
+  st->r[4] = (load_le32(key + 12) >> 8) & 0x00fffff;
+  memset(st->h, 0, sizeof(st->h));
+  st->pad[0] = load_le32(key + 16);
+  st->pad[1] = load_le32(key + 20);
+  st->pad[2] = load_le32(key + 24);
+  st->pad[3] = load_le32(key + 28);
+}
+
+/* Absorbs |len| bytes, zero-padding the last block to 16 bytes as the AEAD
+ * construction requires. */
+static void
+poly1305_update_padded(struct poly1305 *st, const u8 *m, size_t len) {
+  const u32 r0 = st->r[0], r1 = st->r[1], r2 = st->r[2], r3 = st->r[3],
+            r4 = st->r[4];
+  const u32 s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+  u32 h0 = st->h[0], h1 = st->h[1], h2 = st->h[2], h3 = st->h[3],
+      h4 = st->h[4];
+  u8 block[16];
+
+  while (len > 0) {
+    u64 d0, d1, d2, d3, d4;
+    u32 c;
+
+    if (len < 16) {
+      memset(block, 0, sizeof(block));
+      memcpy(block, m, len);
+      m = block;
+      len = 16;
+    }
+
+    h0 += (load_le32(m + 0)) & 0x3ffffff;
+    h1 += (load_le32(m + 3) >> 2) & 0x3ffffff;
+    h2 += (load_le32(m + 6) >> 4) & 0x3ffffff;
+    h3 += (load_le32(m + 9) >> 6) & 0x3ffffff;
+    h4 += (load_le32(m + 12) >> 8) | (1 << 24);
+
+    d0 = ((u64)h0 * r0) + ((u64)h1 * s4) + ((u64)h2 * s3) +
+         ((u64)h3 * s2) + ((u64)h4 * s1);
+    d1 = ((u64)h0 * r1) + ((u64)h1 * r0) + ((u64)h2 * s4) +
+         ((u64)h3 * s3) + ((u64)h4 * s2);
+    d2 = ((u64)h0 * r2) + ((u64)h1 * r1) + ((u64)h2 * r0) +
+         ((u64)h3 * s4) + ((u64)h4 * s3);
+    d3 = ((u64)h0 * r3) + ((u64)h1 * r2) + ((u64)h2 * r1) +
+         ((u64)h3 * r0) + ((u64)h4 * s4);
+    d4 = ((u64)h0 * r4) + ((u64)h1 * r3) + ((u64)h2 * r2) +
+         ((u64)h3 * r1) + ((u64)h4 * r0);
+
+                  c = (u32)(d0 >> 26); h0 = (u32)d0 & 0x3ffffff;
+    d1 += c;      c = (u32)(d1 >> 26); h1 = (u32)d1 & 0x3ffffff;
+    d2 += c;      c = (u32)(d2 >> 26); h2 = (u32)d2 & 0x3ffffff;
+    d3 += c;      c = (u32)(d3 >> 26); h3 = (u32)d3 & 0x3ffffff;
+    d4 += c;      c = (u32)(d4 >> 26); h4 = (u32)d4 & 0x3ffffff;
+    h0 += c * 5;  c = h0 >> 26;        h0 &= 0x3ffffff;
+    h1 += c;
+
+    m += 16;
+    len -= 16;
+  }
+
+  st->h[0] = h0; st->h[1] = h1; st->h[2] = h2; st->h[3] = h3; st->h[4] = h4;
+}
+
+static void
+poly1305_finish(struct poly1305 *st, u8 mac[16]) {
+  u32 h0 = st->h[0], h1 = st->h[1], h2 = st->h[2], h3 = st->h[3],
+      h4 = st->h[4];
+  u32 g0, g1, g2, g3, g4, c, mask;
+  u64 f;
+
+  /* fully carry h */
+               c = h1 >> 26; h1 &= 0x3ffffff;
+  h2 += c;     c = h2 >> 26; h2 &= 0x3ffffff;
+  h3 += c;     c = h3 >> 26; h3 &= 0x3ffffff;
+  h4 += c;     c = h4 >> 26; h4 &= 0x3ffffff;
+  h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+  h1 += c;
+
+  /* compute h - p and select it if it's non-negative */
+  g0 = h0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+  g1 = h1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+  g2 = h2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+  g3 = h3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+  g4 = h4 + c - (1 << 26);
+
+  mask = (g4 >> 31) - 1;
+  g0 &= mask; g1 &= mask; g2 &= mask; g3 &= mask; g4 &= mask;
+  mask = ~mask;
+  h0 = (h0 & mask) | g0;
+  h1 = (h1 & mask) | g1;
+  h2 = (h2 & mask) | g2;
+  h3 = (h3 & mask) | g3;
+  h4 = (h4 & mask) | g4;
+
+  /* h = (h + pad) % 2^128 */
+  h0 = (h0) | (h1 << 26);
+  h1 = (h1 >> 6) | (h2 << 20);
+  h2 = (h2 >> 12) | (h3 << 14);
+  h3 = (h3 >> 18) | (h4 << 8);
+
+  f = (u64)h0 + st->pad[0];             store_le32(mac + 0, (u32)f);
+  f = (u64)h1 + st->pad[1] + (f >> 32); store_le32(mac + 4, (u32)f);
+  f = (u64)h2 + st->pad[2] + (f >> 32); store_le32(mac + 8, (u32)f);
+  f = (u64)h3 + st->pad[3] + (f >> 32); store_le32(mac + 12, (u32)f);
+
+  wipe(st, sizeof(*st));
+}
+
+/* ----------------------------------------------------------------------------
+ * ChaCha20-Poly1305 (RFC 8439) with Noise's nonce encoding
+ * ------------------------------------------------------------------------- */
+
+static void
+aead_tag(u8 tag[16], const u8 key[32], const u8 nonce[12], const u8 *ad,
+         size_t ad_len, const u8 *ciphertext, size_t len) {
+  struct poly1305 st;
+  u8 block[64];
+
+  chacha20_block(block, key, 0, nonce);
+  poly1305_init(&st, block);
+  poly1305_update_padded(&st, ad, ad_len);
+  poly1305_update_padded(&st, ciphertext, len);
+  store_le64(block, ad_len);
+  store_le64(block + 8, len);
+  poly1305_update_padded(&st, block, 16);
+  poly1305_finish(&st, tag);
+  wipe(block, sizeof(block));
+}
+
+static void
+noise_nonce(u8 nonce[12], u64 n) {
+  memset(nonce, 0, 4);
+  store_le64(nonce + 4, n);
+}
+
+int
+noise_encrypt(struct noise_cipherstate *cs, const u8 *ad, size_t ad_len,
+              const u8 *in, size_t len, u8 *out) {
+  u8 nonce[12];
+
+  if (!cs->has_key || cs->n == UINT64_MAX) return NOISE_ERR_STATE;
+  if (len > NOISE_MAX_MESSAGE - NOISE_TAG_SIZE) return NOISE_ERR_LENGTH;
+
+  noise_nonce(nonce, cs->n++);
+  chacha20_xor(out, in, len, cs->k, 1, nonce);
+  aead_tag(out + len, cs->k, nonce, ad, ad_len, out, len);
+  return NOISE_OK;
+}
+
+int
+noise_decrypt(struct noise_cipherstate *cs, const u8 *ad, size_t ad_len,
+              const u8 *in, size_t len, u8 *out) {
+  u8 nonce[12], tag[16];
+  unsigned i, diff = 0;
+
+  if (!cs->has_key || cs->n == UINT64_MAX) return NOISE_ERR_STATE;
+  if (len < NOISE_TAG_SIZE || len > NOISE_MAX_MESSAGE) return NOISE_ERR_LENGTH;
+  len -= NOISE_TAG_SIZE;
+
+  noise_nonce(nonce, cs->n);
+  aead_tag(tag, cs->k, nonce, ad, ad_len, in, len);
+  for (i = 0; i < NOISE_TAG_SIZE; ++i) diff |= tag[i] ^ in[len + i];
+  if (diff) return NOISE_ERR_DECRYPT;
+
+  chacha20_xor(out, in, len, cs->k, 1, nonce);
+  cs->n++;
+  return NOISE_OK;
+}
+
+/* ----------------------------------------------------------------------------
+ * SymmetricState
+ * ------------------------------------------------------------------------- */
+
+static void
+hmac_sha256(u8 out[32], const u8 key[32], const u8 *in, size_t len) {
+  struct sha256_ctx ctx;
+  u8 pad[SHA256_BLOCK_SIZE];
+  unsigned i;
+
+  memset(pad, 0x36, sizeof(pad));
+  for (i = 0; i < 32; ++i) pad[i] ^= key[i];
+  sha256_init(&ctx);
+  sha256_update(&ctx, pad, sizeof(pad));
+  sha256_update(&ctx, in, len);
+  sha256_final(&ctx, out);
+
+  memset(pad, 0x5c, sizeof(pad));
+  for (i = 0; i < 32; ++i) pad[i] ^= key[i];
+  sha256_init(&ctx);
+  sha256_update(&ctx, pad, sizeof(pad));
+  sha256_update(&ctx, out, 32);
+  sha256_final(&ctx, out);
+  wipe(pad, sizeof(pad));
+}
+
+/* Noise's two-output HKDF: out1 || out2 = HKDF(ck, ikm). */
+static void
+hkdf2(u8 out1[32], u8 out2[32], const u8 ck[32], const u8 *ikm,
+      size_t ikm_len) {
+  u8 temp[32], buf[33];
+
+  hmac_sha256(temp, ck, ikm, ikm_len);
+  buf[0] = 1;
+  hmac_sha256(out1, temp, buf, 1);
+  memcpy(buf, out1, 32);
+  buf[32] = 2;
+  hmac_sha256(out2, temp, buf, 33);
+  wipe(temp, sizeof(temp));
+  wipe(buf, sizeof(buf));
+}
+
+static void
+mix_hash(struct noise_handshake *hs, const u8 *data, size_t len) {
+  struct sha256_ctx ctx;
+
+  sha256_init(&ctx);
+  sha256_update(&ctx, hs->h, 32);
+  sha256_update(&ctx, data, len);
+  sha256_final(&ctx, hs->h);
+}
+
+static void
+mix_key(struct noise_handshake *hs, const u8 ikm[32]) {
+  hkdf2(hs->ck, hs->cs.k, hs->ck, ikm, 32);
+  hs->cs.n = 0;
+  hs->cs.has_key = 1;
+}
+
+static int
+encrypt_and_hash(struct noise_handshake *hs, const u8 *in, size_t len,
+                 u8 *out) {
+  int ret;
+
+  if (hs->cs.has_key) {
+    if ((ret = noise_encrypt(&hs->cs, hs->h, 32, in, len, out)) != NOISE_OK)
+      return ret;
+    len += NOISE_TAG_SIZE;
+  } else if (len > 0) {
+    memmove(out, in, len);
+  }
+  mix_hash(hs, out, len);
+  return NOISE_OK;
+}
+
+static int
+decrypt_and_hash(struct noise_handshake *hs, const u8 *in, size_t len,
+                 u8 *out) {
+  int ret;
+
+  if (hs->cs.has_key) {
+    if ((ret = noise_decrypt(&hs->cs, hs->h, 32, in, len, out)) != NOISE_OK)
+      return ret;
+  } else if (len > 0) {
+    memmove(out, in, len);
+  }
+  mix_hash(hs, in, len);
+  return NOISE_OK;
+}
+
+/* ----------------------------------------------------------------------------
+ * Handshake patterns
+ * ------------------------------------------------------------------------- */
+
+enum token { TOK_END, TOK_E, TOK_S, TOK_EE, TOK_ES, TOK_SE, TOK_SS };
+
+#define MAX_MESSAGES 3
+#define MAX_TOKENS 5  /* including TOK_END */
+#define MAX_DH (MAX_TOKENS - 1)
+
+struct pattern {
+  const char *name;
+  int num_messages;
+  int responder_static_premessage;
+  u8 messages[MAX_MESSAGES][MAX_TOKENS];
+};
+
+static const struct pattern patterns[] = {
+  /* NOISE_PATTERN_XX */
+  { "Noise_XX_25519_ChaChaPoly_SHA256", 3, 0,
+    { { TOK_E },
+      { TOK_E, TOK_EE, TOK_S, TOK_ES },
+      { TOK_S, TOK_SE } } },
+  /* NOISE_PATTERN_IK */
+  { "Noise_IK_25519_ChaChaPoly_SHA256", 2, 1,
+    { { TOK_E, TOK_ES, TOK_S, TOK_SS },
+      { TOK_E, TOK_EE, TOK_SE } } },
+};
+
+enum {
+  HAS_RS = 1,
+  HAS_RE = 2,
+  FAILED = 4,
+};
+
+static int
+is_dh(u8 tok) {
+  return tok >= TOK_EE;
+}
+
+/* Picks the private key and remote public key for a DH token. Returns 0 if the
+ * remote key hasn't been received yet. */
+static int
+dh_operands(const struct noise_handshake *hs, u8 tok, const u8 **priv,
+            const u8 **pub) {
+  int local_e, remote_e;
+
+  switch (tok) {
+    case TOK_EE: local_e = 1; remote_e = 1; break;
+    case TOK_ES: local_e = hs->initiator; remote_e = !hs->initiator; break;
+    case TOK_SE: local_e = !hs->initiator; remote_e = hs->initiator; break;
+    default:     local_e = 0; remote_e = 0; break;
+  }
+
+  *priv = local_e ? hs->e.private_key : hs->s.private_key;
+  *pub = remote_e ? hs->re : hs->rs;
+  return hs->flags & (remote_e ? HAS_RE : HAS_RS);
+}
+
+/* Runs |n| queued DH operations, batching them when there is more than
+ * one. */
+static void
+run_dh(u8 *out, const u8 *secrets, const u8 *points, size_t n) {
+  if (n == 1) {
+    curve25519_donna(out, secrets, points);
+  } else if (n > 1) {
+    curve25519_donna_batch(out, secrets, points, n);
+  }
+}
+
+/* The number of bytes a message with |payload_len| bytes of payload takes,
+ * given whether a key is established at its start. */
+static size_t
+message_length(const u8 *tokens, int has_key, size_t payload_len) {
+  size_t len = 0;
+
+  for (; *tokens != TOK_END; ++tokens) {
+    if (*tokens == TOK_E) {
+      len += 32;
+    } else if (*tokens == TOK_S) {
+      len += 32 + (has_key ? NOISE_TAG_SIZE : 0);
+    } else {
+      has_key = 1;
+    }
+  }
+  return len + payload_len + (has_key ? NOISE_TAG_SIZE : 0);
+}
+
+void
+noise_keypair_init(struct noise_keypair *kp, const u8 private_key[32]) {
+  static const u8 basepoint[32] = {9};
+
+  memcpy(kp->private_key, private_key, 32);
+  curve25519_donna(kp->public_key, kp->private_key, basepoint);
+}
+
+int
+noise_handshake_init(struct noise_handshake *hs, enum noise_pattern pattern,
+                     int initiator, const u8 *prologue, size_t prologue_len,
+                     const struct noise_keypair *s, const u8 ephemeral[32],
+                     const u8 *rs) {
+  const struct pattern *p;
+  size_t name_len;
+
+  if ((unsigned) pattern >= sizeof(patterns) / sizeof(patterns[0]) ||
+      s == NULL || ephemeral == NULL) {
+    return NOISE_ERR_ARGUMENT;
+  }
+  p = &patterns[pattern];
+  if (p->responder_static_premessage && initiator && rs == NULL) {
+    return NOISE_ERR_ARGUMENT;
+  }
+
+  memset(hs, 0, sizeof(*hs));
+  hs->pattern = pattern;
+  hs->initiator = initiator ? 1 : 0;
+  hs->s = *s;
+  memcpy(hs->e.private_key, ephemeral, 32);
+
+  name_len = strlen(p->name);
+  if (name_len <= 32) {
+    memcpy(hs->h, p->name, name_len);
+  } else {
+    sha256(hs->h, (const u8 *) p->name, name_len);
+  }
+  memcpy(hs->ck, hs->h, 32);
+  mix_hash(hs, prologue, prologue_len);
+
+  if (p->responder_static_premessage) {
+    if (initiator) {
+      memcpy(hs->rs, rs, 32);
+      hs->flags |= HAS_RS;
+      mix_hash(hs, hs->rs, 32);
+    } else {
+      mix_hash(hs, hs->s.public_key, 32);
+    }
+  }
+
+  return NOISE_OK;
+}
+
+int
+noise_handshake_is_complete(const struct noise_handshake *hs) {
+  return !(hs->flags & FAILED) &&
+         hs->message == patterns[hs->pattern].num_messages;
+}
+
+static int
+check_turn(const struct noise_handshake *hs, int writing) {
+  if ((hs->flags & FAILED) ||
+      hs->message >= patterns[hs->pattern].num_messages) {
+    return NOISE_ERR_STATE;
+  }
+  /* The initiator writes the even-numbered messages. */
+  if (((hs->message & 1) == 0) != (hs->initiator == writing)) {
+    return NOISE_ERR_STATE;
+  }
+  return NOISE_OK;
+}
+
+int
+noise_handshake_write_message(struct noise_handshake *hs, const u8 *payload,
+                              size_t payload_len, u8 *msg, size_t msg_cap,
+                              size_t *msg_len) {
+  static const u8 basepoint[32] = {9};
+  u8 secrets[MAX_TOKENS * 32], points[MAX_TOKENS * 32], results[MAX_TOKENS * 32];
+  const u8 *tokens, *priv, *pub;
+  size_t len, pos = 0, n = 0, next = 0;
+  int ret;
+
+  if ((ret = check_turn(hs, 1)) != NOISE_OK) return ret;
+  tokens = patterns[hs->pattern].messages[hs->message];
+
+  len = message_length(tokens, hs->cs.has_key, payload_len);
+  if (len > NOISE_MAX_MESSAGE) return NOISE_ERR_LENGTH;
+  if (len > msg_cap) return NOISE_ERR_SPACE;
+
+  /* Queue the ephemeral key generation and every DH of this message. The
+   * DHs only need the ephemeral private key, so they can all run at once. */
+  for (; *tokens != TOK_END; ++tokens) {
+    if (*tokens == TOK_E) {
+      memcpy(secrets + 32 * n, hs->e.private_key, 32);
+      memcpy(points + 32 * n, basepoint, 32);
+      n++;
+    } else if (is_dh(*tokens)) {
+      if (!dh_operands(hs, *tokens, &priv, &pub)) {
+        ret = NOISE_ERR_STATE;
+        goto out;
+      }
+      memcpy(secrets + 32 * n, priv, 32);
+      memcpy(points + 32 * n, pub, 32);
+      n++;
+    }
+  }
+  run_dh(results, secrets, points, n);
+
+  for (tokens = patterns[hs->pattern].messages[hs->message];
+       *tokens != TOK_END; ++tokens) {
+    switch (*tokens) {
+      case TOK_E:
+        memcpy(hs->e.public_key, results + 32 * next++, 32);
+        memcpy(msg + pos, hs->e.public_key, 32);
+        mix_hash(hs, msg + pos, 32);
+        pos += 32;
+        break;
+      case TOK_S:
+        encrypt_and_hash(hs, hs->s.public_key, 32, msg + pos);
+        pos += 32 + (hs->cs.has_key ? NOISE_TAG_SIZE : 0);
+        break;
+      default:
+        mix_key(hs, results + 32 * next++);
+        break;
+    }
+  }
+
+  if ((ret = encrypt_and_hash(hs, payload, payload_len, msg + pos)) != NOISE_OK) {
+    goto fail;
+  }
+
+  *msg_len = len;
+  hs->message++;
+  ret = NOISE_OK;
+  goto out;
+
+fail:
+  hs->flags |= FAILED;
+out:
+  wipe(secrets, sizeof(secrets));
+  wipe(results, sizeof(results));
+  return ret;
+}
+
+int
+noise_handshake_read_message(struct noise_handshake *hs, const u8 *msg,
+                             size_t msg_len, u8 *payload, size_t payload_cap,
+                             size_t *payload_len) {
+  u8 secrets[MAX_DH * 32], points[MAX_DH * 32], results[MAX_DH * 32];
+  const u8 *tokens, *priv, *pub;
+  size_t min_len, pos = 0, n, i;
+  int ret;
+
+  if ((ret = check_turn(hs, 0)) != NOISE_OK) return ret;
+  tokens = patterns[hs->pattern].messages[hs->message];
+
+  min_len = message_length(tokens, hs->cs.has_key, 0);
+  if (msg_len < min_len || msg_len > NOISE_MAX_MESSAGE) return NOISE_ERR_LENGTH;
+  if (msg_len - min_len > payload_cap) return NOISE_ERR_SPACE;
+
+  while (*tokens != TOK_END) {
+    if (*tokens == TOK_E) {
+      memcpy(hs->re, msg + pos, 32);
+      hs->flags |= HAS_RE;
+      mix_hash(hs, hs->re, 32);
+      pos += 32;
+      tokens++;
+    } else if (*tokens == TOK_S) {
+      const size_t len = 32 + (hs->cs.has_key ? NOISE_TAG_SIZE : 0);
+      if ((ret = decrypt_and_hash(hs, msg + pos, len, hs->rs)) != NOISE_OK) {
+        goto fail;
+      }
+      hs->flags |= HAS_RS;
+      pos += len;
+      tokens++;
+    } else {
+      /* Batch this run of DH tokens. */
+      for (n = 0; is_dh(tokens[n]); ++n) {
+        if (!dh_operands(hs, tokens[n], &priv, &pub)) {
+          ret = NOISE_ERR_STATE;
+          goto fail;
+        }
+        memcpy(secrets + 32 * n, priv, 32);
+        memcpy(points + 32 * n, pub, 32);
+      }
+      run_dh(results, secrets, points, n);
+      for (i = 0; i < n; ++i) mix_key(hs, results + 32 * i);
+      tokens += n;
+    }
+  }
+
+  if ((ret = decrypt_and_hash(hs, msg + pos, msg_len - pos, payload)) != NOISE_OK) {
+    goto fail;
+  }
+
+  *payload_len = msg_len - pos - (hs->cs.has_key ? NOISE_TAG_SIZE : 0);
+  hs->message++;
+  ret = NOISE_OK;
+  goto out;
+
+fail:
+  hs->flags |= FAILED;
+out:
+  wipe(secrets, sizeof(secrets));
+  wipe(results, sizeof(results));
+  return ret;
+}
+
+int
+noise_handshake_split(struct noise_handshake *hs,
+                      struct noise_cipherstate *send,
+                      struct noise_cipherstate *recv) {
+  struct noise_cipherstate c1, c2;
+  u8 rs[32], h[32];
+
+  if (!noise_handshake_is_complete(hs)) return NOISE_ERR_STATE;
+
+  memset(&c1, 0, sizeof(c1));
+  memset(&c2, 0, sizeof(c2));
+  hkdf2(c1.k, c2.k, hs->ck, NULL, 0);
+  c1.has_key = c2.has_key = 1;
+
+  if (hs->initiator) {
+    *send = c1;
+    *recv = c2;
+  } else {
+    *send = c2;
+    *recv = c1;
+  }
+  wipe(&c1, sizeof(c1));
+  wipe(&c2, sizeof(c2));
+
+  memcpy(rs, hs->rs, 32);
+  memcpy(h, hs->h, 32);
+  wipe(hs, sizeof(*hs));
+  memcpy(hs->rs, rs, 32);
+  memcpy(hs->h, h, 32);
+  return NOISE_OK;
+}
@@ -0,0 +1,110 @@
+/* Noise handshakes (Noise_XX_25519_ChaChaPoly_SHA256 and
+ * Noise_IK_25519_ChaChaPoly_SHA256) on top of curve25519-donna.
+ *
+ * See http://noiseprotocol.org/noise.html for the protocol itself. All state
+ * lives in the fixed-size structures below, which the caller owns: nothing
+ * here allocates memory or draws randomness. Link with sha256.c and one of
+ * the curve25519-donna implementations. */
+
+#ifndef CURVE25519_NOISE_H
+#define CURVE25519_NOISE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum noise_pattern {
+  NOISE_PATTERN_XX,
+  NOISE_PATTERN_IK,
+};
+
+enum noise_error {
+  NOISE_OK = 0,
+  NOISE_ERR_STATE = -1,     /* wrong turn, handshake finished or failed */
+  NOISE_ERR_LENGTH = -2,    /* message too short or too long */
+  NOISE_ERR_SPACE = -3,     /* output buffer too small */
+  NOISE_ERR_DECRYPT = -4,   /* authentication failed */
+  NOISE_ERR_ARGUMENT = -5,  /* missing key for this pattern and role */
+};
+
+/* The largest message Noise allows, including any authentication tag. */
+#define NOISE_MAX_MESSAGE 65535
+#define NOISE_TAG_SIZE 16
+
+struct noise_keypair {
+  uint8_t private_key[32];
+  uint8_t public_key[32];
+};
+
+struct noise_cipherstate {
+  uint8_t k[32];
+  uint64_t n;
+  int has_key;
+};
+
+struct noise_handshake {
+  struct noise_cipherstate cs;
+  uint8_t ck[32];
+  uint8_t h[32];
+  struct noise_keypair s;
+  struct noise_keypair e;
+  uint8_t rs[32];
+  uint8_t re[32];
+  int pattern;
+  int initiator;
+  int message;  /* index of the next message in the pattern */
+  int flags;
+};
+
+/* Derives |kp->public_key| from |private_key|. Long-lived static keys should
+ * be set up once with this and reused for every handshake. */
+void noise_keypair_init(struct noise_keypair *kp, const uint8_t private_key[32]);
+
+/* Starts a handshake. |s| is our static keypair. |ephemeral| must be 32 fresh
+ * random bytes; it becomes the ephemeral private key. |rs| is the
+ * responder's static public key, which an IK initiator must know in advance;
+ * pass NULL otherwise. |prologue| may be NULL if |prologue_len| is zero. */
+int noise_handshake_init(struct noise_handshake *hs, enum noise_pattern pattern,
+                         int initiator, const uint8_t *prologue,
+                         size_t prologue_len, const struct noise_keypair *s,
+                         const uint8_t ephemeral[32], const uint8_t *rs);
+
+/* Writes the next handshake message, carrying |payload|, into |msg|. All DH
+ * operations the message needs are run as one curve25519_donna_batch. */
+int noise_handshake_write_message(struct noise_handshake *hs,
+                                  const uint8_t *payload, size_t payload_len,
+                                  uint8_t *msg, size_t msg_cap,
+                                  size_t *msg_len);
+
+/* Consumes the next handshake message from the peer and writes its payload to
+ * |payload|. Any failure leaves the handshake unusable. */
+int noise_handshake_read_message(struct noise_handshake *hs,
+                                 const uint8_t *msg, size_t msg_len,
+                                 uint8_t *payload, size_t payload_cap,
+                                 size_t *payload_len);
+
+/* Returns 1 once every message of the pattern has been sent or received. */
+int noise_handshake_is_complete(const struct noise_handshake *hs);
+
+/* Derives the transport keys from a complete handshake and wipes |hs|, except
+ * for |hs->rs| and |hs->h| (the handshake hash, for channel binding). */
+int noise_handshake_split(struct noise_handshake *hs,
+                          struct noise_cipherstate *send,
+                          struct noise_cipherstate *recv);
+
+/* Transport encryption. |out| receives |len| + NOISE_TAG_SIZE bytes for
+ * noise_encrypt and |len| - NOISE_TAG_SIZE bytes for noise_decrypt, and may
+ * alias |in|. */
+int noise_encrypt(struct noise_cipherstate *cs, const uint8_t *ad,
+                  size_t ad_len, const uint8_t *in, size_t len, uint8_t *out);
+int noise_decrypt(struct noise_cipherstate *cs, const uint8_t *ad,
+                  size_t ad_len, const uint8_t *in, size_t len, uint8_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* CURVE25519_NOISE_H */
@@ -0,0 +1,220 @@
+/* Client side of the curve25519 shared-memory offload service. Public
+ * domain. */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "curve25519-shm.h"
+
+#define REGION_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+
+struct curve25519_shm_client {
+  int sock, doorbell, notify;
+  struct curve25519_shm_region *region;
+  uint32_t sq_tail, cq_head;
+  unsigned num_free;
+  uint32_t free_slots[CURVE25519_SHM_ENTRIES];
+};
+
+/* Receives the region and both eventfds sent by the daemon on accepting. */
+static int
+receive_fds(int sock, int fds[3]) {
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  union {
+    char buf[CMSG_SPACE(3 * sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  char hello;
+  ssize_t n;
+
+  memset(&msg, 0, sizeof(msg));
+  iov.iov_base = &hello;
+  iov.iov_len = 1;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  do {
+    n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+  } while (n < 0 && errno == EINTR);
+  if (n != 1) return -1;
+
+  cmsg = CMSG_FIRSTHDR(&msg);
+  if (!cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int))) {
+    return -1;
+  }
+  memcpy(fds, CMSG_DATA(cmsg), 3 * sizeof(int));
+  return 0;
+}
+
+struct curve25519_shm_client *
+curve25519_shm_connect(const char *path) {
+  struct curve25519_shm_client *client;
+  struct sockaddr_un addr;
+  int fds[3] = {-1, -1, -1};
+  unsigned i;
+  int seals;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) return NULL;
+  client = calloc(1, sizeof(*client));
+  if (!client) return NULL;
+  client->doorbell = client->notify = -1;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  client->sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (client->sock < 0 ||
+      connect(client->sock, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+      receive_fds(client->sock, fds) != 0) {
+    goto fail;
+  }
+  client->doorbell = fds[1];
+  client->notify = fds[2];
+
+  /* An unsealed region could be shrunk under us by anyone holding it, and
+   * one whose seals can't be read (not a memfd) can't be trusted either. */
+  seals = fcntl(fds[0], F_GET_SEALS);
+  if (seals < 0 || (seals & REGION_SEALS) != REGION_SEALS) {
+    close(fds[0]);
+    goto fail;
+  }
+
+  client->region = mmap(NULL, sizeof(*client->region),
+                        PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+  close(fds[0]);
+  if (client->region == MAP_FAILED) {
+    client->region = NULL;
+    goto fail;
+  }
+  if (client->region->magic != CURVE25519_SHM_MAGIC ||
+      client->region->version != CURVE25519_SHM_VERSION ||
+      client->region->entries != CURVE25519_SHM_ENTRIES) {
+    goto fail;
+  }
+
+  for (i = 0; i < CURVE25519_SHM_ENTRIES; ++i) client->free_slots[i] = i;
+  client->num_free = CURVE25519_SHM_ENTRIES;
+  return client;
+
+fail:
+  curve25519_shm_disconnect(client);
+  return NULL;
+}
+
+void
+curve25519_shm_disconnect(struct curve25519_shm_client *client) {
+  if (!client) return;
+  if (client->region) munmap(client->region, sizeof(*client->region));
+  if (client->doorbell >= 0) close(client->doorbell);
+  if (client->notify >= 0) close(client->notify);
+  if (client->sock >= 0) close(client->sock);
+  free(client);
+}
+
+int
+curve25519_shm_fd(const struct curve25519_shm_client *client) {
+  return client->notify;
+}
+
+int
+curve25519_shm_submit(struct curve25519_shm_client *client, int op,
+                      const uint8_t *secret, const uint8_t *point,
+                      uint64_t user_data) {
+  static const uint8_t basepoint[32] = {9};
+  struct curve25519_shm_ring *sq = &client->region->sq;
+  struct curve25519_shm_slot *slot;
+  const uint64_t one = 1;
+  uint32_t index;
+
+  if (client->num_free == 0) return -1;
+  index = client->free_slots[--client->num_free];
+  slot = &client->region->slots[index];
+
+  slot->op = op;
+  slot->user_data = user_data;
+  slot->result = 0;
+  if (op == CURVE25519_SHM_OP_DH) {
+    memcpy(slot->secret, secret, 32);
+    memcpy(slot->point, point ? point : basepoint, 32);
+  }
+
+  sq->index[client->sq_tail & (CURVE25519_SHM_ENTRIES - 1)] = index;
+  client->sq_tail++;
+  __atomic_store_n(&sq->tail, client->sq_tail, __ATOMIC_RELEASE);
+
+  if (write(client->doorbell, &one, sizeof(one)) < 0) {
+    /* Only fails if the counter would overflow: the daemon will see it. */
+  }
+  return 0;
+}
+
+unsigned
+curve25519_shm_reap(struct curve25519_shm_client *client,
+                    struct curve25519_shm_completion *out, unsigned max) {
+  struct curve25519_shm_ring *cq = &client->region->cq;
+  const uint32_t tail = __atomic_load_n(&cq->tail, __ATOMIC_ACQUIRE);
+  unsigned n = 0;
+
+  while (n < max && client->cq_head != tail) {
+    const uint32_t index =
+        cq->index[client->cq_head & (CURVE25519_SHM_ENTRIES - 1)] &
+        (CURVE25519_SHM_ENTRIES - 1);
+    struct curve25519_shm_slot *slot = &client->region->slots[index];
+
+    out[n].user_data = slot->user_data;
+    out[n].result = slot->result;
+    memcpy(out[n].out, slot->out, 32);
+    if (slot->op == CURVE25519_SHM_OP_KEYGEN) {
+      memcpy(out[n].secret, slot->secret, 32);
+    } else {
+      memset(out[n].secret, 0, 32);
+    }
+    memset(slot->secret, 0, 32);
+    memset(slot->out, 0, 32);
+
+    client->free_slots[client->num_free++] = index;
+    client->cq_head++;
+    n++;
+  }
+  __atomic_store_n(&cq->head, client->cq_head, __ATOMIC_RELEASE);
+  return n;
+}
+
+int
+curve25519_shm_wait(struct curve25519_shm_client *client, int timeout_ms) {
+  struct pollfd pfd[2];
+  uint64_t counter;
+  int n;
+
+  pfd[0].fd = client->notify;
+  pfd[0].events = POLLIN;
+  pfd[1].fd = client->sock;
+  pfd[1].events = POLLIN;
+
+  do {
+    n = poll(pfd, 2, timeout_ms);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0 || (pfd[1].revents & (POLLIN | POLLHUP | POLLERR))) return -1;
+  if (n == 0) return 0;
+
+  if (read(client->notify, &counter, sizeof(counter)) < 0) {
+    /* Already reset by an earlier wait. */
+  }
+  return 1;
+}
@@ -0,0 +1,441 @@
+/* Daemon side of the curve25519 shared-memory offload service. Public domain.
+ *
+ * One thread runs an epoll loop over the listening socket, every client's
+ * socket and doorbell, and the completion eventfd of a curve25519-async
+ * worker pool. Jobs move from client submission rings into the pool, which
+ * batches them regardless of which client they came from, and results go
+ * back to the owning client's completion ring. The pool reads and writes
+ * the slots in place, inside the shared mapping.
+ *
+ * A client's mapping outlives its socket until every job of its that the
+ * pool holds has completed. */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "curve25519-async.h"
+#include "curve25519-shm.h"
+
+#define REGION_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+#define MAX_CLIENTS 1024
+#define POOL_ENTRIES 4096
+
+/* epoll tags: the low bits say what kind of descriptor, the rest which
+ * client. */
+enum {
+  TAG_LISTEN,
+  TAG_STOP,
+  TAG_POOL,
+  TAG_SOCKET,
+  TAG_DOORBELL,
+};
+#define TAG_BITS 3
+
+struct client {
+  int in_use;
+  int connected;
+  int sock, doorbell, notify;
+  struct curve25519_shm_region *region;
+  uint32_t sq_head;    /* our copy; the shared one is only for show */
+  uint32_t cq_tail;
+  unsigned in_flight;  /* jobs of this client in the pool */
+  int backlogged;      /* has queued jobs the pool had no room for */
+  int wake;            /* completions posted since the last notify */
+};
+
+struct curve25519_shm_server {
+  int listen_fd, stop_fd, epoll_fd;
+  char path[sizeof(((struct sockaddr_un *) 0)->sun_path)];
+  struct curve25519_async *pool;
+  int pool_full;
+  struct client clients[MAX_CLIENTS];
+};
+
+static void
+client_release(struct curve25519_shm_server *server, unsigned id) {
+  struct client *c = &server->clients[id];
+
+  munmap(c->region, sizeof(*c->region));
+  memset(c, 0, sizeof(*c));
+}
+
+/* Closes the session. The mapping stays until the pool is done with it. */
+static void
+client_disconnect(struct curve25519_shm_server *server, unsigned id) {
+  struct client *c = &server->clients[id];
+
+  if (!c->connected) return;
+  epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, c->sock, NULL);
+  epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, c->doorbell, NULL);
+  close(c->sock);
+  close(c->doorbell);
+  close(c->notify);
+  c->connected = 0;
+  c->backlogged = 0;
+  if (c->in_flight == 0) client_release(server, id);
+}
+
+/* Returns how many more completions fit in the client's completion ring.
+ * The head comes from the client, so one that has moved it past our tail
+ * gets no room either. */
+static uint32_t
+cq_room(const struct client *c) {
+  const uint32_t head = __atomic_load_n(&c->region->cq.head, __ATOMIC_ACQUIRE);
+  const uint32_t used = c->cq_tail - head;
+
+  return used > CURVE25519_SHM_ENTRIES ? 0 : CURVE25519_SHM_ENTRIES - used;
+}
+
+/* Returns -1, posting nothing, if the client's completion ring is full. */
+static int
+post_completion(struct client *c, uint32_t index) {
+  struct curve25519_shm_ring *cq = &c->region->cq;
+
+  if (cq_room(c) == 0) return -1;
+  cq->index[c->cq_tail & (CURVE25519_SHM_ENTRIES - 1)] = index;
+  c->cq_tail++;
+  __atomic_store_n(&cq->tail, c->cq_tail, __ATOMIC_RELEASE);
+  c->wake = 1;
+  return 0;
+}
+
+/* Moves queued jobs from a client's submission ring into the pool. The
+ * client can scribble over the region at any time, so every index and count
+ * read from it is checked or masked before use.
+ *
+ * A job is only taken while its completion is sure to fit in the completion
+ * ring next to those of the jobs already in the pool. That always holds for
+ * a client that only submits slots it owns; one that stops reaping stays
+ * backlogged until it reaps and rings the doorbell again. */
+static void
+client_drain(struct curve25519_shm_server *server, unsigned id) {
+  struct client *c = &server->clients[id];
+  struct curve25519_shm_ring *sq = &c->region->sq;
+  struct curve25519_async_sqe sqe;
+  const uint32_t tail = __atomic_load_n(&sq->tail, __ATOMIC_ACQUIRE);
+  uint32_t index;
+
+  c->backlogged = 0;
+  if (tail - c->sq_head > CURVE25519_SHM_ENTRIES) {
+    client_disconnect(server, id);
+    return;
+  }
+
+  while (c->sq_head != tail) {
+    struct curve25519_shm_slot *slot;
+
+    if (cq_room(c) <= c->in_flight) {
+      c->backlogged = 1;
+      break;
+    }
+    index = sq->index[c->sq_head & (CURVE25519_SHM_ENTRIES - 1)] &
+            (CURVE25519_SHM_ENTRIES - 1);
+    slot = &c->region->slots[index];
+
+    if (slot->op == CURVE25519_SHM_OP_DH ||
+        slot->op == CURVE25519_SHM_OP_KEYGEN) {
+      sqe.op = slot->op == CURVE25519_SHM_OP_DH ? CURVE25519_ASYNC_OP_DH
+                                                : CURVE25519_ASYNC_OP_KEYGEN;
+      sqe.secret = slot->secret;
+      sqe.basepoint = slot->point;
+      sqe.out = slot->out;
+      sqe.user_data = ((uint64_t) id << 32) | index;
+      if (curve25519_async_submit(server->pool, &sqe) != 0) {
+        c->backlogged = 1;
+        server->pool_full = 1;
+        break;
+      }
+      c->in_flight++;
+    } else {
+      slot->result = -1;
+      post_completion(c, index);  /* cq_room said there is room */
+    }
+
+    c->sq_head++;
+  }
+  __atomic_store_n(&sq->head, c->sq_head, __ATOMIC_RELEASE);
+}
+
+static void
+notify_clients(struct curve25519_shm_server *server) {
+  const uint64_t one = 1;
+  unsigned i;
+
+  for (i = 0; i < MAX_CLIENTS; ++i) {
+    struct client *c = &server->clients[i];
+
+    if (!c->wake) continue;
+    c->wake = 0;
+    if (c->connected && write(c->notify, &one, sizeof(one)) < 0) {
+      /* The counter can't overflow in practice; nothing to do. */
+    }
+  }
+}
+
+static void
+reap_pool(struct curve25519_shm_server *server) {
+  struct curve25519_async_cqe cqes[64];
+  uint64_t counter;
+  unsigned i, n, reaped = 0;
+
+  if (read(curve25519_async_fd(server->pool), &counter, sizeof(counter)) < 0) {
+    /* Spurious wakeup. */
+  }
+
+  while ((n = curve25519_async_reap(server->pool, cqes, 64)) > 0) {
+    for (i = 0; i < n; ++i) {
+      const unsigned id = cqes[i].user_data >> 32;
+      const uint32_t index = (uint32_t) cqes[i].user_data;
+      struct client *c = &server->clients[id];
+
+      c->in_flight--;
+      if (c->connected) {
+        c->region->slots[index].result = cqes[i].result;
+        /* client_drain left room for this, unless the client moved its
+         * head backwards. */
+        if (post_completion(c, index) != 0) client_disconnect(server, id);
+      } else if (c->in_flight == 0) {
+        client_release(server, id);
+      }
+    }
+    reaped += n;
+  }
+  notify_clients(server);
+
+  /* Room in the pool again: pick up what didn't fit before. */
+  if (reaped && server->pool_full) {
+    server->pool_full = 0;
+    for (i = 0; i < MAX_CLIENTS && !server->pool_full; ++i) {
+      if (server->clients[i].backlogged) client_drain(server, i);
+    }
+  }
+}
+
+static int
+epoll_add(int epoll_fd, int fd, uint64_t tag) {
+  struct epoll_event ev;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.u64 = tag;
+  return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/* Sets up a session: a fresh region in a memfd plus the two eventfds, all
+ * sent to the client over its socket. */
+static void
+accept_client(struct curve25519_shm_server *server) {
+  struct client *c = NULL;
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  union {
+    char buf[CMSG_SPACE(3 * sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  int fds[3], sock, memfd = -1;
+  unsigned id;
+  char hello = 'K';
+
+  sock = accept4(server->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+  if (sock < 0) return;
+
+  for (id = 0; id < MAX_CLIENTS; ++id) {
+    if (!server->clients[id].in_use) {
+      c = &server->clients[id];
+      break;
+    }
+  }
+  if (!c) {
+    close(sock);
+    return;
+  }
+
+  memset(c, 0, sizeof(*c));
+  c->sock = sock;
+  c->doorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  c->notify = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  memfd = memfd_create("curve25519-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  /* Sealed so that the client can't shrink the region under our mapping,
+   * which would kill the daemon with SIGBUS on the next access. */
+  if (c->doorbell < 0 || c->notify < 0 || memfd < 0 ||
+      ftruncate(memfd, sizeof(*c->region)) != 0 ||
+      fcntl(memfd, F_ADD_SEALS, REGION_SEALS) != 0) {
+    goto fail;
+  }
+  c->region = mmap(NULL, sizeof(*c->region), PROT_READ | PROT_WRITE,
+                   MAP_SHARED, memfd, 0);
+  if (c->region == MAP_FAILED) {
+    c->region = NULL;
+    goto fail;
+  }
+  c->region->magic = CURVE25519_SHM_MAGIC;
+  c->region->version = CURVE25519_SHM_VERSION;
+  c->region->entries = CURVE25519_SHM_ENTRIES;
+
+  fds[0] = memfd;
+  fds[1] = c->doorbell;
+  fds[2] = c->notify;
+  memset(&msg, 0, sizeof(msg));
+  memset(&control, 0, sizeof(control));
+  iov.iov_base = &hello;
+  iov.iov_len = 1;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+  if (sendmsg(sock, &msg, MSG_NOSIGNAL) != 1) goto fail;
+  close(memfd);
+
+  if (epoll_add(server->epoll_fd, sock,
+                ((uint64_t) id << TAG_BITS) | TAG_SOCKET) != 0 ||
+      epoll_add(server->epoll_fd, c->doorbell,
+                ((uint64_t) id << TAG_BITS) | TAG_DOORBELL) != 0) {
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, sock, NULL);
+    memfd = -1;
+    goto fail;
+  }
+  c->in_use = 1;
+  c->connected = 1;
+  return;
+
+fail:
+  if (c->region) munmap(c->region, sizeof(*c->region));
+  if (memfd >= 0) close(memfd);
+  if (c->doorbell >= 0) close(c->doorbell);
+  if (c->notify >= 0) close(c->notify);
+  close(sock);
+  memset(c, 0, sizeof(*c));
+}
+
+struct curve25519_shm_server *
+curve25519_shm_server_new(const char *path, unsigned workers) {
+  struct curve25519_shm_server *server;
+  struct sockaddr_un addr;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) return NULL;
+  server = calloc(1, sizeof(*server));
+  if (!server) return NULL;
+  server->listen_fd = server->stop_fd = server->epoll_fd = -1;
+  strcpy(server->path, path);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  unlink(path);
+
+  server->pool = curve25519_async_new(workers, POOL_ENTRIES);
+  server->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  server->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (!server->pool || server->listen_fd < 0 || server->stop_fd < 0 ||
+      server->epoll_fd < 0 ||
+      bind(server->listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+      listen(server->listen_fd, 64) != 0 ||
+      epoll_add(server->epoll_fd, server->listen_fd, TAG_LISTEN) != 0 ||
+      epoll_add(server->epoll_fd, server->stop_fd, TAG_STOP) != 0 ||
+      epoll_add(server->epoll_fd, curve25519_async_fd(server->pool),
+                TAG_POOL) != 0) {
+    curve25519_shm_server_free(server);
+    return NULL;
+  }
+
+  return server;
+}
+
+int
+curve25519_shm_server_run(struct curve25519_shm_server *server) {
+  struct epoll_event events[64];
+  uint64_t counter;
+  int i, n;
+
+  for (;;) {
+    n = epoll_wait(server->epoll_fd, events, 64, -1);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+
+    for (i = 0; i < n; ++i) {
+      const uint64_t tag = events[i].data.u64;
+      const unsigned id = tag >> TAG_BITS;
+      struct client *c = &server->clients[id];
+
+      switch (tag & ((1 << TAG_BITS) - 1)) {
+        case TAG_LISTEN:
+          accept_client(server);
+          break;
+        case TAG_STOP:
+          if (read(server->stop_fd, &counter, sizeof(counter)) < 0) {
+            /* Already reset. */
+          }
+          return 0;
+        case TAG_POOL:
+          reap_pool(server);
+          break;
+        case TAG_SOCKET:
+          /* Clients send nothing after the handshake: this is a hangup. */
+          client_disconnect(server, id);
+          break;
+        case TAG_DOORBELL:
+          if (!c->connected) break;
+          if (read(c->doorbell, &counter, sizeof(counter)) < 0) {
+            /* Already reset. */
+          }
+          if (!server->pool_full) client_drain(server, id);
+          else c->backlogged = 1;
+          break;
+      }
+    }
+    notify_clients(server);
+  }
+}
+
+void
+curve25519_shm_server_stop(struct curve25519_shm_server *server) {
+  const uint64_t one = 1;
+
+  if (write(server->stop_fd, &one, sizeof(one)) < 0) {
+    /* Only fails if the counter would overflow: it's readable anyway. */
+  }
+}
+
+void
+curve25519_shm_server_free(struct curve25519_shm_server *server) {
+  unsigned i;
+
+  if (!server) return;
+
+  /* Stop the workers before any mapping they might be writing to goes. */
+  curve25519_async_free(server->pool);
+  for (i = 0; i < MAX_CLIENTS; ++i) {
+    if (!server->clients[i].in_use) continue;
+    server->clients[i].in_flight = 0;
+    client_disconnect(server, i);
+    if (server->clients[i].in_use) client_release(server, i);
+  }
+
+  if (server->listen_fd >= 0) {
+    close(server->listen_fd);
+    unlink(server->path);
+  }
+  if (server->stop_fd >= 0) close(server->stop_fd);
+  if (server->epoll_fd >= 0) close(server->epoll_fd);
+  free(server);
+}
@@ -0,0 +1,132 @@
+/* Local curve25519 offload service over shared memory.
+ *
+ * A daemon (curve25519-shmd) runs DH and keygen jobs for any number of local
+ * processes and batches them together in one worker pool (see
+ * curve25519-async.h), so that clients whose own load is too light to fill
+ * batches still get batch throughput.
+ *
+ * A client connects to the daemon's unix socket only to receive three file
+ * descriptors: a memfd holding the shared region laid out below, an eventfd
+ * that the client writes to after queueing work (the doorbell), and an
+ * eventfd that the daemon writes to after posting completions. Jobs and
+ * results then move through the region without further copies or socket
+ * traffic. Closing the socket ends the session. The region is sealed
+ * against resizing, and the client refuses one that isn't.
+ *
+ * Within the region, the client owns the slots. It fills a free slot and
+ * pushes the slot's index onto the submission ring; the daemon writes the
+ * result into the slot and pushes the index onto the completion ring. Both
+ * rings are single-producer, single-consumer. The daemon reads indices and
+ * counters from the region defensively, since the client can write to it at
+ * any time.
+ *
+ * Linux only. */
+
+#ifndef CURVE25519_SHM_H
+#define CURVE25519_SHM_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CURVE25519_SHM_MAGIC 0x32355368u  /* "hS52" */
+#define CURVE25519_SHM_VERSION 1
+#define CURVE25519_SHM_ENTRIES 256  /* slots per client; a power of two */
+
+enum curve25519_shm_op {
+  CURVE25519_SHM_OP_DH,      /* out = secret * point */
+  CURVE25519_SHM_OP_KEYGEN,  /* fill secret with random bytes, out = public */
+};
+
+/* Shared region layout. */
+
+struct curve25519_shm_slot {
+  uint8_t secret[32];
+  uint8_t point[32];
+  uint8_t out[32];
+  uint64_t user_data;
+  int32_t op;
+  int32_t result;  /* 0, or -1 on failure (bad op, no randomness) */
+};
+
+struct curve25519_shm_ring {
+  uint32_t head __attribute__((aligned(64)));  /* written by the consumer */
+  uint32_t tail __attribute__((aligned(64)));  /* written by the producer */
+  uint32_t index[CURVE25519_SHM_ENTRIES] __attribute__((aligned(64)));
+};
+
+struct curve25519_shm_region {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t entries;
+  struct curve25519_shm_ring sq;  /* client to daemon */
+  struct curve25519_shm_ring cq;  /* daemon to client */
+  struct curve25519_shm_slot slots[CURVE25519_SHM_ENTRIES];
+};
+
+/* Client library. A connection is not thread-safe; use one per thread. */
+
+struct curve25519_shm_client;
+
+struct curve25519_shm_completion {
+  uint64_t user_data;
+  int result;
+  uint8_t secret[32];  /* the generated secret, for KEYGEN */
+  uint8_t out[32];
+};
+
+/* Connects to the daemon listening on |path|. Returns NULL on failure. */
+struct curve25519_shm_client *curve25519_shm_connect(const char *path);
+
+/* Ends the session and releases the region. Results still in flight are
+ * discarded. */
+void curve25519_shm_disconnect(struct curve25519_shm_client *client);
+
+/* Returns the eventfd that becomes readable when completions are posted. */
+int curve25519_shm_fd(const struct curve25519_shm_client *client);
+
+/* Queues one job. |point| is ignored for KEYGEN, and NULL means the base
+ * point 9 for DH. Returns 0, or -1 if all CURVE25519_SHM_ENTRIES slots are
+ * in flight. */
+int curve25519_shm_submit(struct curve25519_shm_client *client, int op,
+                          const uint8_t *secret, const uint8_t *point,
+                          uint64_t user_data);
+
+/* Moves up to |max| completions into |out| and returns how many there were.
+ * Never blocks. */
+unsigned curve25519_shm_reap(struct curve25519_shm_client *client,
+                             struct curve25519_shm_completion *out,
+                             unsigned max);
+
+/* Blocks until completions are posted or |timeout_ms| passes (-1 waits
+ * forever). Returns 1 if completions may be ready, 0 on timeout and -1 if
+ * the daemon has gone away. */
+int curve25519_shm_wait(struct curve25519_shm_client *client, int timeout_ms);
+
+/* Daemon side, for embedding the service in another program. */
+
+struct curve25519_shm_server;
+
+/* Listens on |path| (replacing any stale socket there) and runs jobs on
+ * |workers| threads. Returns NULL on failure. */
+struct curve25519_shm_server *curve25519_shm_server_new(const char *path,
+                                                        unsigned workers);
+
+/* Serves clients until curve25519_shm_server_stop is called. Returns 0, or
+ * -1 on a fatal error. */
+int curve25519_shm_server_run(struct curve25519_shm_server *server);
+
+/* Makes curve25519_shm_server_run return. Safe to call from any thread and
+ * from a signal handler. */
+void curve25519_shm_server_stop(struct curve25519_shm_server *server);
+
+/* Disconnects every client, removes the socket and frees the server. */
+void curve25519_shm_server_free(struct curve25519_shm_server *server);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* CURVE25519_SHM_H */
@@ -0,0 +1,47 @@
+/* curve25519-shmd: runs the shared-memory offload service (see
+ * curve25519-shm.h) until interrupted.
+ *
+ * Usage: curve25519-shmd [socket path] [worker threads] */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "curve25519-shm.h"
+
+static struct curve25519_shm_server *server;
+
+static void
+on_signal(int sig) {
+  (void) sig;
+  curve25519_shm_server_stop(server);
+}
+
+int
+main(int argc, char **argv) {
+  const char *path = argc > 1 ? argv[1] : "/tmp/curve25519-shmd.sock";
+  long workers = argc > 2 ? atol(argv[2]) : sysconf(_SC_NPROCESSORS_ONLN);
+  struct sigaction sa;
+  int ret;
+
+  if (workers < 1) workers = 1;
+  server = curve25519_shm_server_new(path, workers);
+  if (!server) {
+    fprintf(stderr, "curve25519-shmd: cannot listen on %s\n", path);
+    return 1;
+  }
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_signal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  fprintf(stderr, "curve25519-shmd: listening on %s with %ld workers\n", path,
+          workers);
+  ret = curve25519_shm_server_run(server);
+  curve25519_shm_server_free(server);
+  return ret ? 1 : 0;
+}
@@ -1,4 +1,4 @@
 
-from .keys import Private, Public
+from .keys import Private, Public, Keypairs, generate_keypairs
 
-hush_pyflakes = [Private, Public]; del hush_pyflakes
+hush_pyflakes = [Private, Public, Keypairs, generate_keypairs]; del hush_pyflakes
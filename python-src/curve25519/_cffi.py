@@ -0,0 +1,109 @@
+"""The _curve25519 functions on top of the cffi binding (_cffi_build.py).
+
+keys.py uses this module instead of the _curve25519 extension on PyPy, where
+cffi calls are cheap and extension calls go through cpyext. The functions
+take and return the same things, except that there is no Pool (aio.py falls
+back to an executor). cffi releases the GIL around each C call on CPython.
+"""
+
+import os
+
+from ._curve25519_cffi import ffi, lib
+
+backend = ffi.string(lib.curve25519_cffi_backend()).decode("ascii")
+
+def _key(data):
+    # bytes go to const char * arguments as they are
+    if type(data) is not bytes:
+        data = ffi.from_buffer(data)
+    if len(data) != 32:
+        raise ValueError("input must be 32 bytes long")
+    return data
+
+def _keys(data, what):
+    """Packed 32-byte keys, from one buffer or a sequence of 32-byte
+    buffers. Returns (keys, count)."""
+    if type(data) is not bytes:
+        try:
+            data = ffi.from_buffer(data)
+        except TypeError:
+            keys = [bytes(memoryview(k)) for k in data]
+            for k in keys:
+                if len(k) != 32:
+                    raise ValueError("each of %s must be 32 bytes long"
+                                     % what)
+            data = b"".join(keys)
+    if len(data) % 32:
+        raise ValueError("%s must be a multiple of 32 bytes long" % what)
+    return data, len(data) // 32
+
+def _output(out, length):
+    if out is None:
+        return ffi.new("char[]", length or 1)
+    dst = ffi.from_buffer(out, require_writable=True)
+    if len(dst) != length:
+        raise ValueError("out must be %d bytes long" % length)
+    return dst
+
+def _result(dst, out, length=32):
+    return ffi.unpack(dst, length) if out is None else out
+
+def make_private(secret, out=None):
+    dst = _output(out, 32)
+    lib.curve25519_cffi_private(dst, _key(secret), 1)
+    return _result(dst, out)
+
+def make_public(private, out=None):
+    dst = _output(out, 32)
+    lib.curve25519_cffi_public(dst, _key(private), 1)
+    return _result(dst, out)
+
+def make_shared(private, public, out=None):
+    dst = _output(out, 32)
+    lib.curve25519_cffi_shared(dst, _key(private), _key(public), 1)
+    return _result(dst, out)
+
+def make_shared_hashed(private, public, out=None):
+    dst = _output(out, 32)
+    lib.curve25519_cffi_shared_hashed(dst, _key(private), _key(public), 1)
+    return _result(dst, out)
+
+def make_public_many(privates, out=None):
+    src, n = _keys(privates, "privates")
+    dst = _output(out, n * 32)
+    lib.curve25519_cffi_public(dst, src, n)
+    return _result(dst, out, n * 32)
+
+def _pairs(privates, publics):
+    mine, n = _keys(privates, "privates")
+    theirs, m = _keys(publics, "publics")
+    if n != m:
+        raise ValueError("need as many public keys as private keys")
+    return mine, theirs, n
+
+def make_shared_many(privates, publics, out=None):
+    mine, theirs, n = _pairs(privates, publics)
+    dst = _output(out, n * 32)
+    lib.curve25519_cffi_shared(dst, mine, theirs, n)
+    return _result(dst, out, n * 32)
+
+def make_shared_hashed_many(privates, publics, out=None):
+    mine, theirs, n = _pairs(privates, publics)
+    dst = _output(out, n * 32)
+    lib.curve25519_cffi_shared_hashed(dst, mine, theirs, n)
+    return _result(dst, out, n * 32)
+
+def hash_shared_many(shareds, out=None):
+    src, n = _keys(shareds, "shareds")
+    dst = _output(out, n * 32)
+    lib.curve25519_cffi_hash_shared(dst, src, n)
+    return _result(dst, out, n * 32)
+
+def generate_keypairs(n):
+    if n < 0:
+        raise ValueError("n out of range")
+    privates = ffi.new("char[]", n * 32 or 1)
+    publics = ffi.new("char[]", n * 32 or 1)
+    lib.curve25519_cffi_private(privates, os.urandom(n * 32), n)
+    lib.curve25519_cffi_public(publics, privates, n)
+    return ffi.unpack(privates, n * 32), ffi.unpack(publics, n * 32)
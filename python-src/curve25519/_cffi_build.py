@@ -0,0 +1,133 @@
+"""Builds curve25519._curve25519_cffi, a cffi (API mode) binding to the C
+library. Under PyPy, calls through cffi avoid the cpyext emulation layer
+that the _curve25519 extension module needs; see _cffi.py for the wrapper
+that keys.py uses there. setup.py builds it whenever cffi is installed."""
+
+from cffi import FFI
+
+CDEF = """
+    int curve25519_donna(uint8_t *mypublic, const uint8_t *secret,
+                         const uint8_t *basepoint);
+    int curve25519_donna_batch(uint8_t *mypublic, const uint8_t *secret,
+                               const uint8_t *basepoint, size_t n);
+
+    void curve25519_cffi_private(char *out, const char *secrets, size_t n);
+    void curve25519_cffi_public(char *out, const char *privates, size_t n);
+    void curve25519_cffi_shared(char *out, const char *privates,
+                                const char *publics, size_t n);
+    void curve25519_cffi_shared_hashed(char *out, const char *privates,
+                                       const char *publics, size_t n);
+    void curve25519_cffi_hash_shared(char *out, const char *shareds,
+                                     size_t n);
+    const char *curve25519_cffi_backend(void);
+"""
+
+# What _cffi.py calls. These take char pointers, so that bytes objects can be
+# passed as they are, and each runs a whole batch of |n| packed
+# 32-byte keys in one call.
+SOURCE = """
+#include <string.h>
+#include "curve25519-donna.h"
+#include "sha256.h"
+
+#define BATCH 64
+
+static void
+curve25519_cffi_private(char *out, const char *secrets, size_t n)
+{
+    uint8_t *p = (uint8_t *) out;
+    size_t i;
+    for (i = 0; i < n; i++) {
+        memmove(p + i * 32, secrets + i * 32, 32);
+        p[i * 32] &= 248;
+        p[i * 32 + 31] &= 127;
+        p[i * 32 + 31] |= 64;
+    }
+}
+
+static void
+curve25519_cffi_shared(char *out, const char *privates, const char *publics,
+                       size_t n)
+{
+    if (n == 1)
+        curve25519_donna((uint8_t *) out, (const uint8_t *) privates,
+                         (const uint8_t *) publics);
+    else
+        curve25519_donna_batch((uint8_t *) out, (const uint8_t *) privates,
+                               (const uint8_t *) publics, n);
+}
+
+static void
+curve25519_cffi_public(char *out, const char *privates, size_t n)
+{
+    static const uint8_t basepoint[32] = {9};
+    uint8_t basepoints[BATCH * 32];
+    size_t i, m;
+    if (n == 1) {
+        curve25519_donna((uint8_t *) out, (const uint8_t *) privates,
+                         basepoint);
+        return;
+    }
+    for (i = 0; i < BATCH; i++)
+        memcpy(basepoints + i * 32, basepoint, 32);
+    for (i = 0; i < n; i += m) {
+        m = n - i < BATCH ? n - i : BATCH;
+        curve25519_donna_batch((uint8_t *) out + i * 32,
+                               (const uint8_t *) privates + i * 32,
+                               basepoints, m);
+    }
+}
+
+/* sha256(b"curve25519-shared:" + shared) for each shared secret, as in
+   keys.py. */
+static void
+curve25519_cffi_hash_shared(char *out, const char *shareds, size_t n)
+{
+    static const char prefix[] = "curve25519-shared:";
+    struct sha256_ctx ctx;
+    size_t i;
+    for (i = 0; i < n; i++) {
+        sha256_init(&ctx);
+        sha256_update(&ctx, (const uint8_t *) prefix, sizeof(prefix) - 1);
+        sha256_update(&ctx, (const uint8_t *) shareds + i * 32, 32);
+        sha256_final(&ctx, (uint8_t *) out + i * 32);
+    }
+    memset(&ctx, 0, sizeof(ctx));
+}
+
+/* DH, then curve25519_cffi_hash_shared. */
+static void
+curve25519_cffi_shared_hashed(char *out, const char *privates,
+                              const char *publics, size_t n)
+{
+    char shared[BATCH * 32];
+    size_t i, m;
+    for (i = 0; i < n; i += m) {
+        m = n - i < BATCH ? n - i : BATCH;
+        curve25519_cffi_shared(shared, privates + i * 32, publics + i * 32, m);
+        curve25519_cffi_hash_shared(out + i * 32, shared, m);
+    }
+    memset(shared, 0, sizeof(shared));
+}
+
+static const char *
+curve25519_cffi_backend(void)
+{
+    return CURVE25519_BACKEND;
+}
+"""
+
+def make_ffi(backend="curve25519-donna-c64"):
+    ffibuilder = FFI()
+    ffibuilder.cdef(CDEF)
+    ffibuilder.set_source("curve25519._curve25519_cffi", SOURCE,
+                          sources=["%s.c" % backend, "sha256.c"],
+                          include_dirs=["."],
+                          define_macros=[("CURVE25519_BACKEND",
+                                          '"%s"' % backend)])
+    return ffibuilder
+
+ffibuilder = make_ffi()
+
+if __name__ == "__main__":
+    ffibuilder.compile(verbose=True)
@@ -0,0 +1,74 @@
+"""Key agreement for asyncio programs, off the event loop.
+
+The ladders run on a native worker pool (one per event loop, with a thread
+per core) that wakes the loop through a file descriptor when results are
+ready, so awaiting them costs the loop no more than a socket read. Where the
+extension was built without the pool, they run in the loop's default
+executor instead.
+"""
+
+import asyncio
+import os
+import weakref
+
+from .keys import Public, _curve25519, _hash_shared
+
+_pools = weakref.WeakKeyDictionary()
+
+class _LoopPool:
+    def __init__(self, loop):
+        self.pid = os.getpid()
+        self.pool = _curve25519.Pool(workers=os.cpu_count() or 1)
+        loop.add_reader(self.pool.fileno(), self._reap)
+
+    def _reap(self):
+        for future, result in self.pool.reap():
+            if not future.done():
+                future.set_result(result)
+
+def _run(privates, publics):
+    """Returns a future for the packed results of a batch: public keys if
+    publics is None, shared keys otherwise."""
+    loop = asyncio.get_running_loop()
+    if not hasattr(_curve25519, "Pool"):
+        if publics is None:
+            return loop.run_in_executor(None, _curve25519.make_public_many,
+                                        privates)
+        return loop.run_in_executor(None, _curve25519.make_shared_many,
+                                    privates, publics)
+    pool = _pools.get(loop)
+    if pool is None or pool.pid != os.getpid():
+        pool = _pools[loop] = _LoopPool(loop)
+    future = loop.create_future()
+    pool.pool.submit(future, privates, publics)
+    return future
+
+async def make_public_many(privates):
+    """Async _curve25519.make_public_many."""
+    return await _run(privates, None)
+
+async def make_shared_many(privates, publics):
+    """Async _curve25519.make_shared_many."""
+    return await _run(privates, publics)
+
+async def get_public(private):
+    return Public(await _run(private.private, None))
+
+async def get_shared_key(private, public, hashfunc=None):
+    if hashfunc is None:
+        hashfunc = _hash_shared
+    return hashfunc(await _run(private.private, public.public))
+
+async def get_shared_keys(privates, publics, hashfunc=None):
+    """Like [p.get_shared_key(q, hashfunc) for p, q in zip(privates,
+    publics)], with all the ladders run as one batch."""
+    if len(privates) != len(publics):
+        raise ValueError("need as many public keys as private keys")
+    for public in publics:
+        if not isinstance(public, Public):
+            raise ValueError("'publics' must be instances of Public")
+    if hashfunc is None:
+        hashfunc = _hash_shared
+    shared = await _run([p.private for p in privates],
+                        [q.public for q in publics])
+    return [hashfunc(shared[i:i+32]) for i in range(0, len(shared), 32)]
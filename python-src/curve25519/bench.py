@@ -0,0 +1,231 @@
+"""Benchmarks for sizing services that use this package.
+
+    python -m curve25519.bench [--quick] [--json] [--threads N] [--cffi]
+
+Breaks the cost of key agreement down into the native ladder, the
+extension's own overhead, the key derivation hash and the keys.py layer,
+then measures batch throughput and how throughput scales with threads. Times
+are per operation, as percentiles over many samples; each sample times a
+short run of calls so that timer resolution doesn't matter. --json prints the
+same numbers as a JSON object instead of a table.
+"""
+
+import argparse
+import json
+import os
+import platform
+import sys
+import threading
+from hashlib import sha256
+from timeit import default_timer
+
+from .keys import Private, Public, _curve25519, _hash_shared
+
+PERCENTILES = (50, 90, 99)
+# keys per batch when measuring the native hash
+HASH_BATCH = 256
+
+def percentile(sorted_samples, p):
+    index = int(round(p / 100.0 * (len(sorted_samples) - 1)))
+    return sorted_samples[index]
+
+def measure(fn, samples, inner):
+    """Runs fn() samples * inner times; returns per-call statistics in
+    seconds."""
+    times = []
+    fn()
+    for i in range(samples):
+        start = default_timer()
+        for j in range(inner):
+            fn()
+        times.append((default_timer() - start) / inner)
+    times.sort()
+    stats = dict(("p%d" % p, percentile(times, p)) for p in PERCENTILES)
+    stats["min"] = times[0]
+    stats["mean"] = sum(times) / len(times)
+    return stats
+
+def breakdown(lib, samples, fast, slow):
+    secret = os.urandom(32)
+    private = lib.make_private(secret)
+    public = lib.make_public(lib.make_private(os.urandom(32)))
+    shared = lib.make_shared(private, public)
+    out = bytearray(32)
+    out_many = bytearray(HASH_BATCH * 32)
+    priv, pub = Private(private), Public(public)
+
+    results = {}
+    # make_private does no curve arithmetic: it is all argument handling
+    # and producing the result, which every other call pays as well
+    results["wrapper"] = measure(lambda: lib.make_private(secret, out=out),
+                                 samples, fast)
+    results["make_shared"] = measure(
+        lambda: lib.make_shared(private, public, out=out), samples, slow)
+    results["make_shared_hashed"] = measure(
+        lambda: lib.make_shared_hashed(private, public, out=out),
+        samples, slow)
+    results["hashlib_sha256"] = measure(lambda: _hash_shared(shared),
+                                        samples, fast)
+    # the hash is a small fraction of a ladder, so subtracting one call
+    # from another leaves mostly noise: time it on its own, over a batch so
+    # that the call itself is shared by many keys
+    shareds = lib.make_shared_many(*lib.generate_keypairs(HASH_BATCH))
+    hash_many = measure(lambda: lib.hash_shared_many(shareds, out=out_many),
+                        samples, slow)
+    # the differences below use the fastest samples, which have the least
+    # noise from the rest of the machine in them; what noise is left can
+    # push a small difference below zero, which is reported as zero
+    best = lambda name: results[name]["min"]
+    derived = {
+        "ladder": max(0.0, best("make_shared") - best("wrapper")),
+        "native_hash": hash_many["min"] / HASH_BATCH,
+    }
+    if lib is not _curve25519:
+        # keys.py uses the other binding
+        return results, derived
+
+    results["Private.get_shared_key"] = measure(
+        lambda: priv.get_shared_key(pub), samples, slow)
+    results["Private.get_shared_key(hashfunc)"] = measure(
+        lambda: priv.get_shared_key(pub, hashfunc=_hashfunc), samples, slow)
+    results["Private.get_public"] = measure(priv.get_public, samples, slow)
+    derived["keys_layer"] = max(0.0, best("Private.get_shared_key")
+                                - best("make_shared_hashed"))
+    return results, derived
+
+def _hashfunc(shared):
+    return sha256(b"curve25519-shared:" + shared).digest()
+
+def batches(lib, sizes, seconds):
+    """Keys per second for each batch size, running each size for about
+    |seconds|."""
+    results = {}
+    for n in sizes:
+        privates, publics = lib.generate_keypairs(n)
+        calls = {
+            "make_public_many": lambda: lib.make_public_many(privates),
+            "make_shared_many": lambda: lib.make_shared_many(privates,
+                                                             publics),
+            "make_shared_hashed_many":
+                lambda: lib.make_shared_hashed_many(privates, publics),
+            "generate_keypairs": lambda: lib.generate_keypairs(n),
+        }
+        row = {}
+        for name, fn in sorted(calls.items()):
+            done = 0
+            start = default_timer()
+            while True:
+                fn()
+                done += n
+                elapsed = default_timer() - start
+                if elapsed >= seconds:
+                    break
+            row[name] = done / elapsed
+        results[n] = row
+    return results
+
+def scaling(lib, max_threads, batch, seconds):
+    """Keys per second from make_shared_hashed_many calls of |batch| keys
+    running on 1, 2, 4, ... threads."""
+    privates, publics = lib.generate_keypairs(batch)
+    results = {}
+    nthreads = 1
+    while nthreads <= max_threads:
+        done = [0] * nthreads
+        stop = threading.Event()
+        def worker(index):
+            while not stop.is_set():
+                lib.make_shared_hashed_many(privates, publics)
+                done[index] += batch
+        threads = [threading.Thread(target=worker, args=(i,))
+                   for i in range(nthreads)]
+        start = default_timer()
+        for t in threads:
+            t.start()
+        stop.wait(seconds)
+        stop.set()
+        for t in threads:
+            t.join()
+        results[nthreads] = sum(done) / (default_timer() - start)
+        nthreads *= 2
+    return results
+
+def run(args):
+    if args.cffi:
+        from . import _cffi as lib
+    else:
+        # whichever binding keys.py uses
+        lib = _curve25519
+    if args.quick:
+        samples, fast, slow, seconds = 20, 200, 5, 0.1
+    else:
+        samples, fast, slow, seconds = 200, 1000, 20, 1.0
+    cpus = os.cpu_count() or 1
+    report = {
+        "python": "%s %s" % (platform.python_implementation(),
+                             platform.python_version()),
+        "binding": lib.__name__.rsplit(".", 1)[-1],
+        "backend": lib.backend,
+        "cpus": cpus,
+        "gil": getattr(sys, "_is_gil_enabled", lambda: True)(),
+    }
+    report["calls"], report["derived"] = breakdown(lib, samples, fast, slow)
+    report["batch"] = batches(lib, args.sizes, seconds)
+    report["threads"] = scaling(lib, args.threads or max(4, cpus), 64,
+                                seconds)
+    return report
+
+def us(seconds):
+    return "%10.2f" % (seconds * 1e6)
+
+def print_report(report):
+    print("%(python)s, %(binding)s, %(backend)s, %(cpus)d cpus" % report)
+    print("")
+    print("%-34s %s (us)" % ("per call", "".join(
+        "%10s" % k for k in ["p%d" % p for p in PERCENTILES] + ["min"])))
+    for name, stats in sorted(report["calls"].items()):
+        print("%-34s %s" % (name, "".join(
+            us(stats[k]) for k in ["p%d" % p for p in PERCENTILES]
+            + ["min"])))
+    print("")
+    derived = report["derived"]
+    print("native ladder         %s us" % us(derived["ladder"]))
+    print("native hash           %s us" % us(derived["native_hash"]))
+    if "keys_layer" in derived:
+        print("keys.py layer         %s us" % us(derived["keys_layer"]))
+    print("")
+    names = sorted(next(iter(report["batch"].values())))
+    print("%-8s %s (keys/s)" % ("batch", "".join("%25s" % n for n in names)))
+    for n, row in sorted(report["batch"].items()):
+        print("%-8d %s" % (n, "".join("%25.0f" % row[k] for k in names)))
+    print("")
+    base = report["threads"][1]
+    for n, rate in sorted(report["threads"].items()):
+        print("%2d threads: %10.0f shared keys/s (%.2fx)"
+              % (n, rate, rate / base))
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(prog="python -m curve25519.bench",
+                                     description=__doc__.split("\n")[0])
+    parser.add_argument("--json", action="store_true",
+                        help="print the results as JSON")
+    parser.add_argument("--quick", action="store_true",
+                        help="fewer samples and shorter runs")
+    parser.add_argument("--threads", type=int, default=0,
+                        help="most threads to try (default: max(4, cpus))")
+    parser.add_argument("--sizes", type=int, nargs="+",
+                        default=[1, 16, 64, 1024],
+                        help="batch sizes (default: 1 16 64 1024)")
+    parser.add_argument("--cffi", action="store_true",
+                        help="measure the cffi binding rather than the "
+                        "extension module")
+    args = parser.parse_args(argv)
+    report = run(args)
+    if args.json:
+        json.dump(report, sys.stdout, indent=2, sort_keys=True)
+        sys.stdout.write("\n")
+    else:
+        print_report(report)
+
+if __name__ == "__main__":
+    main()
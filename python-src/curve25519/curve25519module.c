@@ -8,98 +8,1130 @@
 /* This is required for compatibility with Python 2. */
 #if PY_MAJOR_VERSION >= 3
 	#include <bytesobject.h> 
-	#define y "y"
+	#define keyword_equals(name, s) (PyUnicode_CompareWithASCIIString(name, s) == 0)
+	#define KEYWORD_FORMAT "%U"
+	#define keyword_arg(name) (name)
 #else
 	#define PyBytes_FromStringAndSize PyString_FromStringAndSize
-	#define y "t"
+	#define PyBytes_CheckExact PyString_CheckExact
+	#define PyBytes_GET_SIZE PyString_GET_SIZE
+	#define PyBytes_AS_STRING PyString_AS_STRING
+	#define keyword_equals(name, s) \
+		(PyString_Check(name) && strcmp(PyString_AS_STRING(name), s) == 0)
+	#define KEYWORD_FORMAT "%s"
+	#define keyword_arg(name) \
+		(PyString_Check(name) ? PyString_AS_STRING(name) : "?")
+#endif
+
+/* The functions take their arguments the METH_FASTCALL way, which skips
+ * building a tuple and a dict per call. Pythons before 3.7 don't have it,
+ * so there each one gets a METH_VARARGS shim that unpacks the tuple and
+ * dict into the same form. */
+typedef PyObject *(*fastcall_fn)(PyObject *, PyObject *const *, Py_ssize_t,
+                                 PyObject *);
+#if PY_VERSION_HEX >= 0x03070000
+	#define FASTCALL(fn) (PyCFunction)(void (*)(void))fn, \
+		METH_FASTCALL | METH_KEYWORDS
+	#define VARARGS_SHIM(fn)
+#else
+	#define FASTCALL(fn) (PyCFunction)fn##_varargs, \
+		METH_VARARGS | METH_KEYWORDS
+	#define VARARGS_SHIM(fn) \
+		static PyObject * \
+		fn##_varargs(PyObject *self, PyObject *args, PyObject *kwargs) \
+		{ \
+			return call_varargs(fn, self, args, kwargs); \
+		}
+
+/* No function here takes more than three arguments. */
+#define MAX_ARGS 3
+
+static PyObject *
+call_varargs(fastcall_fn fn, PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    PyObject *argv[MAX_ARGS + 1], *kwnames = NULL, *key, *value, *result;
+    Py_ssize_t nargs = PyTuple_GET_SIZE(args), n, i, pos = 0;
+    n = nargs + (kwargs ? PyDict_Size(kwargs) : 0);
+    if (n > MAX_ARGS) {
+        PyErr_SetString(PyExc_TypeError, "too many arguments");
+        return NULL;
+    }
+    for (i = 0; i < nargs; i++)
+        argv[i] = PyTuple_GET_ITEM(args, i);
+    if (n > nargs) {
+        kwnames = PyTuple_New(n - nargs);
+        if (!kwnames)
+            return NULL;
+        while (PyDict_Next(kwargs, &pos, &key, &value)) {
+            Py_INCREF(key);
+            PyTuple_SET_ITEM(kwnames, i - nargs, key);
+            argv[i++] = value;
+        }
+    }
+    result = fn(self, argv, nargs, kwnames);
+    Py_XDECREF(kwnames);
+    return result;
+}
 #endif
 
 int curve25519_donna(char *mypublic, 
                      const char *secret, const char *basepoint);
+int curve25519_donna_batch(char *mypublic, const char *secret,
+                           const char *basepoint, size_t n);
+
+/* Which of the two implementations setup.py built in. */
+#ifndef CURVE25519_BACKEND
+#define CURVE25519_BACKEND "curve25519-donna"
+#endif
+
+/* Keys per curve25519_donna_batch call in the *_many functions. */
+#define BATCH 64
+
+#include "sha256.h"
 
+/* The key derivation keys.py applies by default:
+ * sha256(b"curve25519-shared:" + shared). */
+static void
+hash_shared(char *out, const char *shared)
+{
+    static const char prefix[] = "curve25519-shared:";
+    struct sha256_ctx ctx;
+    volatile char *p = (volatile char *) &ctx;
+    size_t i;
+    sha256_init(&ctx);
+    sha256_update(&ctx, (const uint8_t *) prefix, sizeof(prefix) - 1);
+    sha256_update(&ctx, (const uint8_t *) shared, 32);
+    sha256_final(&ctx, (uint8_t *) out);
+    for (i = 0; i < sizeof(ctx); i++)
+        p[i] = 0;
+}
+
+/* Where a result goes: into the caller's writable buffer |out| if one was
+ * given, otherwise into a new bytes object. Returns the object to hand back
+ * to the caller (a new reference) and sets |*dst|, or returns NULL. Call
+ * output_release once the result is written. */
 static PyObject *
-pycurve25519_makeprivate(PyObject *self, PyObject *args)
+output_get(PyObject *out, Py_ssize_t len, Py_buffer *view, char **dst)
 {
-    char *in1;
-    Py_ssize_t in1len;
-    if (!PyArg_ParseTuple(args, y"#:clamp", &in1, &in1len))
+    PyObject *result;
+    view->obj = NULL;
+    if (out == NULL || out == Py_None) {
+        result = PyBytes_FromStringAndSize(NULL, len);
+        if (result)
+            *dst = PyBytes_AS_STRING(result);
+        return result;
+    }
+    if (PyObject_GetBuffer(out, view, PyBUF_WRITABLE) != 0)
         return NULL;
-    if (in1len != 32) {
-        PyErr_SetString(PyExc_ValueError, "input must be 32-byte string");
+    if (view->len != len) {
+        PyErr_Format(PyExc_ValueError, "out must be %zd bytes long", len);
+        PyBuffer_Release(view);
+        return NULL;
+    }
+    *dst = view->buf;
+    Py_INCREF(out);
+    return out;
+}
+
+static void
+output_release(Py_buffer *view)
+{
+    if (view->obj)
+        PyBuffer_Release(view);
+}
+
+
+/* Matches the arguments of a METH_FASTCALL | METH_KEYWORDS call against
+ * |names|, of which the first |required| must be given, and stores them in
+ * |argv| (NULL for those left out). */
+static int
+parse_args(const char *fname, const char *const *names, int required,
+           int total, PyObject *const *args, Py_ssize_t nargs,
+           PyObject *kwnames, PyObject **argv)
+{
+    Py_ssize_t nkw = kwnames ? PyTuple_GET_SIZE(kwnames) : 0, i;
+    int j;
+    if (nargs > total) {
+        PyErr_Format(PyExc_TypeError,
+                     "%s() takes at most %d arguments (%zd given)",
+                     fname, total, nargs);
+        return -1;
+    }
+    for (j = 0; j < total; j++)
+        argv[j] = j < nargs ? args[j] : NULL;
+    for (i = 0; i < nkw; i++) {
+        PyObject *name = PyTuple_GET_ITEM(kwnames, i);
+        for (j = 0; j < total; j++) {
+            if (keyword_equals(name, names[j]))
+                break;
+        }
+        if (j == total || argv[j]) {
+            PyErr_Format(PyExc_TypeError, j == total
+                         ? "%s() got an unexpected keyword argument '"
+                           KEYWORD_FORMAT "'"
+                         : "%s() got multiple values for argument '"
+                           KEYWORD_FORMAT "'",
+                         fname, keyword_arg(name));
+            return -1;
+        }
+        argv[j] = args[nargs + i];
+    }
+    for (j = 0; j < required; j++) {
+        if (!argv[j]) {
+            PyErr_Format(PyExc_TypeError,
+                         "%s() missing required argument '%s'",
+                         fname, names[j]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* A single 32-byte key from any buffer. bytes, the common case, is read
+ * directly rather than through the buffer protocol. */
+struct key {
+    const char *data;
+    Py_buffer view;
+};
+
+static int
+key_get(struct key *key, PyObject *obj)
+{
+    Py_ssize_t len;
+    key->view.obj = NULL;
+    if (PyBytes_CheckExact(obj)) {
+        key->data = PyBytes_AS_STRING(obj);
+        len = PyBytes_GET_SIZE(obj);
+    } else {
+        if (PyObject_GetBuffer(obj, &key->view, PyBUF_SIMPLE) != 0)
+            return -1;
+        key->data = key->view.buf;
+        len = key->view.len;
+    }
+    if (len != 32) {
+        if (key->view.obj)
+            PyBuffer_Release(&key->view);
+        PyErr_SetString(PyExc_ValueError, "input must be 32 bytes long");
+        return -1;
+    }
+    return 0;
+}
+
+static void
+key_release(struct key *key)
+{
+    if (key->view.obj)
+        PyBuffer_Release(&key->view);
+}
+
+static PyObject *
+pycurve25519_makeprivate(PyObject *self, PyObject *const *args,
+                         Py_ssize_t nargs, PyObject *kwnames)
+{
+    static const char *const names[] = {"secret", "out"};
+    PyObject *argv[2], *result;
+    struct key secret;
+    Py_buffer view;
+    char *private;
+    if (parse_args("make_private", names, 1, 2, args, nargs, kwnames,
+                   argv) != 0 ||
+        key_get(&secret, argv[0]) != 0)
         return NULL;
+    result = output_get(argv[1], 32, &view, &private);
+    if (result) {
+        memmove(private, secret.data, 32);
+        private[0] &= 248;
+        private[31] &= 127;
+        private[31] |= 64;
+        output_release(&view);
     }
-    in1[0] &= 248;
-    in1[31] &= 127;
-    in1[31] |= 64;
-    return PyBytes_FromStringAndSize((char *)in1, 32);
+    key_release(&secret);
+    return result;
 }
+VARARGS_SHIM(pycurve25519_makeprivate)
 
 static PyObject *
-pycurve25519_makepublic(PyObject *self, PyObject *args)
+pycurve25519_makepublic(PyObject *self, PyObject *const *args,
+                        Py_ssize_t nargs, PyObject *kwnames)
 {
-    const char *private;
-    char mypublic[32];
+    static const char *const names[] = {"private", "out"};
+    PyObject *argv[2], *result;
+    struct key private;
+    Py_buffer view;
+    char *mypublic;
     char basepoint[32] = {9};
-    Py_ssize_t privatelen;
-    if (!PyArg_ParseTuple(args, y"#:makepublic", &private, &privatelen))
+    if (parse_args("make_public", names, 1, 2, args, nargs, kwnames,
+                   argv) != 0 ||
+        key_get(&private, argv[0]) != 0)
+        return NULL;
+    result = output_get(argv[1], 32, &view, &mypublic);
+    if (result) {
+        Py_BEGIN_ALLOW_THREADS
+        curve25519_donna(mypublic, private.data, basepoint);
+        Py_END_ALLOW_THREADS
+        output_release(&view);
+    }
+    key_release(&private);
+    return result;
+}
+VARARGS_SHIM(pycurve25519_makepublic)
+
+static PyObject *
+pycurve25519_makeshared(PyObject *self, PyObject *const *args,
+                        Py_ssize_t nargs, PyObject *kwnames)
+{
+    static const char *const names[] = {"private", "public", "out"};
+    PyObject *argv[3], *result;
+    struct key myprivate, theirpublic;
+    Py_buffer view;
+    char *shared_key;
+    if (parse_args("make_shared", names, 2, 3, args, nargs, kwnames,
+                   argv) != 0 ||
+        key_get(&myprivate, argv[0]) != 0)
+        return NULL;
+    if (key_get(&theirpublic, argv[1]) != 0) {
+        key_release(&myprivate);
+        return NULL;
+    }
+    result = output_get(argv[2], 32, &view, &shared_key);
+    if (result) {
+        Py_BEGIN_ALLOW_THREADS
+        curve25519_donna(shared_key, myprivate.data, theirpublic.data);
+        Py_END_ALLOW_THREADS
+        output_release(&view);
+    }
+    key_release(&theirpublic);
+    key_release(&myprivate);
+    return result;
+}
+VARARGS_SHIM(pycurve25519_makeshared)
+
+/* A batch of 32-byte keys taken either from one packed buffer (bytes,
+ * bytearray, memoryview, a numpy uint8 array of shape (n, 32), ...) or from
+ * a sequence of 32-byte buffers, which are copied into a packed array. */
+struct keys {
+    const char *data;
+    Py_ssize_t n;
+    Py_buffer view;
+    int has_view;
+    char *copy;
+};
+
+static int
+keys_get(struct keys *keys, PyObject *obj, const char *what)
+{
+    PyObject *seq;
+    Py_ssize_t i;
+
+    memset(keys, 0, sizeof(*keys));
+    if (PyObject_CheckBuffer(obj)) {
+        if (PyObject_GetBuffer(obj, &keys->view, PyBUF_SIMPLE) != 0)
+            return -1;
+        keys->has_view = 1;
+        if (keys->view.len % 32 != 0) {
+            PyErr_Format(PyExc_ValueError,
+                         "%s must be a multiple of 32 bytes long", what);
+            return -1;
+        }
+        keys->data = keys->view.buf;
+        keys->n = keys->view.len / 32;
+        return 0;
+    }
+
+    seq = PySequence_Fast(obj, "expected a buffer or a sequence of keys");
+    if (!seq)
+        return -1;
+#ifdef Py_GIL_DISABLED
+    /* Another thread may resize a list while we read it, so read a
+       snapshot, which PyList_AsTuple takes under the list's lock. */
+    if (PyList_Check(seq)) {
+        PyObject *snapshot = PyList_AsTuple(seq);
+        Py_DECREF(seq);
+        if (!snapshot)
+            return -1;
+        seq = snapshot;
+    }
+#endif
+    keys->n = PySequence_Fast_GET_SIZE(seq);
+    keys->copy = PyMem_Malloc(keys->n ? keys->n * 32 : 1);
+    if (!keys->copy) {
+        Py_DECREF(seq);
+        PyErr_NoMemory();
+        return -1;
+    }
+    for (i = 0; i < keys->n; i++) {
+        Py_buffer item;
+        if (PyObject_GetBuffer(PySequence_Fast_GET_ITEM(seq, i), &item,
+                               PyBUF_SIMPLE) != 0) {
+            Py_DECREF(seq);
+            return -1;
+        }
+        if (item.len != 32) {
+            PyBuffer_Release(&item);
+            Py_DECREF(seq);
+            PyErr_Format(PyExc_ValueError,
+                         "each of %s must be 32 bytes long", what);
+            return -1;
+        }
+        memcpy(keys->copy + i * 32, item.buf, 32);
+        PyBuffer_Release(&item);
+    }
+    Py_DECREF(seq);
+    keys->data = keys->copy;
+    return 0;
+}
+
+static void
+keys_release(struct keys *keys)
+{
+    if (keys->has_view)
+        PyBuffer_Release(&keys->view);
+    if (keys->copy) {
+        volatile char *p = keys->copy;
+        Py_ssize_t i;
+        for (i = 0; i < keys->n * 32; i++)
+            p[i] = 0;
+        PyMem_Free(keys->copy);
+    }
+}
+
+/* Runs fixed-base keygen on |n| packed private keys. Call without the GIL. */
+static void
+public_many(char *publics, const char *privates, Py_ssize_t n)
+{
+    char basepoints[BATCH * 32];
+    Py_ssize_t i, m;
+    memset(basepoints, 0, sizeof(basepoints));
+    for (i = 0; i < BATCH; i++)
+        basepoints[i * 32] = 9;
+    for (i = 0; i < n; i += m) {
+        m = n - i < BATCH ? n - i : BATCH;
+        curve25519_donna_batch(publics + i * 32, privates + i * 32,
+                               basepoints, m);
+    }
+}
+
+static PyObject *
+pycurve25519_makepublic_many(PyObject *self, PyObject *const *args,
+                             Py_ssize_t nargs, PyObject *kwnames)
+{
+    static const char *const names[] = {"privates", "out"};
+    PyObject *argv[2], *result;
+    struct keys keys;
+    Py_buffer view;
+    char *publics;
+    if (parse_args("make_public_many", names, 1, 2, args, nargs, kwnames,
+                   argv) != 0)
+        return NULL;
+    if (keys_get(&keys, argv[0], "privates") != 0) {
+        keys_release(&keys);
+        return NULL;
+    }
+    result = output_get(argv[1], keys.n * 32, &view, &publics);
+    if (!result) {
+        keys_release(&keys);
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    public_many(publics, keys.data, keys.n);
+    Py_END_ALLOW_THREADS
+    output_release(&view);
+    keys_release(&keys);
+    return result;
+}
+VARARGS_SHIM(pycurve25519_makepublic_many)
+
+static PyObject *
+pycurve25519_makeshared_many(PyObject *self, PyObject *const *args,
+                             Py_ssize_t nargs, PyObject *kwnames)
+{
+    static const char *const names[] = {"privates", "publics", "out"};
+    PyObject *argv[3], *result = NULL;
+    struct keys mine, theirs;
+    Py_buffer view;
+    char *shared_keys;
+    if (parse_args("make_shared_many", names, 2, 3, args, nargs, kwnames,
+                   argv) != 0)
+        return NULL;
+    if (keys_get(&mine, argv[0], "privates") != 0) {
+        keys_release(&mine);
         return NULL;
-    if (privatelen != 32) {
-        PyErr_SetString(PyExc_ValueError, "input must be 32-byte string");
+    }
+    if (keys_get(&theirs, argv[1], "publics") != 0) {
+        keys_release(&theirs);
+        keys_release(&mine);
         return NULL;
     }
-    curve25519_donna(mypublic, private, basepoint);
-    return PyBytes_FromStringAndSize((char *)mypublic, 32);
+    if (mine.n != theirs.n) {
+        PyErr_SetString(PyExc_ValueError,
+                        "need as many public keys as private keys");
+    } else {
+        result = output_get(argv[2], mine.n * 32, &view, &shared_keys);
+    }
+    if (result) {
+        Py_BEGIN_ALLOW_THREADS
+        curve25519_donna_batch(shared_keys, mine.data, theirs.data, mine.n);
+        Py_END_ALLOW_THREADS
+        output_release(&view);
+    }
+    keys_release(&theirs);
+    keys_release(&mine);
+    return result;
 }
+VARARGS_SHIM(pycurve25519_makeshared_many)
+
+/* make_shared and make_shared_many followed by hash_shared, without the
+ * raw shared secrets ever reaching Python. */
 
 static PyObject *
-pycurve25519_makeshared(PyObject *self, PyObject *args)
+pycurve25519_makeshared_hashed(PyObject *self, PyObject *const *args,
+                               Py_ssize_t nargs, PyObject *kwnames)
 {
-    const char *myprivate, *theirpublic;
+    static const char *const names[] = {"private", "public", "out"};
+    PyObject *argv[3], *result;
+    struct key myprivate, theirpublic;
+    Py_buffer view;
     char shared_key[32];
-    Py_ssize_t myprivatelen, theirpubliclen;
-    if (!PyArg_ParseTuple(args, y"#"y"#:generate",
-                          &myprivate, &myprivatelen, &theirpublic, &theirpubliclen))
+    char *hashed;
+    if (parse_args("make_shared_hashed", names, 2, 3, args, nargs, kwnames,
+                   argv) != 0 ||
+        key_get(&myprivate, argv[0]) != 0)
         return NULL;
-    if (myprivatelen != 32) {
-        PyErr_SetString(PyExc_ValueError, "input must be 32-byte string");
+    if (key_get(&theirpublic, argv[1]) != 0) {
+        key_release(&myprivate);
         return NULL;
     }
-    if (theirpubliclen != 32) {
-        PyErr_SetString(PyExc_ValueError, "input must be 32-byte string");
+    result = output_get(argv[2], 32, &view, &hashed);
+    if (result) {
+        Py_BEGIN_ALLOW_THREADS
+        curve25519_donna(shared_key, myprivate.data, theirpublic.data);
+        hash_shared(hashed, shared_key);
+        memset(shared_key, 0, 32);
+        Py_END_ALLOW_THREADS
+        output_release(&view);
+    }
+    key_release(&theirpublic);
+    key_release(&myprivate);
+    return result;
+}
+VARARGS_SHIM(pycurve25519_makeshared_hashed)
+
+static PyObject *
+pycurve25519_makeshared_hashed_many(PyObject *self, PyObject *const *args,
+                                    Py_ssize_t nargs, PyObject *kwnames)
+{
+    static const char *const names[] = {"privates", "publics", "out"};
+    PyObject *argv[3], *result = NULL;
+    struct keys mine, theirs;
+    Py_buffer view;
+    char shared_keys[BATCH * 32];
+    char *hashed;
+    Py_ssize_t i, j, n;
+    if (parse_args("make_shared_hashed_many", names, 2, 3, args, nargs, kwnames,
+                   argv) != 0)
+        return NULL;
+    if (keys_get(&mine, argv[0], "privates") != 0) {
+        keys_release(&mine);
         return NULL;
     }
-    curve25519_donna(shared_key, myprivate, theirpublic);
-    return PyBytes_FromStringAndSize((char *)shared_key, 32);
+    if (keys_get(&theirs, argv[1], "publics") != 0) {
+        keys_release(&theirs);
+        keys_release(&mine);
+        return NULL;
+    }
+    if (mine.n != theirs.n) {
+        PyErr_SetString(PyExc_ValueError,
+                        "need as many public keys as private keys");
+    } else {
+        result = output_get(argv[2], mine.n * 32, &view, &hashed);
+    }
+    if (result) {
+        Py_BEGIN_ALLOW_THREADS
+        for (i = 0; i < mine.n; i += n) {
+            n = mine.n - i < BATCH ? mine.n - i : BATCH;
+            curve25519_donna_batch(shared_keys, mine.data + i * 32,
+                                   theirs.data + i * 32, n);
+            for (j = 0; j < n; j++)
+                hash_shared(hashed + (i + j) * 32, shared_keys + j * 32);
+        }
+        memset(shared_keys, 0, sizeof(shared_keys));
+        Py_END_ALLOW_THREADS
+        output_release(&view);
+    }
+    keys_release(&theirs);
+    keys_release(&mine);
+    return result;
+}
+VARARGS_SHIM(pycurve25519_makeshared_hashed_many)
+
+/* hash_shared on its own, for shared secrets from make_shared_many. */
+static PyObject *
+pycurve25519_hash_shared_many(PyObject *self, PyObject *const *args,
+                              Py_ssize_t nargs, PyObject *kwnames)
+{
+    static const char *const names[] = {"shareds", "out"};
+    PyObject *argv[2], *result;
+    struct keys shareds;
+    Py_buffer view;
+    char *hashed;
+    Py_ssize_t i;
+    if (parse_args("hash_shared_many", names, 1, 2, args, nargs, kwnames,
+                   argv) != 0)
+        return NULL;
+    if (keys_get(&shareds, argv[0], "shareds") != 0) {
+        keys_release(&shareds);
+        return NULL;
+    }
+    result = output_get(argv[1], shareds.n * 32, &view, &hashed);
+    if (result) {
+        Py_BEGIN_ALLOW_THREADS
+        for (i = 0; i < shareds.n; i++)
+            hash_shared(hashed + i * 32, shareds.data + i * 32);
+        Py_END_ALLOW_THREADS
+        output_release(&view);
+    }
+    keys_release(&shareds);
+    return result;
 }
+VARARGS_SHIM(pycurve25519_hash_shared_many)
 
+/* Fills |buf| from the kernel's CSPRNG without needing the GIL, where
+ * there's a call for it; elsewhere generate_keypairs asks os.urandom. */
+#if defined(__linux__)
+    #include <errno.h>
+    #include <sys/random.h>
+    #define HAVE_FILL_RANDOM
+
+    static int
+    fill_random(char *buf, Py_ssize_t len)
+    {
+        ssize_t got;
+        while (len > 0) {
+            got = getrandom(buf, len, 0);
+            if (got < 0) {
+                if (errno == EINTR)
+                    continue;
+                return -1;
+            }
+            buf += got;
+            len -= got;
+        }
+        return 0;
+    }
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || \
+      defined(__NetBSD__)
+    #include <stdlib.h>
+    #define HAVE_FILL_RANDOM
+
+    static int
+    fill_random(char *buf, Py_ssize_t len)
+    {
+        arc4random_buf(buf, len);
+        return 0;
+    }
+#endif
+
+static PyObject *
+pycurve25519_generate_keypairs(PyObject *self, PyObject *const *args,
+                               Py_ssize_t nargs, PyObject *kwnames)
+{
+    static const char *const names[] = {"n"};
+    PyObject *argv[1], *privates, *publics;
+    Py_ssize_t n, i;
+    char *private;
+    int failed = 0;
+    if (parse_args("generate_keypairs", names, 1, 1, args, nargs, kwnames,
+                   argv) != 0)
+        return NULL;
+    n = PyNumber_AsSsize_t(argv[0], PyExc_OverflowError);
+    if (n == -1 && PyErr_Occurred())
+        return NULL;
+    if (n < 0 || n > PY_SSIZE_T_MAX / 32) {
+        PyErr_SetString(PyExc_ValueError, "n out of range");
+        return NULL;
+    }
+    privates = PyBytes_FromStringAndSize(NULL, n * 32);
+    publics = PyBytes_FromStringAndSize(NULL, n * 32);
+    if (!privates || !publics)
+        goto fail;
+    private = PyBytes_AS_STRING(privates);
+
+#ifndef HAVE_FILL_RANDOM
+    {
+        PyObject *os = PyImport_ImportModule("os"), *random;
+        random = os ? PyObject_CallMethod(os, "urandom", "n", n * 32) : NULL;
+        Py_XDECREF(os);
+        if (!random)
+            goto fail;
+        memcpy(private, PyBytes_AS_STRING(random), n * 32);
+        Py_DECREF(random);
+    }
+#endif
+
+    Py_BEGIN_ALLOW_THREADS
+#ifdef HAVE_FILL_RANDOM
+    failed = fill_random(private, n * 32);
+#endif
+    if (!failed) {
+        for (i = 0; i < n; i++) {
+            private[i * 32] &= 248;
+            private[i * 32 + 31] &= 127;
+            private[i * 32 + 31] |= 64;
+        }
+        public_many(PyBytes_AS_STRING(publics), private, n);
+    }
+    Py_END_ALLOW_THREADS
+    if (failed) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        goto fail;
+    }
+    return Py_BuildValue("(NN)", privates, publics);
+
+fail:
+    Py_XDECREF(privates);
+    Py_XDECREF(publics);
+    return NULL;
+}
+VARARGS_SHIM(pycurve25519_generate_keypairs)
+
+#if defined(CURVE25519_ASYNC) && PY_VERSION_HEX >= 0x03070000
+#include <unistd.h>
+#include "curve25519-async.h"
+
+/* A native worker pool for event loops. Callers submit whole batches with
+ * an opaque token and get (token, packed results) back from reap() once
+ * every key of a batch is done; fileno() becomes readable when there is
+ * something to reap, so a loop can watch it like a socket. Ladders run on
+ * the pool's own threads, through curve25519_donna_batch, without the GIL.
+ * Batches larger than the pool's rings wait in a queue here. */
+
+struct request {
+    PyObject *token;
+    PyObject *result;     /* bytes, filled in by the workers */
+    char *inputs;         /* copies of the privates, then the publics */
+    int public_only;
+    Py_ssize_t n, submitted, remaining;
+    struct request *next;
+};
+
+typedef struct {
+    PyObject_HEAD
+    struct curve25519_async *pool;
+    unsigned capacity, in_flight;
+    struct request *queue_head, *queue_tail;  /* not fully submitted yet */
+    struct request *running;                  /* fully submitted */
+} PoolObject;
+
+#ifdef Py_GIL_DISABLED
+    #define POOL_LOCK(self) Py_BEGIN_CRITICAL_SECTION(self)
+    #define POOL_UNLOCK() Py_END_CRITICAL_SECTION()
+#else
+    #define POOL_LOCK(self) {
+    #define POOL_UNLOCK() }
+#endif
+
+static void
+request_free(struct request *r)
+{
+    volatile char *p = r->inputs;
+    Py_ssize_t i;
+    for (i = 0; i < r->n * 64; i++)
+        p[i] = 0;
+    PyMem_Free(r->inputs);
+    Py_XDECREF(r->token);
+    Py_XDECREF(r->result);
+    PyMem_Free(r);
+}
+
+/* Feeds queued requests to the workers while the rings have room. */
+static void
+pool_pump(PoolObject *self)
+{
+    struct curve25519_async_sqe sqe;
+    struct request *r;
+
+    while ((r = self->queue_head) != NULL && self->in_flight < self->capacity) {
+        const Py_ssize_t i = r->submitted;
+        sqe.op = CURVE25519_ASYNC_OP_DH;
+        sqe.secret = (uint8_t *) r->inputs + i * 32;
+        sqe.basepoint =
+            r->public_only ? NULL : (uint8_t *) r->inputs + (r->n + i) * 32;
+        sqe.out = (uint8_t *) PyBytes_AS_STRING(r->result) + i * 32;
+        sqe.user_data = (uintptr_t) r;
+        if (curve25519_async_submit(self->pool, &sqe) != 0)
+            break;
+        self->in_flight++;
+        if (++r->submitted == r->n) {
+            self->queue_head = r->next;
+            if (!self->queue_head)
+                self->queue_tail = NULL;
+            r->next = self->running;
+            self->running = r;
+        }
+    }
+}
+
+static PyObject *
+pool_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"workers", "entries", NULL};
+    Py_ssize_t workers = 1, entries = 1024;
+    PoolObject *self;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|nn:Pool", kwlist,
+                                     &workers, &entries))
+        return NULL;
+    if (workers < 1 || (size_t) workers > UINT_MAX) {
+        PyErr_Format(PyExc_ValueError, "workers must be between 1 and %u",
+                     UINT_MAX);
+        return NULL;
+    }
+    if (entries < 1 || entries > (1 << 30)) {
+        PyErr_Format(PyExc_ValueError, "entries must be between 1 and %d",
+                     1 << 30);
+        return NULL;
+    }
+    self = (PoolObject *) type->tp_alloc(type, 0);
+    if (!self)
+        return NULL;
+    self->pool = curve25519_async_new((unsigned) workers, (unsigned) entries);
+    if (!self->pool) {
+        Py_DECREF(self);
+        return PyErr_Format(PyExc_OSError, "cannot start %zd workers",
+                            workers);
+    }
+    self->capacity = (unsigned) entries;
+    return (PyObject *) self;
+}
+
+static void
+pool_clear(PoolObject *self)
+{
+    struct request *r;
+    /* Joins the workers, so nothing writes to the requests after this. */
+    curve25519_async_free(self->pool);
+    self->pool = NULL;
+    while ((r = self->queue_head) != NULL) {
+        self->queue_head = r->next;
+        request_free(r);
+    }
+    while ((r = self->running) != NULL) {
+        self->running = r->next;
+        request_free(r);
+    }
+    self->queue_tail = NULL;
+    self->in_flight = 0;
+}
+
+/* Tokens are arbitrary objects and may refer back to the pool. */
+static int
+pool_traverse(PoolObject *self, visitproc visit, void *arg)
+{
+    struct request *r;
+#if PY_VERSION_HEX >= 0x03090000
+    Py_VISIT(Py_TYPE(self));
+#endif
+    for (r = self->queue_head; r; r = r->next)
+        Py_VISIT(r->token);
+    for (r = self->running; r; r = r->next)
+        Py_VISIT(r->token);
+    return 0;
+}
+
+static int
+pool_tp_clear(PoolObject *self)
+{
+    pool_clear(self);
+    return 0;
+}
+
+static void
+pool_dealloc(PoolObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+    PyObject_GC_UnTrack(self);
+    pool_clear(self);
+    type->tp_free((PyObject *) self);
+#if PY_VERSION_HEX >= 0x03080000
+    Py_DECREF(type);
+#endif
+}
+
+static PyObject *
+pool_close(PoolObject *self, PyObject *unused)
+{
+    POOL_LOCK(self)
+    pool_clear(self);
+    POOL_UNLOCK()
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+pool_fileno(PoolObject *self, PyObject *unused)
+{
+    if (!self->pool) {
+        PyErr_SetString(PyExc_ValueError, "pool is closed");
+        return NULL;
+    }
+    return PyLong_FromLong(curve25519_async_fd(self->pool));
+}
+
+static PyObject *
+pool_submit(PoolObject *self, PyObject *const *args, Py_ssize_t nargs)
+{
+    PyObject *token, *privates, *publics;
+    struct keys mine, theirs;
+    struct request *r = NULL;
+    int ok = 0;
+    if (nargs != 3) {
+        PyErr_SetString(PyExc_TypeError,
+                        "submit() takes token, privates and publics");
+        return NULL;
+    }
+    token = args[0];
+    privates = args[1];
+    publics = args[2];
+    if (!self->pool) {
+        PyErr_SetString(PyExc_ValueError, "pool is closed");
+        return NULL;
+    }
+    memset(&theirs, 0, sizeof(theirs));
+    if (keys_get(&mine, privates, "privates") != 0 ||
+        (publics != Py_None && keys_get(&theirs, publics, "publics") != 0))
+        goto done;
+    if (publics != Py_None && mine.n != theirs.n) {
+        PyErr_SetString(PyExc_ValueError,
+                        "need as many public keys as private keys");
+        goto done;
+    }
+    r = PyMem_Calloc(1, sizeof(*r));
+    if (!r || !(r->inputs = PyMem_Malloc(mine.n ? mine.n * 64 : 1))) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    r->n = r->remaining = mine.n;
+    r->result = PyBytes_FromStringAndSize(NULL, mine.n * 32);
+    if (!r->result)
+        goto done;
+    memcpy(r->inputs, mine.data, mine.n * 32);
+    if (publics == Py_None)
+        r->public_only = 1;
+    else
+        memcpy(r->inputs + mine.n * 32, theirs.data, mine.n * 32);
+    Py_INCREF(token);
+    r->token = token;
+
+    /* keys_get can run Python code (a generator, a buffer exporter) that
+     * closes the pool, and on free-threaded builds another thread can:
+     * check again under the lock. */
+    POOL_LOCK(self)
+    if (!self->pool) {
+        /* Freed below. */
+    } else if (r->n == 0) {
+        const uint64_t one = 1;
+        /* Nothing for the workers to do: complete it at the next reap. */
+        r->next = self->running;
+        self->running = r;
+        if (write(curve25519_async_fd(self->pool), &one, sizeof(one)) < 0) {
+            /* Counter overflow: it's readable anyway. */
+        }
+    } else {
+        if (self->queue_tail)
+            self->queue_tail->next = r;
+        else
+            self->queue_head = r;
+        self->queue_tail = r;
+        pool_pump(self);
+    }
+    ok = self->pool != NULL;
+    POOL_UNLOCK()
+    if (!ok)
+        PyErr_SetString(PyExc_ValueError, "pool is closed");
+
+done:
+    keys_release(&theirs);
+    keys_release(&mine);
+    if (!ok) {
+        if (r)
+            request_free(r);
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+pool_reap(PoolObject *self, PyObject *unused)
+{
+    struct curve25519_async_cqe cqes[64];
+    struct request *r, **link, *finished = NULL, **tail = &finished;
+    PyObject *done = PyList_New(0);
+    uint64_t counter;
+    unsigned i, n;
+    if (!done)
+        return NULL;
+
+    POOL_LOCK(self)
+    if (!self->pool)
+        goto unlock;
+    if (read(curve25519_async_fd(self->pool), &counter, sizeof(counter)) < 0) {
+        /* Spurious wakeup. */
+    }
+    while ((n = curve25519_async_reap(self->pool, cqes, 64)) > 0) {
+        for (i = 0; i < n; i++) {
+            r = (struct request *) (uintptr_t) cqes[i].user_data;
+            r->remaining--;
+        }
+        self->in_flight -= n;
+    }
+    /* Take whatever is finished off |running|, then hand it back. If
+     * building the list fails, it all goes back on |running| for the next
+     * reap. */
+    link = &self->running;
+    while ((r = *link) != NULL) {
+        if (r->remaining) {
+            link = &r->next;
+            continue;
+        }
+        *link = r->next;
+        r->next = NULL;
+        *tail = r;
+        tail = &r->next;
+    }
+    for (r = finished; r; r = r->next) {
+        PyObject *item = PyTuple_Pack(2, r->token, r->result);
+        if (!item || PyList_Append(done, item) != 0) {
+            Py_XDECREF(item);
+            Py_CLEAR(done);
+            break;
+        }
+        Py_DECREF(item);
+    }
+    while ((r = finished) != NULL) {
+        finished = r->next;
+        if (done) {
+            request_free(r);
+        } else {
+            r->next = self->running;
+            self->running = r;
+        }
+    }
+    pool_pump(self);
+unlock:
+    POOL_UNLOCK()
+    return done;
+}
+
+static PyMethodDef
+pool_methods[] = {
+    {"submit", (PyCFunction)(void (*)(void))pool_submit, METH_FASTCALL,
+     "submit(token, privates, publics or None): queue a batch"},
+    {"reap", (PyCFunction)pool_reap, METH_NOARGS,
+     "reap() -> [(token, packed results), ...] for finished batches"},
+    {"fileno", (PyCFunction)pool_fileno, METH_NOARGS,
+     "fd that becomes readable when there is something to reap"},
+    {"close", (PyCFunction)pool_close, METH_NOARGS,
+     "stop the workers and drop unfinished batches"},
+    {NULL, NULL, 0, NULL},
+};
+
+static PyType_Slot
+pool_slots[] = {
+    {Py_tp_doc, "Pool(workers=1, entries=1024): native worker pool"},
+    {Py_tp_new, pool_new},
+    {Py_tp_dealloc, pool_dealloc},
+    {Py_tp_traverse, pool_traverse},
+    {Py_tp_clear, pool_tp_clear},
+    {Py_tp_methods, pool_methods},
+    {0, NULL},
+};
+
+static PyType_Spec
+pool_spec = {
+    "_curve25519.Pool",
+    sizeof(PoolObject),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+    pool_slots,
+};
+#endif
 
 static PyMethodDef
 curve25519_functions[] = {
-    {"make_private", pycurve25519_makeprivate, METH_VARARGS, "data->private"},
-    {"make_public", pycurve25519_makepublic, METH_VARARGS, "private->public"},
-    {"make_shared", pycurve25519_makeshared, METH_VARARGS, "private+public->shared"},
+    {"make_private", FASTCALL(pycurve25519_makeprivate), "data->private"},
+    {"make_public", FASTCALL(pycurve25519_makepublic), "private->public"},
+    {"make_shared", FASTCALL(pycurve25519_makeshared),
+     "private+public->shared"},
+    {"make_public_many", FASTCALL(pycurve25519_makepublic_many),
+     "privates->packed publics"},
+    {"make_shared_many", FASTCALL(pycurve25519_makeshared_many),
+     "privates+publics->packed shareds"},
+    {"make_shared_hashed", FASTCALL(pycurve25519_makeshared_hashed),
+     "private+public->sha256 of shared"},
+    {"make_shared_hashed_many", FASTCALL(pycurve25519_makeshared_hashed_many),
+     "privates+publics->packed hashed shareds"},
+    {"hash_shared_many", FASTCALL(pycurve25519_hash_shared_many),
+     "packed shareds->packed hashed shareds"},
+    {"generate_keypairs", FASTCALL(pycurve25519_generate_keypairs),
+     "n->(packed privates, packed publics)"},
     {NULL, NULL, 0, NULL},
 };
 
 #if PY_MAJOR_VERSION >= 3
+    static int
+    curve25519_exec(PyObject *module)
+    {
+        if (PyModule_AddStringConstant(module, "backend",
+                                       CURVE25519_BACKEND) != 0)
+            return -1;
+    #if defined(CURVE25519_ASYNC) && PY_VERSION_HEX >= 0x03070000
+        PyObject *pool_type = PyType_FromSpec(&pool_spec);
+        if (!pool_type)
+            return -1;
+        if (PyModule_AddObject(module, "Pool", pool_type) != 0) {
+            Py_DECREF(pool_type);
+            return -1;
+        }
+    #endif
+        return 0;
+    }
+
+    /* The module keeps no state outside its own objects, and the ladders
+     * only touch their own arguments, so it needs no GIL on free-threaded
+     * builds and can be loaded into any number of subinterpreters. */
+    static PyModuleDef_Slot
+    curve25519_slots[] = {
+        {Py_mod_exec, curve25519_exec},
+    #ifdef Py_mod_multiple_interpreters
+        {Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED},
+    #endif
+    #ifdef Py_mod_gil
+        {Py_mod_gil, Py_MOD_GIL_NOT_USED},
+    #endif
+        {0, NULL},
+    };
+
     static struct PyModuleDef
     curve25519_module = {
         PyModuleDef_HEAD_INIT,
         "_curve25519",
         NULL,
-        NULL,
+        0,
         curve25519_functions,
+        curve25519_slots,
     };
 
-    PyObject *
+    PyMODINIT_FUNC
     PyInit__curve25519(void)
     {
-        return PyModule_Create(&curve25519_module);
+        return PyModuleDef_Init(&curve25519_module);
     }
 #else
     PyMODINIT_FUNC
     init_curve25519(void)
     {
-          (void)Py_InitModule("_curve25519", curve25519_functions);
+          PyObject *module = Py_InitModule("_curve25519",
+                                           curve25519_functions);
+          if (module)
+              PyModule_AddStringConstant(module, "backend",
+                                         CURVE25519_BACKEND);
     }
-#endif
\ No newline at end of file
+#endif
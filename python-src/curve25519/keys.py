@@ -1,4 +1,12 @@
-from . import _curve25519
+import platform
+if platform.python_implementation() == "PyPy":
+    # cffi calls are far cheaper than cpyext ones there; see _cffi.py
+    try:
+        from . import _cffi as _curve25519
+    except ImportError:
+        from . import _curve25519
+else:
+    from . import _curve25519
 from hashlib import sha256
 import os
 
@@ -32,10 +40,49 @@ class Private:
         if not isinstance(public, Public):
             raise ValueError("'public' must be an instance of Public")
         if hashfunc is None:
-            hashfunc = _hash_shared
+            # DH and _hash_shared in a single native call
+            return _curve25519.make_shared_hashed(self.private, public.public)
         shared = _curve25519.make_shared(self.private, public.public)
         return hashfunc(shared)
 
+    # awaitable versions, which run the ladder off the event loop (see aio.py)
+
+    def get_public_async(self):
+        from . import aio
+        return aio.get_public(self)
+
+    def get_shared_key_async(self, public, hashfunc=None):
+        if not isinstance(public, Public):
+            raise ValueError("'public' must be an instance of Public")
+        from . import aio
+        return aio.get_shared_key(self, public, hashfunc)
+
+class Keypairs:
+    """A batch of keypairs from generate_keypairs(). The keys are held as two
+    packed buffers, .privates and .publics (32 bytes per key); indexing or
+    iterating makes (Private, Public) pairs only as they're asked for."""
+
+    def __init__(self, privates, publics):
+        self.privates = privates
+        self.publics = publics
+
+    def __len__(self):
+        return len(self.privates) // 32
+
+    def __getitem__(self, i):
+        if i < 0:
+            i += len(self)
+        if not 0 <= i < len(self):
+            raise IndexError("keypair index out of range")
+        private = Private.__new__(Private)
+        private.private = self.privates[32*i:32*i+32]
+        return private, Public(self.publics[32*i:32*i+32])
+
+def generate_keypairs(n):
+    """Makes n random keypairs at once. The randomness, clamping and public
+    key derivation all happen in one native call, without the GIL."""
+    return Keypairs(*_curve25519.generate_keypairs(n))
+
 class Public:
     def __init__(self, public):
         assert isinstance(public, bytes)
@@ -0,0 +1,47 @@
+#! /usr/bin/python
+
+# Measures how much key agreement delays an asyncio event loop. A ticker
+# coroutine asks to wake every millisecond and records how late it is, while
+# client coroutines each compute a run of shared keys, either directly on the
+# loop or awaited through the native worker pool.
+
+import asyncio
+from time import perf_counter
+from curve25519 import Private, aio
+
+clients = 16
+per_client = 200
+tick = 0.001
+
+async def ticker(lags, stop):
+    while not stop.is_set():
+        start = perf_counter()
+        await asyncio.sleep(tick)
+        lags.append(perf_counter() - start - tick)
+
+async def client_inline(priv, pub):
+    for i in range(per_client):
+        priv.get_shared_key(pub)
+        await asyncio.sleep(0)
+
+async def client_async(priv, pub):
+    for i in range(per_client):
+        await priv.get_shared_key_async(pub)
+
+async def run(client):
+    pairs = [(Private(), Private().get_public()) for i in range(clients)]
+    lags, stop = [], asyncio.Event()
+    t = asyncio.ensure_future(ticker(lags, stop))
+    start = perf_counter()
+    await asyncio.gather(*[client(priv, pub) for priv, pub in pairs])
+    elapsed = perf_counter() - start
+    stop.set()
+    await t
+    lags.sort()
+    return (clients * per_client / elapsed, lags[len(lags) // 2],
+            lags[len(lags) * 99 // 100], lags[-1])
+
+for name, client in [("inline", client_inline), ("async", client_async)]:
+    rate, p50, p99, worst = asyncio.run(run(client))
+    print("%-6s: %6.0f keys/s, loop lag p50 %7.1fus p99 %7.1fus max %7.1fus"
+          % (name, rate, p50 * 1e6, p99 * 1e6, worst * 1e6))
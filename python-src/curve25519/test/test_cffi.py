@@ -0,0 +1,37 @@
+#! /usr/bin/python
+
+# Per-call overhead of the cffi binding next to the extension module. Run it
+# under both CPython and PyPy: keys.py uses the extension on CPython and the
+# cffi binding on PyPy, where every extension call goes through cpyext.
+# make_private and make_public_many([]) do no curve arithmetic, so their time
+# per call is all binding.
+
+import platform
+from timeit import timeit
+from curve25519 import _curve25519
+from curve25519 import _cffi
+
+secret = b"abcdefghijklmnopqrstuvwxyz123456"
+private = _curve25519.make_private(secret)
+public = _curve25519.make_public(private)
+out = bytearray(32)
+count = 200000
+ladders = 2000
+
+def per_call(stmt, n):
+    return timeit(stmt, globals=globals(), number=n) / n
+
+print("%s %s, %s" % (platform.python_implementation(),
+                     platform.python_version(), _cffi.backend))
+print("%-24s %12s %12s" % ("", "extension", "cffi"))
+for label, call, n, unit, scale in [
+        ("make_private", "make_private(secret)", count, "ns", 1e9),
+        ("make_private(out=)", "make_private(secret, out=out)", count,
+         "ns", 1e9),
+        ("make_public_many([])", "make_public_many(b'')", count, "ns", 1e9),
+        ("make_shared", "make_shared(private, public)", ladders, "us", 1e6),
+        ("make_shared_hashed", "make_shared_hashed(private, public)",
+         ladders, "us", 1e6)]:
+    print("%-24s %9.1f %s %9.1f %s"
+          % (label, per_call("_curve25519." + call, n) * scale, unit,
+             per_call("_cffi." + call, n) * scale, unit))
@@ -1,8 +1,9 @@
 #! /usr/bin/python
 
+import sys
 import unittest
 
-from curve25519 import Private, Public
+from curve25519 import Private, Public, generate_keypairs, _curve25519
 from hashlib import sha1, sha256
 from binascii import hexlify
 
@@ -93,6 +94,242 @@ class Basic(unittest.TestCase):
         self.assertEqual(shared_hexhash,
                              b"80eec98222c8edc4324fb9477a3c775ce7c6c93a")
 
+    def test_many(self):
+        privs = [Private(seed=b"many%d" % i) for i in range(100)]
+        pubs = [Private(seed=b"peer%d" % i).get_public() for i in range(100)]
+        secrets = [p.serialize() for p in privs]
+        peers = [p.serialize() for p in pubs]
+        packed = b"".join(secrets)
+
+        expected = b"".join(p.get_public().serialize() for p in privs)
+        self.assertEqual(_curve25519.make_public_many(secrets), expected)
+        self.assertEqual(_curve25519.make_public_many(packed), expected)
+        self.assertEqual(_curve25519.make_public_many(bytearray(packed)),
+                         expected)
+
+        expected = b"".join(_curve25519.make_shared(s, p)
+                            for s, p in zip(secrets, peers))
+        self.assertEqual(_curve25519.make_shared_many(secrets, peers),
+                         expected)
+        self.assertEqual(_curve25519.make_shared_many(packed, b"".join(peers)),
+                         expected)
+        self.assertEqual(_curve25519.make_shared_many(tuple(secrets),
+                                                      memoryview(b"".join(peers))),
+                         expected)
+
+        self.assertEqual(_curve25519.make_public_many([]), b"")
+        self.assertEqual(_curve25519.make_shared_many(b"", b""), b"")
+        self.assertRaises(ValueError, _curve25519.make_public_many, b"x"*33)
+        self.assertRaises(ValueError, _curve25519.make_public_many, [b"short"])
+        self.assertRaises(ValueError, _curve25519.make_shared_many,
+                          secrets, peers[:-1])
+        self.assertRaises(TypeError, _curve25519.make_public_many, 123)
+
+    def test_buffers(self):
+        secret = b"abcdefghijklmnopqrstuvwxyz123456"
+        private = _curve25519.make_private(secret)
+        public = _curve25519.make_public(private)
+        peer = Private(seed=b"peer").get_public().serialize()
+        shared = _curve25519.make_shared(private, peer)
+
+        # make_private leaves its input alone
+        self.assertEqual(secret, b"abcdefghijklmnopqrstuvwxyz123456")
+        buf = bytearray(secret)
+        self.assertEqual(_curve25519.make_private(buf), private)
+        self.assertEqual(buf, bytearray(secret))
+        # ...unless asked to clamp in place
+        self.assertTrue(_curve25519.make_private(buf, out=buf) is buf)
+        self.assertEqual(bytes(buf), private)
+
+        self.assertEqual(_curve25519.make_public(memoryview(private)), public)
+        self.assertEqual(_curve25519.make_shared(bytearray(private),
+                                                 memoryview(peer)), shared)
+        out = bytearray(32)
+        self.assertTrue(_curve25519.make_public(private, out=out) is out)
+        self.assertEqual(bytes(out), public)
+        _curve25519.make_shared(private, peer, out=memoryview(out))
+        self.assertEqual(bytes(out), shared)
+
+        self.assertRaises(ValueError, _curve25519.make_public, private,
+                          out=bytearray(31))
+        self.assertRaises(BufferError, _curve25519.make_public, private,
+                          out=b"\x00"*32)
+        self.assertRaises(ValueError, _curve25519.make_public, bytearray(31))
+
+        # keyword errors name the keyword
+        with self.assertRaises(TypeError) as cm:
+            _curve25519.make_public(private, output=out)
+        self.assertIn("'output'", str(cm.exception))
+        with self.assertRaises(TypeError) as cm:
+            _curve25519.make_shared(private, peer, public=peer)
+        self.assertIn("'public'", str(cm.exception))
+
+        # a 2-D buffer, as a numpy array of shape (n, 32) would give
+        privs = [Private(seed=b"buf%d" % i).serialize() for i in range(10)]
+        grid = memoryview(bytearray(b"".join(privs))).cast("B", (10, 32))
+        out = bytearray(10 * 32)
+        self.assertTrue(_curve25519.make_public_many(grid, out=out) is out)
+        self.assertEqual(bytes(out), _curve25519.make_public_many(privs))
+        _curve25519.make_shared_many([bytearray(p) for p in privs],
+                                     [public] * 10, out=out)
+        self.assertEqual(bytes(out), b"".join(_curve25519.make_shared(p, public)
+                                              for p in privs))
+        self.assertRaises(ValueError, _curve25519.make_public_many, privs,
+                          out=bytearray(32))
+
+    def test_hashed(self):
+        def hashed(shared_key):
+            return sha256(b"curve25519-shared:"+shared_key).digest()
+        secrets = [Private(seed=b"h%d" % i).serialize() for i in range(70)]
+        peers = [Private(seed=b"p%d" % i).get_public().serialize()
+                 for i in range(70)]
+        expected = [hashed(_curve25519.make_shared(s, p))
+                    for s, p in zip(secrets, peers)]
+        self.assertEqual(_curve25519.make_shared_hashed(secrets[0], peers[0]),
+                         expected[0])
+        self.assertEqual(_curve25519.make_shared_hashed_many(secrets, peers),
+                         b"".join(expected))
+        out = bytearray(70 * 32)
+        _curve25519.make_shared_hashed_many(b"".join(secrets),
+                                            b"".join(peers), out=out)
+        self.assertEqual(bytes(out), b"".join(expected))
+        self.assertEqual(_curve25519.make_shared_hashed_many([], []), b"")
+        shareds = [_curve25519.make_shared(s, p)
+                   for s, p in zip(secrets, peers)]
+        self.assertEqual(_curve25519.hash_shared_many(shareds),
+                         b"".join(expected))
+        self.assertEqual(_curve25519.hash_shared_many(b"".join(shareds)),
+                         b"".join(expected))
+        self.assertEqual(_curve25519.hash_shared_many([]), b"")
+
+    def test_generate_keypairs(self):
+        pairs = generate_keypairs(100)
+        self.assertEqual(len(pairs), 100)
+        self.assertEqual(len(pairs.privates), 100 * 32)
+        self.assertEqual(len(pairs.publics), 100 * 32)
+        seen = set()
+        for priv, pub in pairs:
+            self.assertEqual(_curve25519.make_private(priv.serialize()),
+                             priv.serialize())
+            self.assertEqual(priv.get_public().serialize(), pub.serialize())
+            seen.add(priv.serialize())
+        self.assertEqual(len(seen), 100)
+        priv, pub = pairs[-1]
+        self.assertEqual(pub.serialize(), pairs.publics[-32:])
+        self.assertRaises(IndexError, lambda: pairs[100])
+
+        self.assertEqual(len(generate_keypairs(0)), 0)
+        self.assertRaises(ValueError, _curve25519.generate_keypairs, -1)
+        self.assertRaises(TypeError, _curve25519.generate_keypairs, "10")
+
+    def test_cffi(self):
+        try:
+            from curve25519 import _cffi
+        except ImportError:
+            raise unittest.SkipTest("cffi binding not built")
+        secrets = [Private(seed=b"cffi%d" % i).serialize() for i in range(70)]
+        peers = [Private(seed=b"peer%d" % i).get_public().serialize()
+                 for i in range(70)]
+        raw = b"abcdefghijklmnopqrstuvwxyz123456"
+        self.assertEqual(_cffi.make_private(raw), _curve25519.make_private(raw))
+        self.assertEqual(_cffi.make_public(secrets[0]),
+                         _curve25519.make_public(secrets[0]))
+        for name in ("make_shared", "make_shared_hashed"):
+            self.assertEqual(getattr(_cffi, name)(secrets[0], peers[0]),
+                             getattr(_curve25519, name)(secrets[0], peers[0]))
+        self.assertEqual(_cffi.make_public_many(secrets),
+                         _curve25519.make_public_many(secrets))
+        for name in ("make_shared_many", "make_shared_hashed_many"):
+            self.assertEqual(getattr(_cffi, name)(b"".join(secrets), peers),
+                             getattr(_curve25519, name)(secrets, peers))
+        shareds = _curve25519.make_shared_many(secrets, peers)
+        self.assertEqual(_cffi.hash_shared_many(shareds),
+                         _curve25519.hash_shared_many(shareds))
+
+        out = bytearray(32)
+        self.assertTrue(_cffi.make_public(secrets[0], out=out) is out)
+        self.assertEqual(bytes(out), _curve25519.make_public(secrets[0]))
+        self.assertRaises(ValueError, _cffi.make_public, bytearray(31))
+        self.assertRaises(ValueError, _cffi.make_shared_many,
+                          secrets, peers[:-1])
+        self.assertRaises(BufferError, _cffi.make_public, secrets[0],
+                          out=b"\x00"*32)
+
+        privates, publics = _cffi.generate_keypairs(10)
+        self.assertEqual(_curve25519.make_public_many(privates), publics)
+        self.assertEqual(_cffi.generate_keypairs(0), (b"", b""))
+
+    @unittest.skipIf(sys.version_info < (3, 7), "needs asyncio.run")
+    def test_async(self):
+        import asyncio
+        from curve25519 import aio
+        privs = [Private(seed=b"async%d" % i) for i in range(20)]
+        pubs = [Private(seed=b"peer%d" % i).get_public() for i in range(20)]
+        expected = [p.get_shared_key(q) for p, q in zip(privs, pubs)]
+
+        run = asyncio.run
+        self.assertEqual(run(privs[0].get_shared_key_async(pubs[0])),
+                         expected[0])
+        self.assertEqual(run(privs[0].get_public_async()).serialize(),
+                         privs[0].get_public().serialize())
+        self.assertEqual(run(aio.get_shared_keys(privs, pubs)), expected)
+        self.assertEqual(run(aio.get_shared_keys([], [])), [])
+        self.assertEqual(run(aio.make_public_many(
+            [p.serialize() for p in privs])),
+            b"".join(p.get_public().serialize() for p in privs))
+        self.assertRaises(ValueError, privs[0].get_shared_key_async, privs[1])
+
+        # many batches in flight at once, more keys than the pool's rings
+        loop = asyncio.new_event_loop()
+        try:
+            asyncio.set_event_loop(loop)
+            results = loop.run_until_complete(asyncio.gather(
+                *[aio.get_shared_keys(privs * 60, pubs * 60) for i in range(3)]))
+        finally:
+            asyncio.set_event_loop(None)
+            loop.close()
+        for result in results:
+            self.assertEqual(result, expected * 60)
+
+    @unittest.skipIf(not hasattr(_curve25519, "Pool"), "no native pool")
+    def test_pool_cycle(self):
+        import gc, weakref
+        class Token(object):
+            pass
+        # a token that refers back to its pool, as a future does through
+        # its callbacks
+        token = Token()
+        token.pool = _curve25519.Pool()
+        token.pool.submit(token, b"", None)
+        alive = weakref.ref(token)
+        del token
+        gc.collect()
+        self.assertIsNone(alive())
+
+    @unittest.skipIf(not hasattr(_curve25519, "Pool"), "no native pool")
+    def test_pool_arguments(self):
+        for kwargs, name in [({"workers": 0}, "workers"),
+                             ({"workers": -1}, "workers"),
+                             ({"entries": 0}, "entries"),
+                             ({"entries": 2 ** 31}, "entries")]:
+            with self.assertRaises(ValueError) as cm:
+                _curve25519.Pool(**kwargs)
+            self.assertIn(name, str(cm.exception))
+        _curve25519.Pool(workers=2, entries=3).close()
+
+    @unittest.skipIf(not hasattr(_curve25519, "Pool"), "no native pool")
+    def test_pool_closed_while_submitting(self):
+        # reading the keys runs Python code, which may close the pool
+        def closing(keys):
+            pool.close()
+            for key in keys:
+                yield key
+        for keys in ([b"\x01" * 32], []):
+            pool = _curve25519.Pool()
+            self.assertRaises(ValueError, pool.submit, "t", closing(keys),
+                              None)
+            self.assertEqual(pool.reap(), [])
+
 
 if __name__ == "__main__":
     unittest.main()
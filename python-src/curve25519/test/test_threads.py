@@ -0,0 +1,40 @@
+#! /usr/bin/python
+
+# Measures how key agreement scales with threads. The native calls release
+# the GIL (and free-threaded builds have none), so N threads should get close
+# to N times the throughput of one, up to the number of cores.
+
+import os
+import threading
+from time import time
+from curve25519 import Private
+
+count = 2000
+
+def worker(priv, pub, n):
+    for i in range(n):
+        priv.get_shared_key(pub)
+
+def run(nthreads):
+    pairs = [(Private(), Private().get_public()) for i in range(nthreads)]
+    per_thread = count // nthreads
+    threads = [threading.Thread(target=worker, args=(priv, pub, per_thread))
+               for priv, pub in pairs]
+    start = time()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    elapsed = time() - start
+    return per_thread * nthreads / elapsed
+
+cpus = os.cpu_count() or 1
+base = None
+nthreads = 1
+while nthreads <= max(4, cpus):
+    rate = run(nthreads)
+    if base is None:
+        base = rate
+    print("%2d threads: %7.0f shared keys/s (%.2fx)" % (nthreads, rate,
+                                                         rate / base))
+    nthreads *= 2
@@ -1,16 +1,68 @@
 #! /usr/bin/python
 
+import os, sys, tempfile, shutil
 from subprocess import Popen, PIPE
 from distutils.core import setup, Extension
+from distutils.ccompiler import new_compiler
+from distutils.sysconfig import customize_compiler
 
 version = Popen(["git", "describe", "--tags"], stdout=PIPE).communicate()[0]\
           .strip().decode("utf8")
 
+def have_uint128():
+    # curve25519-donna-c64.c needs a 128-bit integer type, which 64-bit gcc
+    # and clang provide as mode(TI)
+    compiler = new_compiler()
+    customize_compiler(compiler)
+    tmpdir = tempfile.mkdtemp()
+    try:
+        src = os.path.join(tmpdir, "uint128.c")
+        with open(src, "w") as f:
+            f.write("typedef unsigned uint128_t __attribute__((mode(TI)));\n"
+                    "int f(unsigned long long a, unsigned long long b)\n"
+                    "{ return (int) (((uint128_t) a * b) >> 64); }\n")
+        compiler.compile([src], output_dir=tmpdir)
+        return True
+    except Exception:
+        return False
+    finally:
+        shutil.rmtree(tmpdir)
+
+# the 64-bit backend is several times faster where it builds; set
+# CURVE25519_BACKEND=donna or =donna-c64 to choose
+backend = os.environ.get("CURVE25519_BACKEND")
+if backend is None:
+    backend = "donna-c64" if have_uint128() else "donna"
+if backend not in ("donna", "donna-c64"):
+    sys.exit("CURVE25519_BACKEND must be donna or donna-c64")
+
+sources = ["python-src/curve25519/curve25519module.c",
+           "curve25519-%s.c" % backend, "sha256.c"]
+define_macros = [("CURVE25519_BACKEND", '"curve25519-%s"' % backend)]
+# the native worker pool behind the asyncio methods needs eventfd
+if sys.platform.startswith("linux") and sys.version_info >= (3, 7):
+    sources.append("curve25519-async.c")
+    define_macros.append(("CURVE25519_ASYNC", None))
+
 ext_modules = [Extension("curve25519._curve25519",
-                         ["python-src/curve25519/curve25519module.c",
-                          "curve25519-donna.c"],
+                         sources,
+                         include_dirs=["."],
+                         define_macros=define_macros,
                          )]
 
+# the cffi binding, which keys.py prefers on PyPy (where calls into the
+# extension module above go through cpyext); built whenever cffi is around
+try:
+    sys.path.insert(0, "python-src/curve25519")
+    from _cffi_build import make_ffi
+except ImportError:
+    pass
+else:
+    ffibuilder = make_ffi("curve25519-%s" % backend)
+    ext_modules.append(ffibuilder.distutils_extension(tmpdir="build/cffi"))
+finally:
+    del sys.path[0]
+
 short_description="Python wrapper for the Curve25519 cryptographic library"
 long_description="""\
 Curve25519 is a fast elliptic-curve key-agreement protocol, in which two
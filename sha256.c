@@ -0,0 +1,140 @@
+/* Minimal SHA-256 (FIPS 180-4). Public domain.
+ *
+ * This is a straightforward, portable implementation: it only has to keep up
+ * with the handful of short hashes done per key agreement, which are dwarfed
+ * by the cost of the curve25519 ladder. */
+
+#include <string.h>
+
+#include "sha256.h"
+
+static const uint32_t K[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+  0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+  0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+  0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+  0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+  0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static uint32_t
+load_be32(const uint8_t *in) {
+  return ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) |
+         ((uint32_t)in[2] << 8) | ((uint32_t)in[3]);
+}
+
+static void
+store_be32(uint8_t *out, uint32_t in) {
+  out[0] = in >> 24;
+  out[1] = in >> 16;
+  out[2] = in >> 8;
+  out[3] = in;
+}
+
+/* Hash one 64-byte block into |state|. */
+static void
+sha256_block(uint32_t state[8], const uint8_t *block) {
+  uint32_t w[64];
+  uint32_t a, b, c, d, e, f, g, h;
+  unsigned i;
+
+  for (i = 0; i < 16; ++i) w[i] = load_be32(block + 4 * i);
+  for (i = 16; i < 64; ++i) {
+    const uint32_t s0 =
+        ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    const uint32_t s1 =
+        ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  a = state[0]; b = state[1]; c = state[2]; d = state[3];
+  e = state[4]; f = state[5]; g = state[6]; h = state[7];
+
+  for (i = 0; i < 64; ++i) {
+    const uint32_t s1 = ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25);
+    const uint32_t ch = (e & f) ^ (~e & g);
+    const uint32_t t1 = h + s1 + ch + K[i] + w[i];
+    const uint32_t s0 = ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22);
+    const uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+    const uint32_t t2 = s0 + maj;
+
+    h = g; g = f; f = e; e = d + t1;
+    d = c; c = b; b = a; a = t1 + t2;
+  }
+
+  state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+  state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+void
+sha256_init(struct sha256_ctx *ctx) {
+  static const uint32_t iv[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+  };
+
+  memcpy(ctx->state, iv, sizeof(iv));
+  ctx->count = 0;
+}
+
+void
+sha256_update(struct sha256_ctx *ctx, const uint8_t *in, size_t len) {
+  size_t used = ctx->count % SHA256_BLOCK_SIZE;
+
+  if (len == 0) return;
+  ctx->count += len;
+
+  if (used) {
+    size_t todo = SHA256_BLOCK_SIZE - used;
+    if (todo > len) todo = len;
+    memcpy(ctx->buf + used, in, todo);
+    in += todo;
+    len -= todo;
+    if (used + todo < SHA256_BLOCK_SIZE) return;
+    sha256_block(ctx->state, ctx->buf);
+  }
+
+  for (; len >= SHA256_BLOCK_SIZE; len -= SHA256_BLOCK_SIZE) {
+    sha256_block(ctx->state, in);
+    in += SHA256_BLOCK_SIZE;
+  }
+
+  memcpy(ctx->buf, in, len);
+}
+
+void
+sha256_final(struct sha256_ctx *ctx, uint8_t out[SHA256_DIGEST_SIZE]) {
+  size_t used = ctx->count % SHA256_BLOCK_SIZE;
+  const uint64_t bits = ctx->count * 8;
+  unsigned i;
+
+  ctx->buf[used++] = 0x80;
+  if (used > SHA256_BLOCK_SIZE - 8) {
+    memset(ctx->buf + used, 0, SHA256_BLOCK_SIZE - used);
+    sha256_block(ctx->state, ctx->buf);
+    used = 0;
+  }
+  memset(ctx->buf + used, 0, SHA256_BLOCK_SIZE - 8 - used);
+  store_be32(ctx->buf + 56, (uint32_t)(bits >> 32));
+  store_be32(ctx->buf + 60, (uint32_t)bits);
+  sha256_block(ctx->state, ctx->buf);
+
+  for (i = 0; i < 8; ++i) store_be32(out + 4 * i, ctx->state[i]);
+  memset(ctx, 0, sizeof(*ctx));
+}
+
+void
+sha256(uint8_t out[SHA256_DIGEST_SIZE], const uint8_t *in, size_t len) {
+  struct sha256_ctx ctx;
+
+  sha256_init(&ctx);
+  sha256_update(&ctx, in, len);
+  sha256_final(&ctx, out);
+}
@@ -0,0 +1,34 @@
+/* Minimal SHA-256 (FIPS 180-4), used by the Noise handshake and the Python
+ * binding's fused key derivation. Public domain. */
+
+#ifndef CURVE25519_SHA256_H
+#define CURVE25519_SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SHA256_BLOCK_SIZE 64
+#define SHA256_DIGEST_SIZE 32
+
+struct sha256_ctx {
+  uint32_t state[8];
+  uint64_t count;  /* bytes hashed so far */
+  uint8_t buf[SHA256_BLOCK_SIZE];
+};
+
+void sha256_init(struct sha256_ctx *ctx);
+void sha256_update(struct sha256_ctx *ctx, const uint8_t *in, size_t len);
+void sha256_final(struct sha256_ctx *ctx, uint8_t out[SHA256_DIGEST_SIZE]);
+
+/* One-shot convenience wrapper. */
+void sha256(uint8_t out[SHA256_DIGEST_SIZE], const uint8_t *in, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* CURVE25519_SHA256_H */
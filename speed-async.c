@@ -0,0 +1,136 @@
+/* Reactor-thread latency with and without offload.
+ *
+ * Inline, the event loop is stalled for a whole ladder per request. With the
+ * asynchronous rings it only spends the time to submit and to reap, while
+ * the workers run the ladders; the end-to-end latency of each request is
+ * printed as well. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "curve25519-donna.h"
+#include "curve25519-async.h"
+
+#define COUNT 4000
+#define BURST 8
+
+static uint8_t secrets[COUNT][32], outs[COUNT][32];
+static uint64_t stall[2 * COUNT], latency[COUNT], submitted_at[COUNT];
+
+static uint64_t
+time_now() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int
+cmp_u64(const void *a, const void *b) {
+  const uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+  return x < y ? -1 : x > y;
+}
+
+static void
+report(const char *name, uint64_t *samples, unsigned n) {
+  uint64_t sum = 0;
+  unsigned i;
+
+  qsort(samples, n, sizeof(*samples), cmp_u64);
+  for (i = 0; i < n; ++i) sum += samples[i];
+  printf("%-28s mean %8.2f us   p50 %8.2f us   p99 %8.2f us\n", name,
+         (double) sum / n / 1000, (double) samples[n / 2] / 1000,
+         (double) samples[n * 99 / 100] / 1000);
+}
+
+static void
+bench_inline(void) {
+  static const uint8_t basepoint[32] = {9};
+  uint64_t start;
+  unsigned i;
+
+  for (i = 0; i < COUNT; ++i) {
+    start = time_now();
+    curve25519_donna(outs[i], secrets[i], basepoint);
+    stall[i] = time_now() - start;
+  }
+  report("inline: reactor stall", stall, COUNT);
+}
+
+static void
+bench_offload(unsigned workers) {
+  struct curve25519_async *a = curve25519_async_new(workers, 256);
+  struct curve25519_async_sqe sqe;
+  struct curve25519_async_cqe cqes[BURST];
+  struct epoll_event ev;
+  uint64_t start, counter;
+  unsigned i, n, next = 0, done = 0, stalls = 0;
+  char name[64];
+  int ep = epoll_create1(0);
+
+  if (!a || ep < 0) {
+    fprintf(stderr, "setup failed\n");
+    exit(1);
+  }
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  epoll_ctl(ep, EPOLL_CTL_ADD, curve25519_async_fd(a), &ev);
+
+  memset(&sqe, 0, sizeof(sqe));
+  sqe.op = CURVE25519_ASYNC_OP_DH;
+  while (done < COUNT) {
+    /* A burst of requests arrives; hand them off. */
+    for (i = 0; i < BURST && next < COUNT; ++i, ++next) {
+      sqe.secret = secrets[next];
+      sqe.out = outs[next];
+      sqe.user_data = next;
+      start = time_now();
+      submitted_at[next] = start;
+      curve25519_async_submit(a, &sqe);
+      stall[stalls++] = time_now() - start;
+    }
+
+    epoll_wait(ep, &ev, 1, -1);
+    start = time_now();
+    if (read(curve25519_async_fd(a), &counter, sizeof(counter)) < 0) {
+      /* Spurious wakeup; nothing to reset. */
+    }
+    while ((n = curve25519_async_reap(a, cqes, BURST)) > 0) {
+      const uint64_t now = time_now();
+      for (i = 0; i < n; ++i) {
+        latency[done + i] = now - submitted_at[cqes[i].user_data];
+      }
+      done += n;
+    }
+    if (stalls < 2 * COUNT) stall[stalls++] = time_now() - start;
+  }
+
+  snprintf(name, sizeof(name), "offload x%u: reactor stall", workers);
+  report(name, stall, stalls);
+  snprintf(name, sizeof(name), "offload x%u: end to end", workers);
+  report(name, latency, COUNT);
+
+  close(ep);
+  curve25519_async_free(a);
+}
+
+int
+main() {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  unsigned i, j;
+
+  for (i = 0; i < COUNT; ++i) {
+    for (j = 0; j < 32; ++j) secrets[i][j] = i * 7 + j;
+  }
+
+  bench_inline();
+  bench_offload(1);
+  if (cpus > 2) bench_offload((unsigned) cpus - 1);
+
+  return 0;
+}
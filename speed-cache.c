@@ -0,0 +1,104 @@
+/* Reconnect storm: threads repeatedly derive the static-static secret with
+ * peers drawn from a fixed population, with and without the cache. The
+ * cached run starts cold, so its first contact with every peer is a miss. */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "curve25519-donna.h"
+#include "curve25519-cache.h"
+
+#define NPEERS 2000
+#define PER_THREAD 20000
+
+static uint8_t my_secret[32], peers[NPEERS][32];
+static struct curve25519_cache *cache;
+
+static uint64_t
+time_now() {
+  struct timeval tv;
+  uint64_t ret;
+
+  gettimeofday(&tv, NULL);
+  ret = tv.tv_sec;
+  ret *= 1000000;
+  ret += tv.tv_usec;
+
+  return ret;
+}
+
+static void *
+storm(void *arg) {
+  unsigned i, seed = (unsigned) (uintptr_t) arg;
+  uint8_t shared[32];
+
+  for (i = 0; i < PER_THREAD; ++i) {
+    const uint8_t *peer;
+
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    peer = peers[seed % NPEERS];
+    if (cache) {
+      curve25519_cache_shared(cache, shared, 1, my_secret, peer);
+    } else {
+      curve25519_donna(shared, my_secret, peer);
+    }
+  }
+  return NULL;
+}
+
+static double
+run(unsigned nthreads) {
+  pthread_t threads[64];
+  uint64_t start, end;
+  unsigned i;
+
+  start = time_now();
+  for (i = 0; i < nthreads; ++i) {
+    pthread_create(&threads[i], NULL, storm, (void *) (uintptr_t) (i + 1));
+  }
+  for (i = 0; i < nthreads; ++i) pthread_join(threads[i], NULL);
+  end = time_now();
+
+  return (double) nthreads * PER_THREAD * 1000000 / (end - start);
+}
+
+int
+main() {
+  static const uint8_t basepoint[32] = {9};
+  struct curve25519_cache_stats stats;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  unsigned nthreads = cpus < 1 ? 1 : cpus > 64 ? 64 : (unsigned) cpus;
+  uint8_t secret[32];
+  unsigned i;
+
+  memset(my_secret, 0x42, sizeof(my_secret));
+  for (i = 0; i < NPEERS; ++i) {
+    memset(secret, 0, sizeof(secret));
+    memcpy(secret + 1, &i, sizeof(i));
+    curve25519_donna(peers[i], secret, basepoint);
+  }
+
+  printf("%u peers, %u threads, %u reconnects each\n", NPEERS, nthreads,
+         PER_THREAD);
+  printf("uncached: %10.0f agreements/s\n", run(nthreads));
+
+  cache = curve25519_cache_new(4096, 4 * nthreads);
+  if (!cache) {
+    fprintf(stderr, "curve25519_cache_new failed (RLIMIT_MEMLOCK?)\n");
+    return 1;
+  }
+  printf("cached:   %10.0f agreements/s", run(nthreads));
+  curve25519_cache_stats(cache, &stats);
+  printf("  (hit rate %.1f%%, %u entries, %llu evictions)\n",
+         100.0 * stats.hits / (stats.hits + stats.misses), stats.entries,
+         (unsigned long long) stats.evictions);
+  curve25519_cache_free(cache);
+
+  return 0;
+}
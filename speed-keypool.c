@@ -0,0 +1,93 @@
+/* Latency of the key agreement step of a handshake (fresh ephemeral keypair,
+ * then one DH with the peer's ephemeral) with and without the keypair pool.
+ * Handshakes arrive with idle gaps in between, in which the pool refills. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <time.h>
+
+#include "curve25519-donna.h"
+#include "curve25519-keypool.h"
+
+#define COUNT 2000
+#define GAP_NS 300000
+
+static uint64_t samples[COUNT];
+
+static uint64_t
+time_now() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int
+cmp_u64(const void *a, const void *b) {
+  const uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+  return x < y ? -1 : x > y;
+}
+
+static void
+report(const char *name) {
+  uint64_t sum = 0;
+  unsigned i;
+
+  qsort(samples, COUNT, sizeof(*samples), cmp_u64);
+  for (i = 0; i < COUNT; ++i) sum += samples[i];
+  printf("%-10s mean %8.2f us   p50 %8.2f us   p99 %8.2f us\n", name,
+         (double) sum / COUNT / 1000, (double) samples[COUNT / 2] / 1000,
+         (double) samples[COUNT * 99 / 100] / 1000);
+}
+
+static void
+idle(void) {
+  struct timespec ts = {0, GAP_NS};
+  nanosleep(&ts, NULL);
+}
+
+int
+main() {
+  static const uint8_t basepoint[32] = {9};
+  struct curve25519_keypool *pool;
+  struct curve25519_keypool_stats stats;
+  uint8_t peer_secret[32], peer[32], secret[32], public_key[32], shared[32];
+  uint64_t start;
+  unsigned i;
+
+  memset(peer_secret, 0x42, sizeof(peer_secret));
+  curve25519_donna(peer, peer_secret, basepoint);
+
+  for (i = 0; i < COUNT; ++i) {
+    idle();
+    start = time_now();
+    if (getrandom(secret, 32, 0) != 32) return 1;
+    curve25519_donna(public_key, secret, basepoint);
+    curve25519_donna(shared, secret, peer);
+    samples[i] = time_now() - start;
+  }
+  report("inline");
+
+  pool = curve25519_keypool_new(256, 64);
+  if (!pool) return 1;
+  for (i = 0; i < COUNT; ++i) {
+    idle();
+    start = time_now();
+    curve25519_keypool_get(pool, secret, public_key);
+    curve25519_donna(shared, secret, peer);
+    samples[i] = time_now() - start;
+  }
+  report("pool");
+
+  curve25519_keypool_stats(pool, &stats, 0);
+  printf("pool: %llu served, %llu misses, %llu low-watermark events, "
+         "lowest level %u\n",
+         (unsigned long long) stats.served, (unsigned long long) stats.misses,
+         (unsigned long long) stats.low_events, stats.min_level);
+  curve25519_keypool_free(pool);
+
+  return 0;
+}
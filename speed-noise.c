@@ -0,0 +1,93 @@
+/* Loopback benchmark: both sides of Noise XX and IK handshakes in one thread,
+ * so the rate printed is handshakes per second per core. */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <stdint.h>
+
+#include "curve25519-noise.h"
+
+static uint64_t
+time_now() {
+  struct timeval tv;
+  uint64_t ret;
+
+  gettimeofday(&tv, NULL);
+  ret = tv.tv_sec;
+  ret *= 1000000;
+  ret += tv.tv_usec;
+
+  return ret;
+}
+
+static int
+handshake(enum noise_pattern pattern, const struct noise_keypair *is,
+          const struct noise_keypair *rs, unsigned iteration) {
+  struct noise_handshake hs[2];
+  struct noise_cipherstate send, recv;
+  uint8_t e[32], msg[256], payload[64];
+  size_t msg_len, payload_len;
+  int i, ret = 0;
+
+  /* Stand-ins for fresh random ephemerals. */
+  memset(e, 0, sizeof(e));
+  memcpy(e, &iteration, sizeof(iteration));
+  e[31] = 1;
+  ret |= noise_handshake_init(&hs[0], pattern, 1, NULL, 0, is, e,
+                              rs->public_key);
+  e[31] = 2;
+  ret |= noise_handshake_init(&hs[1], pattern, 0, NULL, 0, rs, e, NULL);
+
+  for (i = 0; !noise_handshake_is_complete(&hs[0]); ++i) {
+    ret |= noise_handshake_write_message(&hs[i & 1], NULL, 0, msg, sizeof(msg),
+                                         &msg_len);
+    ret |= noise_handshake_read_message(&hs[(i + 1) & 1], msg, msg_len,
+                                        payload, sizeof(payload),
+                                        &payload_len);
+  }
+
+  ret |= noise_handshake_split(&hs[0], &send, &recv);
+  ret |= noise_handshake_split(&hs[1], &send, &recv);
+  return ret;
+}
+
+static void
+bench(enum noise_pattern pattern, const char *name,
+      const struct noise_keypair *is, const struct noise_keypair *rs) {
+  static const unsigned count = 3000;
+  uint64_t start, end;
+  unsigned i;
+
+  for (i = 0; i < 100; ++i) handshake(pattern, is, rs, i);
+
+  start = time_now();
+  for (i = 0; i < count; ++i) {
+    if (handshake(pattern, is, rs, i) != NOISE_OK) {
+      printf("%s: handshake failed\n", name);
+      return;
+    }
+  }
+  end = time_now();
+
+  printf("%s: %luus per handshake, %lu handshakes/s per core\n", name,
+         (unsigned long) ((end - start) / count),
+         (unsigned long) (count * 1000000ull / (end - start)));
+}
+
+int
+main() {
+  struct noise_keypair is, rs;
+  uint8_t key[32];
+
+  memset(key, 42, 32);
+  noise_keypair_init(&is, key);
+  memset(key, 43, 32);
+  noise_keypair_init(&rs, key);
+
+  bench(NOISE_PATTERN_XX, "Noise_XX", &is, &rs);
+  bench(NOISE_PATTERN_IK, "Noise_IK", &is, &rs);
+
+  return 0;
+}
@@ -0,0 +1,77 @@
+/* Compares the cost of checking that a public key is on the curve, rather
+ * than the twist, with the cost of a DH. */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <stdint.h>
+
+#include "curve25519-donna.h"
+
+static uint64_t
+time_now() {
+  struct timeval tv;
+  uint64_t ret;
+
+  gettimeofday(&tv, NULL);
+  ret = tv.tv_sec;
+  ret *= 1000000;
+  ret += tv.tv_usec;
+
+  return ret;
+}
+
+#define COUNT 10000
+#define BATCH 64
+
+int
+main() {
+  static const unsigned char basepoint[32] = {9};
+  static unsigned char points[BATCH * 32];
+  static int results[BATCH];
+  unsigned char mysecret[32], out[32];
+  unsigned i;
+  uint64_t start, dh, ct, vt, batch;
+  int sink = 0;
+
+  memset(mysecret, 42, 32);
+  curve25519_donna(points, mysecret, basepoint);
+  for (i = 1; i < BATCH; ++i) {
+    curve25519_donna(points + 32 * i, points + 32 * (i - 1), basepoint);
+  }
+
+  start = time_now();
+  for (i = 0; i < COUNT; ++i) {
+    curve25519_donna(out, mysecret, points + 32 * (i % BATCH));
+  }
+  dh = time_now() - start;
+
+  start = time_now();
+  for (i = 0; i < COUNT; ++i) {
+    sink += curve25519_donna_on_curve(points + 32 * (i % BATCH));
+  }
+  ct = time_now() - start;
+
+  start = time_now();
+  for (i = 0; i < COUNT; ++i) {
+    sink += curve25519_donna_on_curve_vartime(points + 32 * (i % BATCH));
+  }
+  vt = time_now() - start;
+
+  start = time_now();
+  for (i = 0; i < COUNT / BATCH; ++i) {
+    sink += curve25519_donna_on_curve_batch(results, points, BATCH);
+  }
+  batch = time_now() - start;
+
+  printf("dh:               %.2fus\n", (double) dh / COUNT);
+  printf("on_curve:         %.2fus (%.1f%% of a DH)\n", (double) ct / COUNT,
+         100.0 * ct / dh);
+  printf("on_curve_vartime: %.2fus (%.1f%% of a DH)\n", (double) vt / COUNT,
+         100.0 * vt / dh);
+  printf("on_curve_batch:   %.2fus per point\n",
+         (double) batch / ((COUNT / BATCH) * BATCH));
+
+  return sink == 0;
+}
@@ -0,0 +1,194 @@
+/* Load generator for the shared-memory offload service.
+ *
+ * Forks client processes that each keep a window of DH jobs in flight and
+ * reports the total throughput and the per-job latency, next to the
+ * throughput of calling curve25519_donna directly on every core.
+ *
+ * Usage: speed-shm [socket path of a running curve25519-shmd]
+ * Without an argument the service runs on a thread of this process. */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "curve25519-donna.h"
+#include "curve25519-shm.h"
+
+#define JOBS_PER_CLIENT 4000
+#define MAX_CLIENTS 64
+
+static uint64_t
+time_now() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int
+cmp_u64(const void *a, const void *b) {
+  const uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+  return x < y ? -1 : x > y;
+}
+
+static void *
+serve(void *server) {
+  curve25519_shm_server_run(server);
+  return NULL;
+}
+
+/* One client process: keeps |window| jobs in flight until all are done and
+ * stores each job's latency in |latency|. */
+static int
+run_client(const char *path, unsigned window, unsigned seed,
+           uint64_t *latency) {
+  struct curve25519_shm_client *client = curve25519_shm_connect(path);
+  struct curve25519_shm_completion done[64];
+  uint64_t submitted_at[JOBS_PER_CLIENT];
+  uint8_t secret[32];
+  unsigned i, n, next = 0, completed = 0;
+
+  if (!client) return 1;
+  memset(secret, seed, 32);
+
+  while (completed < JOBS_PER_CLIENT) {
+    while (next < JOBS_PER_CLIENT && next - completed < window) {
+      secret[0] = next;
+      submitted_at[next] = time_now();
+      if (curve25519_shm_submit(client, CURVE25519_SHM_OP_DH, secret, NULL,
+                                next) != 0) {
+        break;
+      }
+      next++;
+    }
+    n = curve25519_shm_reap(client, done, 64);
+    if (n == 0) {
+      if (curve25519_shm_wait(client, 10000) != 1) return 1;
+      continue;
+    }
+    for (i = 0; i < n; ++i) {
+      latency[completed + i] = time_now() - submitted_at[done[i].user_data];
+    }
+    completed += n;
+  }
+
+  curve25519_shm_disconnect(client);
+  return 0;
+}
+
+static void
+bench_service(const char *path, unsigned clients, unsigned window) {
+  const size_t total = (size_t) clients * JOBS_PER_CLIENT;
+  uint64_t *latency, start, elapsed;
+  pid_t pids[MAX_CLIENTS];
+  unsigned i;
+  int status, fails = 0;
+
+  /* Shared with the children so that they can hand back their samples. */
+  latency = mmap(NULL, total * sizeof(*latency), PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (latency == MAP_FAILED) {
+    fprintf(stderr, "mmap failed\n");
+    exit(1);
+  }
+
+  start = time_now();
+  for (i = 0; i < clients; ++i) {
+    pids[i] = fork();
+    if (pids[i] == 0) {
+      _exit(run_client(path, window, i, latency + (size_t) i * JOBS_PER_CLIENT));
+    }
+  }
+  for (i = 0; i < clients; ++i) {
+    if (pids[i] < 0 || waitpid(pids[i], &status, 0) != pids[i] ||
+        !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      fails++;
+    }
+  }
+  elapsed = time_now() - start;
+  if (fails) {
+    fprintf(stderr, "%d client processes failed\n", fails);
+    exit(1);
+  }
+
+  qsort(latency, total, sizeof(*latency), cmp_u64);
+  printf("service, %2u clients x window %3u: %9.0f DH/s   "
+         "p50 %8.2f us   p99 %8.2f us\n", clients, window,
+         (double) total * 1e9 / elapsed, (double) latency[total / 2] / 1000,
+         (double) latency[total * 99 / 100] / 1000);
+  munmap(latency, total * sizeof(*latency));
+}
+
+/* The same work done in-process with one plain call per job on each core. */
+static void
+bench_direct(unsigned cpus) {
+  static const uint8_t basepoint[32] = {9};
+  uint8_t secret[32], out[32];
+  uint64_t start, elapsed;
+  pid_t pids[MAX_CLIENTS];
+  unsigned i, j;
+  int status;
+
+  start = time_now();
+  for (i = 0; i < cpus; ++i) {
+    pids[i] = fork();
+    if (pids[i] == 0) {
+      memset(secret, i, 32);
+      for (j = 0; j < JOBS_PER_CLIENT; ++j) {
+        secret[0] = j;
+        curve25519_donna(out, secret, basepoint);
+      }
+      _exit(0);
+    }
+  }
+  for (i = 0; i < cpus; ++i) {
+    if (pids[i] > 0) waitpid(pids[i], &status, 0);
+  }
+  elapsed = time_now() - start;
+  printf("direct, %2u processes:              %9.0f DH/s\n", cpus,
+         (double) cpus * JOBS_PER_CLIENT * 1e9 / elapsed);
+}
+
+int
+main(int argc, char **argv) {
+  static const unsigned windows[] = {1, 8, 64};
+  struct curve25519_shm_server *server = NULL;
+  pthread_t thread;
+  char path[64];
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  unsigned i, clients;
+
+  if (cpus < 1) cpus = 1;
+  if (cpus > MAX_CLIENTS / 2) cpus = MAX_CLIENTS / 2;
+
+  if (argc > 1) {
+    snprintf(path, sizeof(path), "%s", argv[1]);
+  } else {
+    snprintf(path, sizeof(path), "/tmp/speed-shm-%d.sock", (int) getpid());
+    server = curve25519_shm_server_new(path, cpus);
+    if (!server || pthread_create(&thread, NULL, serve, server) != 0) {
+      fprintf(stderr, "cannot start the server\n");
+      return 1;
+    }
+  }
+
+  bench_direct(cpus);
+  for (clients = 1; clients <= 2 * (unsigned) cpus; clients *= 2) {
+    for (i = 0; i < sizeof(windows) / sizeof(windows[0]); ++i) {
+      bench_service(path, clients, windows[i]);
+    }
+  }
+
+  if (server) {
+    curve25519_shm_server_stop(server);
+    pthread_join(thread, NULL);
+    curve25519_shm_server_free(server);
+  }
+  return 0;
+}
@@ -0,0 +1,127 @@
+/* Pushes DH and keygen jobs through the asynchronous rings, waiting on the
+ * eventfd with epoll, and checks every result against curve25519_donna. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "curve25519-donna.h"
+#include "curve25519-async.h"
+
+#define NJOBS 1000
+#define ENTRIES 64
+
+static uint8_t secrets[NJOBS][32], points[NJOBS][32], outs[NJOBS][32];
+static int ops[NJOBS], reaped[NJOBS];
+
+static unsigned
+check_cqe(const struct curve25519_async_cqe *cqe) {
+  static const uint8_t basepoint[32] = {9};
+  static const uint8_t zero[32];
+  const uint64_t i = cqe->user_data;
+  uint8_t expected[32];
+
+  if (i >= NJOBS || reaped[i]++) {
+    fprintf(stderr, "bad or duplicate completion %llu\n", (unsigned long long) i);
+    return 1;
+  }
+  if (cqe->result != 0) {
+    fprintf(stderr, "job %u failed\n", (unsigned) i);
+    return 1;
+  }
+  if (ops[i] == CURVE25519_ASYNC_OP_KEYGEN) {
+    if (memcmp(secrets[i], zero, 32) == 0) {
+      fprintf(stderr, "keygen %u left the secret empty\n", (unsigned) i);
+      return 1;
+    }
+    curve25519_donna(expected, secrets[i], basepoint);
+  } else {
+    curve25519_donna(expected, secrets[i], points[i]);
+  }
+  if (memcmp(expected, outs[i], 32) != 0) {
+    fprintf(stderr, "job %u has the wrong result\n", (unsigned) i);
+    return 1;
+  }
+  return 0;
+}
+
+int
+main() {
+  struct curve25519_async *a;
+  struct curve25519_async_sqe sqe;
+  struct curve25519_async_cqe cqes[16];
+  struct epoll_event ev;
+  uint64_t counter;
+  unsigned i, j, n, submitted = 0, done = 0, fails = 0, full = 0;
+  int ep;
+
+  for (i = 0; i < NJOBS; ++i) {
+    ops[i] = (i % 5 == 0) ? CURVE25519_ASYNC_OP_KEYGEN : CURVE25519_ASYNC_OP_DH;
+    for (j = 0; j < 32; ++j) {
+      secrets[i][j] = ops[i] == CURVE25519_ASYNC_OP_KEYGEN ? 0 : i * 31 + j;
+      points[i][j] = i * 17 + j * 5;
+    }
+    /* Every third job passes NULL for the base point. */
+    if (i % 3 == 0) {
+      memset(points[i], 0, 32);
+      points[i][0] = 9;
+    }
+  }
+
+  a = curve25519_async_new(3, ENTRIES);
+  if (!a) {
+    fprintf(stderr, "curve25519_async_new failed\n");
+    return 1;
+  }
+
+  ep = epoll_create1(0);
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  if (ep < 0 || epoll_ctl(ep, EPOLL_CTL_ADD, curve25519_async_fd(a), &ev)) {
+    perror("epoll");
+    return 1;
+  }
+
+  while (done < NJOBS) {
+    /* Submit until the rings push back, then wait for completions. */
+    while (submitted < NJOBS) {
+      sqe.op = ops[submitted];
+      sqe.secret = secrets[submitted];
+      sqe.basepoint = (submitted % 3) ? points[submitted] : NULL;
+      sqe.out = outs[submitted];
+      sqe.user_data = submitted;
+      if (curve25519_async_submit(a, &sqe) != 0) {
+        full++;
+        break;
+      }
+      submitted++;
+    }
+
+    if (epoll_wait(ep, &ev, 1, 10000) != 1) {
+      fprintf(stderr, "timed out waiting for completions\n");
+      return 1;
+    }
+    if (read(curve25519_async_fd(a), &counter, sizeof(counter)) !=
+        sizeof(counter)) {
+      fails++;
+    }
+    while ((n = curve25519_async_reap(a, cqes, 16)) > 0) {
+      for (i = 0; i < n; ++i) fails += check_cqe(&cqes[i]);
+      done += n;
+    }
+  }
+
+  if (full == 0) {
+    fprintf(stderr, "submissions never hit the in-flight limit\n");
+    fails++;
+  }
+  if (curve25519_async_reap(a, cqes, 16) != 0) fails++;
+
+  close(ep);
+  curve25519_async_free(a);
+
+  if (fails == 0) fprintf(stderr, "Asynchronous jobs match curve25519_donna.\n");
+  return fails ? 1 : 0;
+}
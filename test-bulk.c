@@ -0,0 +1,134 @@
+/* Runs curve25519-bulk on a file and through a pipe, in both modes and with
+ * record counts that aren't a multiple of the chunk size or of the threads'
+ * share of a chunk, and checks every output record against
+ * curve25519_donna.
+ *
+ * Usage: test-bulk [path to curve25519-bulk] */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "curve25519-donna.h"
+
+#define NRECORDS 40000
+
+static uint8_t records[NRECORDS][64], results[NRECORDS][32];
+
+/* Returns 1 unless the files at |a| and |b| have the same contents. */
+static unsigned
+differ(const char *a, const char *b) {
+  FILE *fa = fopen(a, "rb"), *fb = fopen(b, "rb");
+  int ca, cb;
+  unsigned ret = 1;
+
+  if (fa && fb) {
+    do {
+      ca = fgetc(fa);
+      cb = fgetc(fb);
+    } while (ca == cb && ca != EOF);
+    ret = ca != cb;
+  }
+  if (fa) fclose(fa);
+  if (fb) fclose(fb);
+  return ret;
+}
+
+static unsigned
+check(const char *tool, const char *mode, const char *command_fmt,
+      const char *in, const char *out, unsigned n) {
+  static const uint8_t basepoint[32] = {9};
+  const size_t record_size = strcmp(mode, "public") == 0 ? 32 : 64;
+  char command[512];
+  uint8_t expected[32];
+  FILE *f;
+  unsigned i;
+
+  f = fopen(in, "wb");
+  for (i = 0; i < n; ++i) fwrite(records[i], record_size, 1, f);
+  fclose(f);
+
+  snprintf(command, sizeof(command), command_fmt, tool, mode, in, out);
+  if (system(command) != 0) {
+    fprintf(stderr, "FAIL: %s\n", command);
+    return 1;
+  }
+
+  memset(results, 0, sizeof(results));
+  f = fopen(out, "rb");
+  if (!f || fread(results, 32, n, f) != n ||
+      fgetc(f) != EOF) {
+    fprintf(stderr, "FAIL: %s: wrong output length\n", command);
+    if (f) fclose(f);
+    return 1;
+  }
+  fclose(f);
+
+  for (i = 0; i < n; ++i) {
+    curve25519_donna(expected, records[i],
+                     record_size == 32 ? basepoint : records[i] + 32);
+    if (memcmp(expected, results[i], 32) != 0) {
+      fprintf(stderr, "FAIL: %s: record %u\n", command, i);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int
+main(int argc, char **argv) {
+  const char *tool = argc > 1 ? argv[1] : "./curve25519-bulk";
+  char in[64], out[64], out2[64], command[512];
+  unsigned i, j, fails = 0;
+  FILE *f;
+
+  for (i = 0; i < NRECORDS; ++i) {
+    for (j = 0; j < 64; ++j) records[i][j] = i * 31 + j * 7 + (i >> 8);
+    records[i][63] &= 0x7f;
+  }
+
+  snprintf(in, sizeof(in), "/tmp/test-bulk-%d.in", (int) getpid());
+  snprintf(out, sizeof(out), "/tmp/test-bulk-%d.out", (int) getpid());
+  snprintf(out2, sizeof(out2), "/tmp/test-bulk-%d.out2", (int) getpid());
+
+  fails += check(tool, "public", "%s -q -t 3 %s %s %s", in, out, NRECORDS);
+  fails += check(tool, "shared", "%s -q -t 3 %s %s %s", in, out, NRECORDS);
+  fails += check(tool, "public", "cat %3$s | %1$s -q -t 2 %2$s > %4$s", in, out,
+                 NRECORDS);
+  fails += check(tool, "shared", "cat %3$s | %1$s -q -t 1 %2$s - %4$s", in, out,
+                 NRECORDS);
+
+  /* 129 records don't split into whole batches for two threads; the output
+   * must be the same as with one. */
+  fails += check(tool, "shared", "%s -q -t 1 %s %s %s", in, out2, 129);
+  fails += check(tool, "shared", "%s -q -t 2 %s %s %s", in, out, 129);
+  if (differ(out, out2)) {
+    fprintf(stderr, "FAIL: 129 records with -t 2 differ from -t 1\n");
+    fails++;
+  }
+
+  /* A partial record is an error. */
+  f = fopen(in, "wb");
+  fwrite(records, 33, 1, f);
+  fclose(f);
+  snprintf(command, sizeof(command), "%s -q public %s %s 2>/dev/null", tool, in, out);
+  if (system(command) == 0) {
+    fprintf(stderr, "FAIL: partial record accepted\n");
+    fails++;
+  }
+
+  /* So is input that can't be read. */
+  snprintf(command, sizeof(command), "%s -q public /tmp %s 2>/dev/null", tool, out);
+  if (system(command) == 0) {
+    fprintf(stderr, "FAIL: unreadable input accepted\n");
+    fails++;
+  }
+
+  unlink(in);
+  unlink(out);
+  unlink(out2);
+  if (fails == 0) fprintf(stderr, "Bulk tool output matches curve25519_donna.\n");
+  return fails ? 1 : 0;
+}
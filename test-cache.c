@@ -0,0 +1,195 @@
+/* Checks the shared-secret cache against curve25519_donna: hits, misses,
+ * eviction when full, invalidation by key and by peer, concurrent use, and
+ * invalidation while a miss is computing.
+ *
+ * Linked with -Wl,--wrap=curve25519_donna so that a ladder can be paused. */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "curve25519-donna.h"
+#include "curve25519-cache.h"
+
+#define NPEERS 64
+#define NTHREADS 4
+
+static uint8_t secrets[2][32], peers[NPEERS][32];
+static struct curve25519_cache *cache;
+
+/* PAUSE_ARMED makes the next ladder report PAUSE_WAITING and wait until it is
+ * set to PAUSE_OFF. */
+enum { PAUSE_OFF, PAUSE_ARMED, PAUSE_WAITING };
+static int pause_state;
+static pthread_mutex_t pause_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pause_cond = PTHREAD_COND_INITIALIZER;
+
+int __real_curve25519_donna(uint8_t *, const uint8_t *, const uint8_t *);
+int __wrap_curve25519_donna(uint8_t *, const uint8_t *, const uint8_t *);
+
+int
+__wrap_curve25519_donna(uint8_t *mypublic, const uint8_t *secret,
+                        const uint8_t *basepoint) {
+  pthread_mutex_lock(&pause_lock);
+  if (pause_state == PAUSE_ARMED) {
+    pause_state = PAUSE_WAITING;
+    pthread_cond_broadcast(&pause_cond);
+    while (pause_state != PAUSE_OFF) {
+      pthread_cond_wait(&pause_cond, &pause_lock);
+    }
+  }
+  pthread_mutex_unlock(&pause_lock);
+  return __real_curve25519_donna(mypublic, secret, basepoint);
+}
+
+static unsigned
+lookup(uint64_t key_id, unsigned peer, int expect_hit) {
+  uint8_t shared[32], expected[32];
+  int hit = curve25519_cache_shared(cache, shared, key_id, secrets[key_id],
+                                    peers[peer]);
+
+  curve25519_donna(expected, secrets[key_id], peers[peer]);
+  if (memcmp(shared, expected, 32) != 0) {
+    fprintf(stderr, "wrong secret for key %u, peer %u\n", (unsigned) key_id,
+            peer);
+    return 1;
+  }
+  if (expect_hit >= 0 && hit != expect_hit) {
+    fprintf(stderr, "key %u, peer %u: expected a %s\n", (unsigned) key_id,
+            peer, expect_hit ? "hit" : "miss");
+    return 1;
+  }
+  return 0;
+}
+
+static void *
+storm(void *arg) {
+  unsigned i, fails = 0, seed = (unsigned) (uintptr_t) arg;
+
+  for (i = 0; i < 300; ++i) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    fails += lookup(seed & 1, (seed >> 1) % NPEERS, -1);
+  }
+  return (void *) (uintptr_t) fails;
+}
+
+static void *
+paused_miss(void *arg) {
+  (void) arg;
+  return (void *) (uintptr_t) lookup(0, 7, 0);
+}
+
+int
+main() {
+  struct curve25519_cache_stats stats;
+  pthread_t threads[NTHREADS];
+  void *ret;
+  unsigned i, j, fails = 0;
+
+  memset(secrets[0], 0x11, 32);
+  memset(secrets[1], 0x22, 32);
+  for (i = 0; i < NPEERS; ++i) {
+    for (j = 0; j < 32; ++j) peers[i][j] = i * 7 + j;
+    peers[i][31] &= 127;
+  }
+
+  /* Roomy enough that no set overflows: the sets are chosen by a random
+   * hash, so a tight fit could evict by chance. */
+  cache = curve25519_cache_new(4096, 4);
+  if (!cache) {
+    fprintf(stderr, "curve25519_cache_new failed (RLIMIT_MEMLOCK?)\n");
+    return 1;
+  }
+
+  /* Populate, then everything hits, under either key. */
+  for (i = 0; i < NPEERS; ++i) {
+    fails += lookup(0, i, 0);
+    fails += lookup(1, i, 0);
+  }
+  for (i = 0; i < NPEERS; ++i) {
+    fails += lookup(0, i, 1);
+    fails += lookup(1, i, 1);
+  }
+
+  /* Rotating key 0 leaves key 1 alone. */
+  if (curve25519_cache_invalidate_key(cache, 0) != NPEERS) fails++;
+  fails += lookup(0, 5, 0);
+  fails += lookup(1, 5, 1);
+  if (curve25519_cache_invalidate_peer(cache, 1, peers[5]) != 1 ||
+      curve25519_cache_invalidate_peer(cache, 1, peers[5]) != 0) {
+    fails++;
+  }
+  fails += lookup(1, 5, 0);
+
+  curve25519_cache_stats(cache, &stats);
+  if (stats.hits != 2 * NPEERS + 1 || stats.misses != 2 * NPEERS + 2 ||
+      stats.invalidations != NPEERS + 1 || stats.entries != NPEERS + 1 ||
+      stats.evictions != 0) {
+    fprintf(stderr, "unexpected statistics\n");
+    fails++;
+  }
+  curve25519_cache_free(cache);
+
+  /* A cache far smaller than the working set stays correct and evicts. */
+  cache = curve25519_cache_new(16, 2);
+  if (!cache) {
+    fprintf(stderr, "curve25519_cache_new failed (RLIMIT_MEMLOCK?)\n");
+    return 1;
+  }
+  for (i = 0; i < 3 * NPEERS; ++i) fails += lookup(i & 1, i % NPEERS, -1);
+  curve25519_cache_stats(cache, &stats);
+  if (stats.entries > stats.capacity || stats.evictions == 0) {
+    fprintf(stderr, "small cache didn't evict\n");
+    fails++;
+  }
+  curve25519_cache_free(cache);
+
+  cache = curve25519_cache_new(128, NTHREADS);
+  if (!cache) {
+    fprintf(stderr, "curve25519_cache_new failed (RLIMIT_MEMLOCK?)\n");
+    return 1;
+  }
+  for (i = 0; i < NTHREADS; ++i) {
+    pthread_create(&threads[i], NULL, storm, (void *) (uintptr_t) (i + 1));
+  }
+  for (i = 0; i < NTHREADS; ++i) {
+    pthread_join(threads[i], &ret);
+    fails += (unsigned) (uintptr_t) ret;
+  }
+  curve25519_cache_stats(cache, &stats);
+  if (stats.hits + stats.misses != NTHREADS * 300) fails++;
+  curve25519_cache_free(cache);
+
+  /* Rotating a key while a miss on it is in its ladder: the miss still gets
+   * its answer, but mustn't cache it after the rotation. */
+  cache = curve25519_cache_new(64, 1);
+  if (!cache) {
+    fprintf(stderr, "curve25519_cache_new failed (RLIMIT_MEMLOCK?)\n");
+    return 1;
+  }
+  pause_state = PAUSE_ARMED;
+  pthread_create(&threads[0], NULL, paused_miss, NULL);
+  pthread_mutex_lock(&pause_lock);
+  while (pause_state != PAUSE_WAITING) {
+    pthread_cond_wait(&pause_cond, &pause_lock);
+  }
+  pthread_mutex_unlock(&pause_lock);
+  curve25519_cache_invalidate_key(cache, 0);
+  pthread_mutex_lock(&pause_lock);
+  pause_state = PAUSE_OFF;
+  pthread_cond_broadcast(&pause_cond);
+  pthread_mutex_unlock(&pause_lock);
+  pthread_join(threads[0], &ret);
+  fails += (unsigned) (uintptr_t) ret;
+  if (curve25519_cache_invalidate_key(cache, 0) != 0) {
+    fprintf(stderr, "a miss cached its result across invalidation\n");
+    fails++;
+  }
+  curve25519_cache_free(cache);
+
+  if (fails == 0) fprintf(stderr, "Shared-secret cache OK.\n");
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,174 @@
+/* Checks that curve25519_donna_checked rejects every encoding of a point of
+ * small order and every non-canonical encoding, accepts ordinary points with
+ * the same result as curve25519_donna, and reports how rejection's cost
+ * compares with a DH. Also checks the on-curve/twist tests against each
+ * other. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "curve25519-donna.h"
+
+static uint64_t
+time_now() {
+  struct timeval tv;
+  uint64_t ret;
+
+  gettimeofday(&tv, NULL);
+  ret = tv.tv_sec;
+  ret *= 1000000;
+  ret += tv.tv_usec;
+
+  return ret;
+}
+
+/* 2^255 - 19 + |delta|, little-endian */
+static void
+p_plus(uint8_t out[32], int delta) {
+  memset(out, 0xff, 32);
+  out[0] = 0xed + delta;
+  out[31] = 0x7f;
+}
+
+static unsigned
+test_on_curve(void) {
+  static const uint8_t basepoint[32] = {9};
+  uint8_t points[64 * 32], point[32];
+  int results[64];
+  unsigned i, fails = 0;
+
+  /* u = 0, 1, 4 and 9 are on the curve; u = 2, 3 and 5 are on the twist. */
+  static const struct { uint8_t u; int on_curve; } small[] = {
+    {0, 1}, {1, 1}, {2, 0}, {3, 0}, {4, 1}, {5, 0}, {9, 1},
+  };
+  for (i = 0; i < sizeof(small) / sizeof(small[0]); ++i) {
+    memset(point, 0, 32);
+    point[0] = small[i].u;
+    if (curve25519_donna_on_curve(point) != small[i].on_curve ||
+        curve25519_donna_on_curve_vartime(point) != small[i].on_curve) {
+      fprintf(stderr, "wrong on-curve result for u = %u\n", small[i].u);
+      fails++;
+    }
+  }
+
+  /* Public keys are on the curve; their 2^255-19 complements and a spread of
+   * arbitrary strings must agree between the three interfaces. */
+  memset(point, 42, 32);
+  for (i = 0; i < 32; ++i) {
+    curve25519_donna(points + 32 * i, point, basepoint);
+    memcpy(point, points + 32 * i, 32);
+  }
+  for (i = 32; i < 64; ++i) {
+    unsigned j;
+    for (j = 0; j < 32; ++j) points[32 * i + j] = points[32 * (i - 32) + j] * 7 + i;
+  }
+
+  if (curve25519_donna_on_curve_batch(results, points, 32) != 1) {
+    fprintf(stderr, "public key on the twist\n");
+    fails++;
+  }
+  curve25519_donna_on_curve_batch(results, points, 64);
+  for (i = 0; i < 64; ++i) {
+    if (results[i] != curve25519_donna_on_curve(points + 32 * i) ||
+        results[i] != curve25519_donna_on_curve_vartime(points + 32 * i)) {
+      fprintf(stderr, "on-curve interfaces disagree for point %u\n", i);
+      fails++;
+    }
+  }
+
+  return fails;
+}
+
+int
+main() {
+  static const uint8_t order8[2][32] = {
+    { 0xe0,0xeb,0x7a,0x7c,0x3b,0x41,0xb8,0xae,0x16,0x56,0xe3,0xfa,0xf1,0x9f,0xc4,0x6a,
+      0xda,0x09,0x8d,0xeb,0x9c,0x32,0xb1,0xfd,0x86,0x62,0x05,0x16,0x5f,0x49,0xb8,0x00 },
+    { 0x5f,0x9c,0x95,0xbc,0xa3,0x50,0x8c,0x24,0xb1,0xd0,0xb1,0x55,0x9c,0x83,0xef,0x5b,
+      0x04,0x44,0x5c,0xc4,0x58,0x1c,0x8e,0x86,0xd8,0x22,0x4e,0xdd,0xd0,0x9f,0x11,0x57 },
+  };
+  static const uint8_t basepoint[32] = {9};
+  uint8_t bad[7][32], point[32], secret[32], out[32], expected[32];
+  unsigned i, rep, top, fails = 0;
+  uint64_t start, elapsed, reject_time, dh_time;
+
+  memset(secret, 42, sizeof(secret));
+
+  memset(bad, 0, sizeof(bad));
+  bad[1][0] = 1;
+  p_plus(bad[2], -1);
+  memcpy(bad[3], order8[0], 32);
+  memcpy(bad[4], order8[1], 32);
+  p_plus(bad[5], 0);
+  p_plus(bad[6], 1);
+
+  for (i = 0; i < 7; ++i) {
+    for (top = 0; top < 2; ++top) {
+      memcpy(point, bad[i], 32);
+      point[31] |= top << 7;
+      /* Confirm that these really are points of small order. */
+      curve25519_donna(out, secret, point);
+      if (memcmp(out, bad[0], 32) != 0) {
+        fprintf(stderr, "point %u/%u isn't of small order\n", i, top);
+        fails++;
+      }
+      memset(out, 0xaa, sizeof(out));
+      if (curve25519_donna_checked(out, secret, point) != -1 ||
+          memcmp(out, bad[0], 32) != 0) {
+        fprintf(stderr, "small-order point %u/%u accepted\n", i, top);
+        fails++;
+      }
+    }
+  }
+
+  /* Non-canonical encodings of ordinary points. */
+  p_plus(point, 2);
+  if (curve25519_donna_checked(out, secret, point) != -1) {
+    fprintf(stderr, "p+2 accepted\n");
+    fails++;
+  }
+  memcpy(point, basepoint, 32);
+  point[31] |= 0x80;
+  if (curve25519_donna_checked(out, secret, point) != -1) {
+    fprintf(stderr, "9 + 2^255 accepted\n");
+    fails++;
+  }
+
+  /* An ordinary point gives the ordinary answer. */
+  curve25519_donna(expected, secret, basepoint);
+  if (curve25519_donna_checked(out, secret, basepoint) != 0 ||
+      memcmp(out, expected, 32) != 0) {
+    fprintf(stderr, "basepoint rejected\n");
+    fails++;
+  }
+  curve25519_donna(point, expected, basepoint);
+  curve25519_donna(expected, secret, point);
+  if (curve25519_donna_checked(out, secret, point) != 0 ||
+      memcmp(out, expected, 32) != 0) {
+    fprintf(stderr, "public key rejected\n");
+    fails++;
+  }
+
+  /* Only reported: a timing bound would fail on a loaded machine, and the
+   * checks above already cover what is rejected. Best of five runs each. */
+  reject_time = dh_time = UINT64_MAX;
+  for (rep = 0; rep < 5; ++rep) {
+    start = time_now();
+    for (i = 0; i < 100000; ++i) curve25519_donna_checked(out, secret, bad[3]);
+    elapsed = time_now() - start;
+    if (elapsed < reject_time) reject_time = elapsed;
+    start = time_now();
+    for (i = 0; i < 1000; ++i) curve25519_donna_checked(out, secret, basepoint);
+    elapsed = (time_now() - start) * 100;
+    if (elapsed < dh_time) dh_time = elapsed;
+  }
+  fprintf(stderr, "rejecting a point costs %.4f of a DH\n",
+          (double) reject_time / (double) (dh_time ? dh_time : 1));
+
+  fails += test_on_curve();
+
+  if (fails == 0) fprintf(stderr, "Small-order and non-canonical points rejected.\n");
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,114 @@
+/* Checks that the keypair pool hands out valid, distinct keypairs, keeps its
+ * statistics, and never gives a forked child the keys its parent will get. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "curve25519-donna.h"
+#include "curve25519-keypool.h"
+
+#define NKEYS 200
+
+static uint8_t secrets[NKEYS][32], publics[NKEYS][32];
+
+static int
+valid(const uint8_t *secret, const uint8_t *public_key) {
+  static const uint8_t basepoint[32] = {9};
+  uint8_t expected[32];
+
+  curve25519_donna(expected, secret, basepoint);
+  return memcmp(expected, public_key, 32) == 0;
+}
+
+static int
+wait_for_level(struct curve25519_keypool *pool, unsigned level) {
+  struct curve25519_keypool_stats stats;
+  struct timespec ts = {0, 1000000};
+  unsigned i;
+
+  for (i = 0; i < 10000; ++i) {
+    curve25519_keypool_stats(pool, &stats, 0);
+    if (stats.level >= level) return 0;
+    nanosleep(&ts, NULL);
+  }
+  return -1;
+}
+
+int
+main() {
+  struct curve25519_keypool *pool;
+  struct curve25519_keypool_stats stats;
+  uint8_t secret[32], public_key[32], child_secret[32];
+  unsigned i, j, fails = 0;
+  int fds[2], status;
+  pid_t pid;
+
+  pool = curve25519_keypool_new(64, 16);
+  if (!pool || wait_for_level(pool, 64) != 0) {
+    fprintf(stderr, "pool didn't fill\n");
+    return 1;
+  }
+
+  /* Take them faster than the refill thread can make them, so the pool
+   * runs low, and only then check them. */
+  for (i = 0; i < NKEYS; ++i) {
+    if (curve25519_keypool_get(pool, secrets[i], publics[i]) != 0) fails++;
+  }
+  curve25519_keypool_stats(pool, &stats, 1);
+
+  for (i = 0; i < NKEYS; ++i) {
+    if (!valid(secrets[i], publics[i])) {
+      fprintf(stderr, "keypair %u is invalid\n", i);
+      fails++;
+    }
+    for (j = 0; j < i; ++j) {
+      if (memcmp(secrets[i], secrets[j], 32) == 0) {
+        fprintf(stderr, "keypairs %u and %u are equal\n", j, i);
+        fails++;
+      }
+    }
+  }
+
+  if (stats.served + stats.misses != NKEYS || stats.low_events == 0 ||
+      stats.generated < 64 || stats.min_level >= 16) {
+    fprintf(stderr, "unexpected statistics\n");
+    fails++;
+  }
+
+  /* Both sides of a fork take a key from the same pool. The refill thread
+   * stops above the low watermark, so it needn't be full. */
+  if (wait_for_level(pool, 16) != 0 || pipe(fds) != 0) {
+    fprintf(stderr, "pool didn't refill\n");
+    return 1;
+  }
+  pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    status = curve25519_keypool_get(pool, secret, public_key) != 0 ||
+             !valid(secret, public_key);
+    if (write(fds[1], secret, 32) != 32) status = 1;
+    curve25519_keypool_free(pool);
+    _exit(status);
+  }
+  close(fds[1]);
+  curve25519_keypool_get(pool, secret, public_key);
+  if (read(fds[0], child_secret, 32) != 32 ||
+      waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+      WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "child failed\n");
+    fails++;
+  } else if (memcmp(secret, child_secret, 32) == 0) {
+    fprintf(stderr, "child got the parent's keypair\n");
+    fails++;
+  }
+  close(fds[0]);
+
+  curve25519_keypool_free(pool);
+
+  if (fails == 0) fprintf(stderr, "Keypair pool OK.\n");
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,85 @@
+/* Checks that a ladder run in pieces of any size gives curve25519_donna's
+ * result, and prints the pauses when running 32 bits at a time. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "curve25519-donna.h"
+
+static uint64_t
+time_now() {
+  struct timeval tv;
+  uint64_t ret;
+
+  gettimeofday(&tv, NULL);
+  ret = tv.tv_sec;
+  ret *= 1000000;
+  ret += tv.tv_usec;
+
+  return ret;
+}
+
+int
+main() {
+  static const unsigned steps[] = {1, 7, 32, 100, 255, 256, 1000};
+  struct curve25519_donna_ladder ladder;
+  uint8_t secret[32], point[32], expected[32], out[32];
+  unsigned i, j, k, remaining, fails = 0;
+  uint64_t start, full, step = 0, finish = 0;
+
+  memset(secret, 0x37, 32);
+  memset(point, 0, 32);
+  point[0] = 9;
+
+  for (i = 0; i < 40; ++i) {
+    for (j = 0; j < 32; ++j) secret[j] = secret[j] * 7 + i + j;
+    curve25519_donna(expected, secret, point);
+
+    for (k = 0; k < sizeof(steps) / sizeof(steps[0]); ++k) {
+      curve25519_donna_ladder_init(&ladder, secret, point);
+      /* Stop one piece early so that finish has steps left to run too. */
+      remaining = 256;
+      while (remaining > steps[k]) {
+        remaining = curve25519_donna_ladder_step(&ladder, steps[k]);
+      }
+      curve25519_donna_ladder_finish(&ladder, out);
+      if (memcmp(expected, out, 32) != 0) {
+        fprintf(stderr, "FAIL: %u-bit steps (%u)\n", steps[k], i);
+        fails++;
+      }
+    }
+
+    /* A zero-sized step does nothing; finish runs the whole ladder. */
+    curve25519_donna_ladder_init(&ladder, secret, point);
+    if (curve25519_donna_ladder_step(&ladder, 0) != 256) fails++;
+    curve25519_donna_ladder_finish(&ladder, out);
+    if (memcmp(expected, out, 32) != 0) {
+      fprintf(stderr, "FAIL: finish only (%u)\n", i);
+      fails++;
+    }
+
+    memcpy(point, expected, 32);
+  }
+
+  start = time_now();
+  for (i = 0; i < 100; ++i) curve25519_donna(out, secret, point);
+  full = time_now() - start;
+
+  for (i = 0; i < 100; ++i) {
+    curve25519_donna_ladder_init(&ladder, secret, point);
+    start = time_now();
+    for (j = 0; j < 7; ++j) curve25519_donna_ladder_step(&ladder, 32);
+    step += time_now() - start;
+    start = time_now();
+    curve25519_donna_ladder_finish(&ladder, out);
+    finish += time_now() - start;
+  }
+  fprintf(stderr, "a whole DH takes %llu us; a 32-bit step %llu us and "
+          "finishing %llu us\n", (unsigned long long) full / 100,
+          (unsigned long long) step / 700, (unsigned long long) finish / 100);
+
+  if (fails == 0) fprintf(stderr, "Resumable ladder matches curve25519_donna.\n");
+  return fails ? 1 : 0;
+}
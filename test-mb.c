@@ -0,0 +1,117 @@
+/* Feeds single jobs through the multi-buffer manager and checks that every
+ * one completes, in order, with the result curve25519_donna gives, including
+ * when partial batches are forced by flushes and deadlines. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "curve25519-donna.h"
+#include "curve25519-mb.h"
+
+#define NJOBS 100
+
+static struct curve25519_mb_job jobs[NJOBS];
+static uint8_t secrets[NJOBS][32], points[NJOBS][32], outs[NJOBS][32];
+
+static unsigned
+check_job(struct curve25519_mb_job *job, unsigned *next) {
+  const unsigned i = (unsigned) (job - jobs);
+  static const uint8_t basepoint[32] = {9};
+  uint8_t expected[32];
+
+  if (i != *next) {
+    fprintf(stderr, "job %u completed out of order (expected %u)\n", i, *next);
+    return 1;
+  }
+  (*next)++;
+
+  curve25519_donna(expected, secrets[i], job->basepoint ? points[i] : basepoint);
+  if (job->status != CURVE25519_MB_STATUS_COMPLETED ||
+      memcmp(expected, outs[i], 32) != 0) {
+    fprintf(stderr, "job %u has the wrong result\n", i);
+    return 1;
+  }
+  return 0;
+}
+
+static unsigned
+run(unsigned lanes, unsigned flush_every) {
+  struct curve25519_mb_mgr mgr;
+  struct curve25519_mb_job *done;
+  unsigned i, next = 0, fails = 0;
+
+  curve25519_mb_mgr_init(&mgr, lanes, 0);
+  for (i = 0; i < NJOBS; ++i) {
+    jobs[i].secret = secrets[i];
+    jobs[i].basepoint = (i % 3) ? points[i] : NULL;
+    jobs[i].out = outs[i];
+    for (done = curve25519_mb_submit(&mgr, &jobs[i]); done;
+         done = curve25519_mb_get_completed(&mgr)) {
+      fails += check_job(done, &next);
+    }
+    if (flush_every && i % flush_every == 0) {
+      while ((done = curve25519_mb_flush(&mgr)) != NULL) {
+        fails += check_job(done, &next);
+      }
+    }
+  }
+  while ((done = curve25519_mb_flush(&mgr)) != NULL) {
+    fails += check_job(done, &next);
+  }
+
+  if (next != NJOBS) {
+    fprintf(stderr, "only %u of %u jobs completed\n", next, NJOBS);
+    fails++;
+  }
+  if (mgr.jobs != NJOBS) fails++;
+  return fails;
+}
+
+static unsigned
+run_deadline(void) {
+  struct curve25519_mb_mgr mgr;
+  struct curve25519_mb_job *done;
+  struct timespec ts = {0, 2000000};
+  unsigned i, next = 0, fails = 0;
+
+  /* Three jobs can't fill eight lanes; the 1ms deadline must release them. */
+  curve25519_mb_mgr_init(&mgr, 8, 1000000);
+  for (i = 0; i < 3; ++i) {
+    jobs[i].basepoint = points[i];
+    if (curve25519_mb_submit(&mgr, &jobs[i]) != NULL) fails++;
+  }
+  if (curve25519_mb_poll(&mgr) != NULL) fails++;
+  nanosleep(&ts, NULL);
+  while ((done = curve25519_mb_poll(&mgr)) != NULL) {
+    fails += check_job(done, &next);
+  }
+  if (next != 3 || mgr.partial_batches != 1) {
+    fprintf(stderr, "deadline didn't run the partial batch\n");
+    fails++;
+  }
+  return fails;
+}
+
+int
+main() {
+  unsigned i, j, fails = 0;
+
+  for (i = 0; i < NJOBS; ++i) {
+    for (j = 0; j < 32; ++j) {
+      secrets[i][j] = i * 31 + j;
+      points[i][j] = i * 17 + j * 5;
+    }
+  }
+
+  fails += run(1, 0);
+  fails += run(4, 0);
+  fails += run(8, 7);
+  fails += run(CURVE25519_MB_MAX_LANES, 0);
+  fails += run(CURVE25519_MB_MAX_LANES, 1);
+  fails += run_deadline();
+
+  if (fails == 0) fprintf(stderr, "Multi-buffer jobs match curve25519_donna.\n");
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,190 @@
+/* Runs Noise XX and IK handshakes between two in-memory peers and checks that
+ * they agree on keys, that transport messages round-trip and that tampering
+ * is detected. Known-answer tests pin SHA-256, the RFC 8439 AEAD and one XX
+ * handshake, so that a bug shared by both peers can't pass.
+ *
+ * The AEAD vector needs a nonce the Noise API never produces, so this file
+ * includes curve25519-noise.c to reach the internals; the Makefile doesn't
+ * link it separately. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "curve25519-noise.c"
+
+static int
+check(int cond, const char *what) {
+  if (!cond) fprintf(stderr, "FAIL: %s\n", what);
+  return cond ? 0 : 1;
+}
+
+static void
+fill(uint8_t *out, uint8_t seed) {
+  int i;
+  for (i = 0; i < 32; ++i) out[i] = seed + 7 * i;
+}
+
+static int
+test_sha256(void) {
+  static const uint8_t abc[32] = {
+    0xba,0x78,0x16,0xbf,0x8f,0x01,0xcf,0xea,0x41,0x41,0x40,0xde,0x5d,0xae,0x22,0x23,
+    0xb0,0x03,0x61,0xa3,0x96,0x17,0x7a,0x9c,0xb4,0x10,0xff,0x61,0xf2,0x00,0x15,0xad,
+  };
+  static const uint8_t two_blocks[32] = {
+    0x24,0x8d,0x6a,0x61,0xd2,0x06,0x38,0xb8,0xe5,0xc0,0x26,0x93,0x0c,0x3e,0x60,0x39,
+    0xa3,0x3c,0xe4,0x59,0x64,0xff,0x21,0x67,0xf6,0xec,0xed,0xd4,0x19,0xdb,0x06,0xc1,
+  };
+  static const char msg[] =
+      "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+  uint8_t out[32];
+  int fails = 0;
+
+  sha256(out, (const uint8_t *) "abc", 3);
+  fails += check(memcmp(out, abc, 32) == 0, "sha256(abc)");
+  sha256(out, (const uint8_t *) msg, strlen(msg));
+  fails += check(memcmp(out, two_blocks, 32) == 0, "sha256(two blocks)");
+  return fails;
+}
+
+/* RFC 8439, section 2.8.2. The tag covers the ciphertext, so it checks the
+ * ChaCha20 half as well as Poly1305. */
+static int
+test_aead(void) {
+  static const uint8_t nonce[12] = {
+    0x07,0x00,0x00,0x00,0x40,0x41,0x42,0x43,0x44,0x45,0x46,0x47,
+  };
+  static const uint8_t ad[12] = {
+    0x50,0x51,0x52,0x53,0xc0,0xc1,0xc2,0xc3,0xc4,0xc5,0xc6,0xc7,
+  };
+  static const uint8_t expected_tag[16] = {
+    0x1a,0xe1,0x0b,0x59,0x4f,0x09,0xe2,0x6a,0x7e,0x90,0x2e,0xcb,0xd0,0x60,0x06,0x91,
+  };
+  static const char plaintext[] =
+      "Ladies and Gentlemen of the class of '99: If I could offer you only "
+      "one tip for the future, sunscreen would be it.";
+  uint8_t key[32], ciphertext[sizeof(plaintext)], tag[16];
+  const size_t len = sizeof(plaintext) - 1;
+  int i;
+
+  for (i = 0; i < 32; ++i) key[i] = 0x80 + i;
+  chacha20_xor(ciphertext, (const uint8_t *) plaintext, len, key, 1, nonce);
+  aead_tag(tag, key, nonce, ad, sizeof(ad), ciphertext, len);
+  return check(memcmp(tag, expected_tag, 16) == 0, "RFC 8439 AEAD tag");
+}
+
+/* Noise_XX_25519_ChaChaPoly_SHA256 with the keys, prologue and payloads that
+ * run_handshake uses, from an independent implementation: the handshake hash
+ * and the initiator's first transport message, "ping". */
+static const uint8_t xx_hash[32] = {
+    0x9a,0x3f,0x8b,0x1f,0xf8,0x7e,0x5d,0xf9,0x0d,0x11,0x0b,0x15,0xe2,0xf2,0x5e,0xaa,
+    0x96,0xb5,0x31,0x46,0x3f,0xdc,0xf3,0x8d,0x7f,0x10,0xa3,0x62,0x2e,0xdb,0x3b,0xd8,
+};
+static const uint8_t xx_ping[4 + NOISE_TAG_SIZE] = {
+    0x3a,0x18,0x6c,0xbf,0x23,0x18,0xcc,0x4a,0x6d,0xa2,0xf0,0x07,0x2a,0xf3,0x0e,0x9a,
+    0x69,0x7d,0x49,0x78,
+};
+
+/* |expected_hash| and |expected_ping| may be NULL. */
+static int
+run_handshake(enum noise_pattern pattern, const char *name,
+              const uint8_t *expected_hash, const uint8_t *expected_ping) {
+  struct noise_keypair is, rs;
+  struct noise_handshake ih, rh;
+  struct noise_cipherstate isend, irecv, rsend, rrecv;
+  uint8_t key[32], msg[256], payload[64], copy[256];
+  size_t msg_len, payload_len;
+  int fails = 0, i;
+
+  fill(key, 1);
+  noise_keypair_init(&is, key);
+  fill(key, 2);
+  noise_keypair_init(&rs, key);
+
+  fill(key, 3);
+  fails += check(noise_handshake_init(&ih, pattern, 1, (const uint8_t *) "p", 1,
+                                      &is, key, rs.public_key) == NOISE_OK,
+                 "initiator init");
+  fill(key, 4);
+  fails += check(noise_handshake_init(&rh, pattern, 0, (const uint8_t *) "p", 1,
+                                      &rs, key, NULL) == NOISE_OK,
+                 "responder init");
+
+  fails += check(noise_handshake_read_message(&ih, msg, 32, payload,
+                                              sizeof(payload), &payload_len)
+                     == NOISE_ERR_STATE, "initiator may not read first");
+
+  for (i = 0; !noise_handshake_is_complete(&ih); ++i) {
+    struct noise_handshake *w = (i & 1) ? &rh : &ih;
+    struct noise_handshake *r = (i & 1) ? &ih : &rh;
+
+    fails += check(noise_handshake_write_message(w, (const uint8_t *) "hello", 5,
+                                                 msg, sizeof(msg), &msg_len)
+                       == NOISE_OK, "write message");
+
+    if (i == 0) {
+      /* A tampered copy of a message must be rejected once a key exists,
+       * which for IK is already the first message. */
+      struct noise_handshake tmp = *r;
+      memcpy(copy, msg, msg_len);
+      copy[msg_len - 1] ^= 1;
+      fails += check(noise_handshake_read_message(&tmp, copy, msg_len, payload,
+                                                  sizeof(payload), &payload_len)
+                         == (pattern == NOISE_PATTERN_IK ? NOISE_ERR_DECRYPT
+                                                         : NOISE_OK),
+                     "tampered first message");
+    }
+
+    fails += check(noise_handshake_read_message(r, msg, msg_len, payload,
+                                                sizeof(payload), &payload_len)
+                       == NOISE_OK, "read message");
+    fails += check(payload_len == 5 && memcmp(payload, "hello", 5) == 0,
+                   "payload");
+  }
+
+  fails += check(noise_handshake_is_complete(&rh), "responder complete");
+  fails += check(memcmp(ih.rs, rs.public_key, 32) == 0, "initiator learned rs");
+  fails += check(memcmp(rh.rs, is.public_key, 32) == 0, "responder learned rs");
+  fails += check(memcmp(ih.h, rh.h, 32) == 0, "handshake hash");
+  if (expected_hash) {
+    fails += check(memcmp(ih.h, expected_hash, 32) == 0,
+                   "handshake hash matches the test vector");
+  }
+
+  fails += check(noise_handshake_split(&ih, &isend, &irecv) == NOISE_OK, "split");
+  fails += check(noise_handshake_split(&rh, &rsend, &rrecv) == NOISE_OK, "split");
+
+  for (i = 0; i < 3; ++i) {
+    fails += check(noise_encrypt(&isend, NULL, 0, (const uint8_t *) "ping", 4,
+                                 msg) == NOISE_OK, "encrypt");
+    if (i == 0 && expected_ping) {
+      fails += check(memcmp(msg, expected_ping, 4 + NOISE_TAG_SIZE) == 0,
+                     "transport message matches the test vector");
+    }
+    fails += check(noise_decrypt(&rrecv, NULL, 0, msg, 4 + NOISE_TAG_SIZE,
+                                 payload) == NOISE_OK &&
+                   memcmp(payload, "ping", 4) == 0, "decrypt");
+    fails += check(noise_encrypt(&rsend, NULL, 0, (const uint8_t *) "pong", 4,
+                                 msg) == NOISE_OK, "encrypt");
+    msg[0] ^= (i == 2);
+    fails += check(noise_decrypt(&irecv, NULL, 0, msg, 4 + NOISE_TAG_SIZE,
+                                 payload) == (i == 2 ? NOISE_ERR_DECRYPT
+                                                     : NOISE_OK),
+                   "decrypt");
+  }
+
+  if (fails == 0) fprintf(stderr, "%s handshake OK\n", name);
+  return fails;
+}
+
+int
+main() {
+  int fails = 0;
+
+  fails += test_sha256();
+  fails += test_aead();
+  fails += run_handshake(NOISE_PATTERN_XX, "Noise_XX", xx_hash, xx_ping);
+  fails += run_handshake(NOISE_PATTERN_IK, "Noise_IK", NULL, NULL);
+
+  return fails ? 1 : 0;
+}
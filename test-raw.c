@@ -0,0 +1,82 @@
+/* Checks unclamped scalar multiplication and single-ladder key blinding
+ * against compositions of curve25519_donna_raw calls. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "curve25519-donna.h"
+
+static unsigned
+check(int cond, const char *what, unsigned i) {
+  if (!cond) fprintf(stderr, "FAIL: %s (%u)\n", what, i);
+  return cond ? 0 : 1;
+}
+
+int
+main() {
+  static const uint8_t basepoint[32] = {9};
+  static const uint8_t order8[32] = {
+    0xe0,0xeb,0x7a,0x7c,0x3b,0x41,0xb8,0xae,0x16,0x56,0xe3,0xfa,0xf1,0x9f,0xc4,0x6a,
+    0xda,0x09,0x8d,0xeb,0x9c,0x32,0xb1,0xfd,0x86,0x62,0x05,0x16,0x5f,0x49,0xb8,0x00,
+  };
+  static const uint8_t zero[32];
+  uint8_t k[32], b[32], clamped[32], point[32], t[32], u[32], v[32];
+  unsigned i, j, fails = 0;
+
+  memset(k, 0x5a, 32);
+  memset(b, 0xc3, 32);
+  memcpy(point, basepoint, 32);
+
+  for (i = 0; i < 50; ++i) {
+    /* Arbitrary, unclamped scalars: all 256 bits and low bits set. */
+    for (j = 0; j < 32; ++j) {
+      k[j] = k[j] * 13 + i + j;
+      b[j] = b[j] * 29 + 3 * i + 1;
+    }
+
+    /* With a clamped scalar the raw function is curve25519_donna. */
+    memcpy(clamped, k, 32);
+    clamped[0] &= 248;
+    clamped[31] &= 127;
+    clamped[31] |= 64;
+    curve25519_donna(t, k, point);
+    curve25519_donna_raw(u, clamped, point);
+    fails += check(memcmp(t, u, 32) == 0, "raw matches clamped", i);
+
+    /* k(bP) = b(kP) */
+    curve25519_donna_raw(t, k, point);
+    curve25519_donna_raw(t, b, t);
+    curve25519_donna_raw(u, b, point);
+    curve25519_donna_raw(u, k, u);
+    fails += check(memcmp(t, u, 32) == 0, "raw commutes", i);
+
+    /* One blinded ladder equals two ladders, also for the order-8 point,
+     * where the reduction modulo 8l, rather than l, matters. */
+    fails += check(curve25519_donna_raw_blinded(v, k, b, point) == 0,
+                   "blinded accepts curve point", i);
+    fails += check(memcmp(t, v, 32) == 0, "blinded matches two ladders", i);
+
+    curve25519_donna_raw(t, k, order8);
+    curve25519_donna_raw(t, b, t);
+    curve25519_donna_raw_blinded(v, k, b, order8);
+    fails += check(memcmp(t, v, 32) == 0, "blinded low-order point", i);
+
+    /* The order-8 point times a multiple of eight is the point at infinity. */
+    memcpy(clamped, k, 32);
+    clamped[0] &= 248;
+    curve25519_donna_raw(t, clamped, order8);
+    fails += check(memcmp(t, zero, 32) == 0, "order 8 killed by 8", i);
+
+    curve25519_donna(point, k, basepoint);
+  }
+
+  /* u = 2 is on the twist, where reducing modulo 8l is wrong. */
+  memset(point, 0, 32);
+  point[0] = 2;
+  fails += check(curve25519_donna_raw_blinded(v, k, b, point) == -1 &&
+                 memcmp(v, zero, 32) == 0, "blinded rejects twist", 0);
+
+  if (fails == 0) fprintf(stderr, "Raw and blinded scalar multiplication OK.\n");
+  return fails ? 1 : 0;
+}
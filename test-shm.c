@@ -0,0 +1,268 @@
+/* Runs the offload service on a thread and has several processes push DH and
+ * keygen jobs through it at once, checking every result against
+ * curve25519_donna. Also checks that a client leaving with jobs in flight
+ * doesn't disturb the others, and that a client refuses a region that isn't
+ * sealed. */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "curve25519-donna.h"
+#include "curve25519-shm.h"
+
+#define NCHILDREN 3
+#define NJOBS 600
+
+static uint8_t secrets[NJOBS][32], points[NJOBS][32];
+static int ops[NJOBS], reaped[NJOBS];
+
+static void *
+serve(void *server) {
+  curve25519_shm_server_run(server);
+  return NULL;
+}
+
+static unsigned
+check_completion(const struct curve25519_shm_completion *c) {
+  static const uint8_t basepoint[32] = {9};
+  static const uint8_t zero[32];
+  const uint64_t i = c->user_data;
+  uint8_t expected[32];
+
+  if (i >= NJOBS || reaped[i]++) {
+    fprintf(stderr, "bad or duplicate completion %llu\n", (unsigned long long) i);
+    return 1;
+  }
+  if (ops[i] != CURVE25519_SHM_OP_DH && ops[i] != CURVE25519_SHM_OP_KEYGEN) {
+    return c->result == -1 ? 0 : 1;
+  }
+  if (c->result != 0) {
+    fprintf(stderr, "job %u failed\n", (unsigned) i);
+    return 1;
+  }
+  if (ops[i] == CURVE25519_SHM_OP_KEYGEN) {
+    if (memcmp(c->secret, zero, 32) == 0) {
+      fprintf(stderr, "keygen %u returned an empty secret\n", (unsigned) i);
+      return 1;
+    }
+    curve25519_donna(expected, c->secret, basepoint);
+  } else {
+    curve25519_donna(expected, secrets[i], points[i]);
+  }
+  if (memcmp(expected, c->out, 32) != 0) {
+    fprintf(stderr, "job %u: wrong result\n", (unsigned) i);
+    return 1;
+  }
+  return 0;
+}
+
+/* Submits every job, as many at a time as the client has slots for, and
+ * checks them all. Returns the number of failures. */
+static unsigned
+run_client(const char *path, unsigned seed) {
+  struct curve25519_shm_client *client = curve25519_shm_connect(path);
+  struct curve25519_shm_completion done[32];
+  unsigned i, j, n, next = 0, completed = 0, fails = 0;
+
+  if (!client) {
+    fprintf(stderr, "cannot connect\n");
+    return 1;
+  }
+
+  memset(reaped, 0, sizeof(reaped));
+  for (i = 0; i < NJOBS; ++i) {
+    for (j = 0; j < 32; ++j) {
+      secrets[i][j] = seed + i * 7 + j * 13;
+      points[i][j] = seed * 3 + i * 5 + j;
+    }
+    points[i][31] &= 0x7f;
+    ops[i] = i % 3 == 2 ? CURVE25519_SHM_OP_KEYGEN : CURVE25519_SHM_OP_DH;
+  }
+  ops[NJOBS / 2] = 77;
+
+  while (completed < NJOBS) {
+    while (next < NJOBS &&
+           curve25519_shm_submit(client, ops[next], secrets[next],
+                                 next % 5 == 0 ? NULL : points[next],
+                                 next) == 0) {
+      if (next % 5 == 0) {
+        memset(points[next], 0, 32);
+        points[next][0] = 9;
+      }
+      next++;
+    }
+    n = curve25519_shm_reap(client, done, 32);
+    if (n == 0) {
+      if (curve25519_shm_wait(client, 10000) != 1) {
+        fprintf(stderr, "daemon stopped answering\n");
+        fails++;
+        break;
+      }
+      continue;
+    }
+    for (i = 0; i < n; ++i) fails += check_completion(&done[i]);
+    completed += n;
+  }
+
+  curve25519_shm_disconnect(client);
+  return fails;
+}
+
+struct offer {
+  int listener, region;
+};
+
+/* Accepts one connection and sends it |region| as the shared region, the
+ * way the daemon sends its memfd. */
+static void *
+offer_region(void *arg) {
+  const struct offer *offer = arg;
+  int fds[3] = {offer->region, offer->region, offer->region};
+  union {
+    char buf[CMSG_SPACE(sizeof(fds))];
+    struct cmsghdr align;
+  } control;
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  char hello = 0;
+  int sock = accept(offer->listener, NULL, NULL);
+
+  if (sock < 0) return NULL;
+  memset(&msg, 0, sizeof(msg));
+  memset(&control, 0, sizeof(control));
+  iov.iov_base = &hello;
+  iov.iov_len = 1;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+  sendmsg(sock, &msg, MSG_NOSIGNAL);
+  close(sock);
+  return NULL;
+}
+
+/* Offers the client |region|, a valid region in an fd that isn't sealed,
+ * and expects the connect to fail. Closes |region|. */
+static unsigned
+check_unsealed(const char *path, int region, const char *what) {
+  struct curve25519_shm_client *client;
+  struct curve25519_shm_region *r;
+  struct sockaddr_un addr;
+  struct offer offer;
+  pthread_t thread;
+
+  offer.region = region;
+  offer.listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  unlink(path);
+  if (region < 0 || ftruncate(region, sizeof(*r)) != 0 ||
+      offer.listener < 0 ||
+      bind(offer.listener, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+      listen(offer.listener, 1) != 0 ||
+      (r = mmap(NULL, sizeof(*r), PROT_READ | PROT_WRITE, MAP_SHARED, region,
+                0)) == MAP_FAILED) {
+    fprintf(stderr, "cannot set up the %s region\n", what);
+    return 1;
+  }
+  r->magic = CURVE25519_SHM_MAGIC;
+  r->version = CURVE25519_SHM_VERSION;
+  r->entries = CURVE25519_SHM_ENTRIES;
+  munmap(r, sizeof(*r));
+
+  pthread_create(&thread, NULL, offer_region, &offer);
+  client = curve25519_shm_connect(path);
+  pthread_join(thread, NULL);
+  close(offer.listener);
+  close(region);
+  unlink(path);
+  if (client) {
+    fprintf(stderr, "client accepted an unsealed %s region\n", what);
+    curve25519_shm_disconnect(client);
+    return 1;
+  }
+  return 0;
+}
+
+int
+main() {
+  struct curve25519_shm_server *server;
+  struct curve25519_shm_client *client;
+  pthread_t thread;
+  pid_t children[NCHILDREN];
+  char path[64];
+  unsigned i, fails = 0;
+  int status;
+
+  snprintf(path, sizeof(path), "/tmp/test-shm-%d.sock", (int) getpid());
+  server = curve25519_shm_server_new(path, 2);
+  if (!server || pthread_create(&thread, NULL, serve, server) != 0) {
+    fprintf(stderr, "cannot start the server\n");
+    return 1;
+  }
+
+  for (i = 0; i < NCHILDREN; ++i) {
+    children[i] = fork();
+    if (children[i] == 0) _exit(run_client(path, i + 1) ? 1 : 0);
+  }
+
+  /* Leave with a full window in flight, while the children are busy. */
+  client = curve25519_shm_connect(path);
+  if (!client) {
+    fprintf(stderr, "cannot connect\n");
+    fails++;
+  } else {
+    memset(secrets[0], 0x42, 32);
+    while (curve25519_shm_submit(client, CURVE25519_SHM_OP_DH, secrets[0],
+                                 NULL, 0) == 0) {
+    }
+    curve25519_shm_disconnect(client);
+  }
+
+  for (i = 0; i < NCHILDREN; ++i) {
+    if (children[i] < 0 || waitpid(children[i], &status, 0) != children[i] ||
+        !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "client process %u failed\n", i);
+      fails++;
+    }
+  }
+
+  /* The service still works after all of that. */
+  fails += run_client(path, 99);
+
+  curve25519_shm_server_stop(server);
+  pthread_join(thread, NULL);
+  curve25519_shm_server_free(server);
+  if (access(path, F_OK) == 0) {
+    fprintf(stderr, "socket not removed\n");
+    fails++;
+  }
+
+  /* A file that can't carry seals, and a memfd that doesn't have them. */
+  snprintf(path, sizeof(path), "/tmp/test-shm-%d-unsealed.sock",
+           (int) getpid());
+  fails += check_unsealed(path, open("/tmp", O_TMPFILE | O_RDWR, 0600),
+                          "tmpfile");
+  fails += check_unsealed(path, memfd_create("test-shm", 0), "memfd");
+
+  if (fails == 0) fprintf(stderr, "Offload service results match curve25519_donna.\n");
+  return fails ? 1 : 0;
+}